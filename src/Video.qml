@@ -0,0 +1,18 @@
+import QtQuick
+import QtMultimedia
+
+Rectangle {
+	color: 'black'
+	VideoOutput {
+		id: videoOutput
+		property matrix4x4 colorMatrix: Qt.matrix4x4()
+		/* Neutral settings render the video directly */
+		property bool adjusted: false
+		anchors.fill: parent
+		layer.enabled: adjusted && GraphicsInfo.api !== GraphicsInfo.Software
+		layer.effect: ShaderEffect {
+			property matrix4x4 colorMatrix: videoOutput.colorMatrix
+			fragmentShader: 'colormatrix.frag.qsb'
+		}
+	}
+}
@@ -1,42 +1,71 @@
 module;
 
-#include <QAudioDecoder>
+#include <QAudioBuffer>
+#include <QAudioBufferOutput>
 #include <QMediaPlayer>
+#include <QPointer>
+#include <QThread>
 #include <QtCore/qtmochelpers.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
 #include <phonon/AudioDataOutput>
 #include <phonon/audiodataoutputinterface.h>
 
+#define TAP_CAPACITY 64
+#define USEC 1'000'000
+#define DISCONTINUITY 10'000
+#define DEFAULT_RATE 44'100
+#define SURROUND_GAIN 0.7071F
+
 export module phonon_native:audiodataoutput;
 
+import :audiotap;
+import :deinterleave;
+import :ringbuffer;
 import :sinknode;
 
 export namespace Phonon::Native {
+	/* Taps the audio the player renders. The renderer thread only queues
+	 * the buffers in a lock-free ring, they are converted, cut into blocks
+	 * of the data size and emitted on the delivery thread. */
 	class AudioDataOutput final:
 		public QObject,
 		public AudioDataOutputInterface,
 		public SinkNode {
 		Q_OBJECT
 		Q_INTERFACES(Phonon::AudioDataOutputInterface)
+		Q_PROPERTY(QThread* deliveryThread READ deliveryThread WRITE
+				setDeliveryThread)
 
 	  public:
+		/* Delivers the sample rate and channels of the source instead of
+		 * 44.1 kHz stereo */
+		static inline bool nativeFormat{};
+
 		explicit AudioDataOutput(QObject* parent):
-			QObject{parent}, m_decoder{new QAudioDecoder{parent}} {
-			QAudioFormat format{};
-			format.setChannelConfig(
-				QAudioFormat::defaultChannelConfigForChannelCount(2));
-			format.setChannelCount(2);
-			format.setSampleFormat(QAudioFormat::Int16);
-			format.setSampleRate(44'100);
-			m_decoder->setAudioFormat(format);
-			connect(
-				m_decoder,
-				&QAudioDecoder::bufferReady,
-				this,
-				[=, this]() { m_buffer << m_decoder->read(); },
-				Qt::AutoConnection);
+			QObject{parent}, m_delivery{new QObject{}},
+			m_buffers{TAP_CAPACITY} {}
+
+		~AudioDataOutput() final {
+			if(m_tap) {
+				disconnect(m_tap, nullptr, this, nullptr);
+			}
+			/* Lets queued deliveries run before the receiver goes away.
+			 * Without an event loop in the delivery thread they never
+			 * will, waiting for them would not return. */
+			auto* thread{m_delivery->thread()};
+			if(thread && thread != QThread::currentThread()
+				&& thread->isRunning()) {
+				QMetaObject::invokeMethod(
+					m_delivery, []() {}, Qt::BlockingQueuedConnection);
+				m_delivery->deleteLater();
+			} else {
+				delete m_delivery;
+			}
 		}
 
-		~AudioDataOutput() final = default;
 		AudioDataOutput(const AudioDataOutput&) = delete;
 		AudioDataOutput(AudioDataOutput&&) = delete;
 		auto operator=(const AudioDataOutput&) -> AudioDataOutput& = delete;
@@ -51,84 +80,343 @@ export namespace Phonon::Native {
 		}
 
 		auto connectToMediaPlayer(QMediaPlayer* player) -> void final {
+			m_tap = AudioTap::of(player);
+			connect(
+				m_tap,
+				&QAudioBufferOutput::audioBufferReceived,
+				this,
+				[=, this](const QAudioBuffer& buffer) { enqueue(buffer); },
+				Qt::DirectConnection);
 			connect(
 				player,
 				&QMediaPlayer::sourceChanged,
 				this,
-				[=, this](const QUrl& source) {
-					m_buffer.clear();
-					m_decoder->setSource(source);
-					m_decoder->start();
-				},
+				[=, this]() { deliver([this]() { resetBlock(); }); },
 				Qt::AutoConnection);
 			connect(
 				player,
-				&QMediaPlayer::hasVideoChanged,
+				&QMediaPlayer::mediaStatusChanged,
 				this,
-				[=, this](bool enabled) {
-					if(enabled) {
-						m_decoder->stop();
-						m_buffer.clear();
+				[=, this](QMediaPlayer::MediaStatus status) {
+					if(status == QMediaPlayer::EndOfMedia) {
+						deliver([this]() {
+							drain();
+							flushBlock();
+						});
 					}
 				},
 				Qt::AutoConnection);
-			connect(player,
-				&QMediaPlayer::positionChanged,
-				this,
-				&AudioDataOutput::onPositionChange,
-				Qt::AutoConnection);
 			SinkNode::connectToMediaPlayer(player);
 		}
 
 		auto disconnectFromMediaPlayer(QMediaPlayer* player) -> void final {
 			disconnect(player, nullptr, this, nullptr);
+			if(m_tap) {
+				disconnect(m_tap, nullptr, this, nullptr);
+				m_tap = nullptr;
+			}
 			SinkNode::disconnectFromMediaPlayer(player);
 		}
 
+		/* Thread that emits dataReady, the thread of the output by
+		 * default */
+		[[nodiscard]]
+		auto deliveryThread() const -> QThread* {
+			return m_delivery->thread();
+		}
+
+		auto setDeliveryThread(QThread* thread) -> void {
+			thread = thread ? thread : this->thread();
+			auto* current{m_delivery->thread()};
+			if(current == QThread::currentThread()) {
+				m_delivery->moveToThread(thread);
+			} else if(current && current->isRunning()) {
+				QMetaObject::invokeMethod(
+					m_delivery,
+					[=, this]() { m_delivery->moveToThread(thread); },
+					Qt::BlockingQueuedConnection);
+			} else {
+				/* Deliveries queued in a stopped thread are lost anyway */
+				delete m_delivery;
+				m_delivery = new QObject{};
+				m_delivery->moveToThread(thread);
+				m_drainPosted.store(false, std::memory_order_release);
+			}
+		}
+
 	  signals:
 		auto endOfMedia(int remainingSamples) -> void;
 		auto dataReady(
 			const QMap<Phonon::AudioDataOutput::Channel, QVector<qint16>>& data)
 			-> void;
+		/* Same as dataReady with the media time of the first frame in
+		 * microseconds */
+		auto blockReady(qint64 startTime,
+			const QMap<Phonon::AudioDataOutput::Channel, QVector<qint16>>& data)
+			-> void;
 
 	  private:
-		Phonon::AudioDataOutput* m_frontend;
-		QAudioDecoder* m_decoder;
-		QVector<QAudioBuffer> m_buffer;
-		long m_dataSize{512};
+		using Channel = Phonon::AudioDataOutput::Channel;
 
-	  public slots:
+		static constexpr std::array<Channel, 6> channels{
+			Phonon::AudioDataOutput::LeftChannel,
+			Phonon::AudioDataOutput::RightChannel,
+			Phonon::AudioDataOutput::CenterChannel,
+			Phonon::AudioDataOutput::LeftSurroundChannel,
+			Phonon::AudioDataOutput::RightSurroundChannel,
+			Phonon::AudioDataOutput::SubwooferChannel};
 
-		auto setDataSize(int size) -> void {
-			m_dataSize = size;
-		}
-
-	  private slots:
-
-		auto onPositionChange(qint64 position) -> void {
-			for(auto i{1}; i < m_buffer.size(); i++) {
-				if((m_buffer[i].startTime() / 1000) > position) {
-					auto audioData{m_buffer[i - 1].constData<qint16>()};
-					QVector<qint16> leftChannel;
-					QVector<qint16> rightChannel;
-					for(auto frame{0};
-						frame < m_dataSize
-						&& frame < (m_buffer[i - 1].sampleCount() / 2);
-						frame++) {
-						leftChannel << audioData[2 * frame];
-						rightChannel << audioData[2 * frame + 1];
+		/* Position of a Phonon channel in the frames of the format or -1.
+		 * 7.1 sources report their back pair as surround channels. */
+		[[nodiscard]]
+		static auto channelOffset(const QAudioFormat& format, Channel channel)
+			-> int {
+			if(format.channelCount() == 1) {
+				return channel == Phonon::AudioDataOutput::LeftChannel
+						|| channel == Phonon::AudioDataOutput::RightChannel
+					? 0
+					: -1;
+			}
+			auto offset{[&](QAudioFormat::AudioChannelPosition position,
+							QAudioFormat::AudioChannelPosition fallback) {
+				auto result{format.channelOffset(position)};
+				return result >= 0 ? result : format.channelOffset(fallback);
+			}};
+			switch(channel) {
+				case Phonon::AudioDataOutput::LeftChannel:
+					return format.channelOffset(QAudioFormat::FrontLeft);
+				case Phonon::AudioDataOutput::RightChannel:
+					return format.channelOffset(QAudioFormat::FrontRight);
+				case Phonon::AudioDataOutput::CenterChannel:
+					return format.channelOffset(QAudioFormat::FrontCenter);
+				case Phonon::AudioDataOutput::LeftSurroundChannel:
+					return offset(
+						QAudioFormat::BackLeft, QAudioFormat::SideLeft);
+				case Phonon::AudioDataOutput::RightSurroundChannel:
+					return offset(
+						QAudioFormat::BackRight, QAudioFormat::SideRight);
+				case Phonon::AudioDataOutput::SubwooferChannel:
+					return format.channelOffset(QAudioFormat::LFE);
+			}
+			return -1;
+		}
+
+		template<typename Function>
+		auto deliver(Function function) -> void {
+			QMetaObject::invokeMethod(
+				m_delivery, std::move(function), Qt::QueuedConnection);
+		}
+
+		/* Renderer thread, must not block. Buffers are dropped while the
+		 * ring is full. */
+		auto enqueue(const QAudioBuffer& buffer) -> void {
+			if(!m_buffers.push(buffer)) {
+				return;
+			}
+			if(!m_drainPosted.exchange(true, std::memory_order_acq_rel)) {
+				deliver([this]() { drain(); });
+			}
+		}
+
+		/* Delivery thread from here on */
+
+		auto drain() -> void {
+			m_drainPosted.store(false, std::memory_order_release);
+			while(auto buffer{m_buffers.pop()}) {
+				process(*buffer);
+			}
+		}
+
+		auto process(const QAudioBuffer& buffer) -> void {
+			auto format{buffer.format()};
+			if(format.channelConfig() == QAudioFormat::ChannelConfigUnknown) {
+				format.setChannelConfig(
+					QAudioFormat::defaultChannelConfigForChannelCount(
+						format.channelCount()));
+			}
+			auto rate{format.sampleRate()};
+			auto frames{buffer.frameCount()};
+			if(rate <= 0 || frames <= 0) {
+				return;
+			}
+			if(qAbs(buffer.startTime() - m_nextTime) > DISCONTINUITY) {
+				/* Seek or new source */
+				resetBlock();
+				m_phase = 0.0;
+				m_last.fill(0);
+			}
+			m_nextTime = buffer.startTime() + frames * USEC / rate;
+
+			/* Deinterleave the whole buffer into the scratch arrays */
+			m_scratch.resize(format.channelCount());
+			QList<qint16*> outputs(format.channelCount(), nullptr);
+			std::array<int, channels.size()> offsets{};
+			for(std::size_t i{0}; i < channels.size(); i++) {
+				offsets[i] = channelOffset(format, channels[i]);
+				if(offsets[i] >= 0 && offsets[i] < outputs.size()) {
+					m_scratch[offsets[i]].resize(frames);
+					outputs[offsets[i]] = m_scratch[offsets[i]].data();
+				} else {
+					offsets[i] = -1;
+				}
+			}
+			deinterleave(buffer,
+				frames,
+				{outputs.constData(), static_cast<size_t>(outputs.size())});
+			const auto* source{&m_scratch};
+			if(!nativeFormat) {
+				frames = convert(offsets, frames, rate);
+				rate = DEFAULT_RATE;
+				source = &m_converted;
+				offsets.fill(-1);
+				offsets[0] = 0;
+				offsets[1] = 1;
+			}
+
+			qsizetype done{0};
+			while(done < frames) {
+				auto size{static_cast<qsizetype>(
+					m_dataSize.load(std::memory_order_relaxed))};
+				if(m_blockFrames >= size) {
+					/* The data size shrank */
+					resetBlock();
+				}
+				if(m_blockFrames == 0) {
+					m_blockTime = buffer.startTime() + done * USEC / rate;
+				}
+				auto count{qMin(frames - done, size - m_blockFrames)};
+				for(std::size_t i{0}; i < channels.size(); i++) {
+					if(offsets[i] < 0) {
+						m_block.remove(channels[i]);
+						continue;
 					}
+					auto& samples{m_block[channels[i]]};
+					samples.resize(size);
+					std::copy_n((*source)[offsets[i]].constData() + done,
+						count,
+						samples.data() + m_blockFrames);
+				}
+				m_blockFrames += count;
+				done += count;
+				if(m_blockFrames >= size) {
+					emitBlock();
+				}
+			}
+		}
+
+		auto emitBlock() -> void {
+			m_blockFrames = 0;
+			emit blockReady(m_blockTime, m_block);
+			emit dataReady(m_block);
+		}
+
+		/* The last block of a source is padded with silence */
+		auto flushBlock() -> void {
+			if(m_blockFrames == 0) {
+				return;
+			}
+			emit endOfMedia(static_cast<int>(m_blockFrames));
+			for(auto& samples: m_block) {
+				std::fill(samples.begin() + m_blockFrames, samples.end(), 0);
+			}
+			emitBlock();
+		}
+
+		auto resetBlock() -> void {
+			m_blockFrames = 0;
+		}
+
+		/* Mixes the scratch channels down to stereo and resamples them
+		 * linearly to 44.1 kHz into the converted arrays. The position
+		 * between two input frames is carried over to the next buffer,
+		 * -1 is the last frame of the previous one. Returns the number of
+		 * converted frames. */
+		auto convert(const std::array<int, channels.size()>& offsets,
+			qsizetype frames,
+			int rate) -> qsizetype {
+			auto at{[&](std::size_t channel, qsizetype frame) -> float {
+				auto offset{offsets[channel]};
+				return offset < 0
+					? 0.0F
+					: static_cast<float>(m_scratch[offset][frame]);
+			}};
+			auto mono{offsets[0] >= 0 && offsets[0] == offsets[1]};
+			m_mixed.resize(2);
+			for(auto& samples: m_mixed) {
+				samples.resize(frames);
+			}
+			for(qsizetype frame{0}; frame < frames; frame++) {
+				auto left{at(0, frame)};
+				auto right{at(1, frame)};
+				if(!mono) {
+					auto center{SURROUND_GAIN * at(2, frame)};
+					left += center + SURROUND_GAIN * at(3, frame);
+					right += center + SURROUND_GAIN * at(4, frame);
+				}
+				m_mixed[0][frame] = clamp(left);
+				m_mixed[1][frame] = clamp(right);
+			}
 
-					QMap<Phonon::AudioDataOutput::Channel, QVector<qint16>>
-						data;
-					data.insert(
-						Phonon::AudioDataOutput::LeftChannel, leftChannel);
-					data.insert(
-						Phonon::AudioDataOutput::RightChannel, rightChannel);
-					emit dataReady(data);
-					break;
+			m_converted.resize(2);
+			if(rate == DEFAULT_RATE) {
+				m_converted = m_mixed;
+				return frames;
+			}
+			auto step{static_cast<double>(rate) / DEFAULT_RATE};
+			auto count{qMax<qsizetype>(0,
+				static_cast<qsizetype>(std::ceil(
+					(static_cast<double>(frames - 1) - m_phase) / step)))};
+			for(std::size_t channel{0}; channel < 2; channel++) {
+				const auto& input{m_mixed[channel]};
+				auto& output{m_converted[channel]};
+				output.resize(count);
+				auto sample{[&](qsizetype frame) -> float {
+					return static_cast<float>(
+						frame < 0 ? m_last[channel] : input[frame]);
+				}};
+				for(qsizetype i{0}; i < count; i++) {
+					auto position{m_phase + static_cast<double>(i) * step};
+					auto frame{static_cast<qsizetype>(std::floor(position))};
+					auto fraction{
+						static_cast<float>(position - std::floor(position))};
+					auto first{sample(frame)};
+					output[i] = clamp(
+						first + (sample(frame + 1) - first) * fraction);
 				}
+				m_last[channel] = input[frames - 1];
 			}
+			m_phase += static_cast<double>(count) * step
+				- static_cast<double>(frames);
+			return count;
+		}
+
+		[[nodiscard]]
+		static auto clamp(float value) -> qint16 {
+			return static_cast<qint16>(
+				std::lround(qBound(-32768.0F, value, 32767.0F)));
+		}
+
+		Phonon::AudioDataOutput* m_frontend{};
+		QPointer<QAudioBufferOutput> m_tap;
+		QObject* m_delivery;
+		RingBuffer<QAudioBuffer> m_buffers;
+		std::atomic<bool> m_drainPosted{};
+		std::atomic<int> m_dataSize{512};
+		/* Owned by the delivery thread */
+		QList<QVector<qint16>> m_scratch;
+		QList<QVector<qint16>> m_mixed;
+		QList<QVector<qint16>> m_converted;
+		std::array<qint16, 2> m_last{};
+		double m_phase{};
+		QMap<Channel, QVector<qint16>> m_block;
+		qsizetype m_blockFrames{};
+		qint64 m_blockTime{};
+		qint64 m_nextTime{};
+
+	  public slots:
+
+		auto setDataSize(int size) -> void {
+			m_dataSize.store(qMax(1, size), std::memory_order_relaxed);
 		}
 	};
 } // namespace Phonon::Native
@@ -5,6 +5,7 @@ module;
 #include <QMediaDevices>
 #include <QMediaPlayer>
 #include <QtCore/qtmochelpers.h>
+#include <array>
 #include <phonon/AudioOutputInterface>
 
 export module phonon_native:audiooutput;
@@ -27,11 +28,7 @@ export namespace Phonon::Native {
 				this,
 				&AudioOutput::mutedChanged,
 				Qt::AutoConnection);
-			connect(m_output,
-				&QAudioOutput::volumeChanged,
-				this,
-				&AudioOutput::volumeChanged,
-				Qt::AutoConnection);
+			m_gains.fill(1.0F);
 		}
 
 		~AudioOutput() final = default;
@@ -42,11 +39,15 @@ export namespace Phonon::Native {
 
 		[[nodiscard]]
 		auto volume() const -> qreal final {
-			return static_cast<qreal>(m_output->volume());
+			return m_volume;
 		}
 
 		auto setVolume(qreal volume) -> void final {
-			m_output->setVolume(static_cast<float>(volume));
+			if(!qFuzzyCompare(m_volume, volume)) {
+				m_volume = volume;
+				applyVolume();
+				emit volumeChanged(m_volume);
+			}
 		}
 
 		[[nodiscard]]
@@ -87,17 +88,35 @@ export namespace Phonon::Native {
 		}
 
 		auto disconnectFromMediaPlayer(QMediaPlayer* player) -> void final {
-			player->setAudioOutput(nullptr);
+			if(player->audioOutput() == m_output) {
+				player->setAudioOutput(nullptr);
+			}
 			SinkNode::disconnectFromMediaPlayer(player);
 		}
 
+		auto setGain(Gain stage, float gain) -> void final {
+			m_gains[stage] = gain;
+			applyVolume();
+			SinkNode::setGain(stage, gain);
+		}
+
 	  signals:
 		auto volumeChanged(qreal volume) -> void;
 		auto audioDeviceFailed() -> void;
 		void mutedChanged(bool _t1) override;
 
 	  private:
+		auto applyVolume() -> void {
+			auto volume{static_cast<float>(m_volume)};
+			for(auto gain: m_gains) {
+				volume *= gain;
+			}
+			m_output->setVolume(volume);
+		}
+
 		QAudioOutput* m_output;
+		qreal m_volume{1.0};
+		std::array<float, GainCount> m_gains{};
 	};
 } // namespace Phonon::Native
 
@@ -0,0 +1,63 @@
+module;
+
+#include <QAudioBufferOutput>
+#include <QMediaPlayer>
+#include <QMetaMethod>
+
+export module phonon_native:audiotap;
+
+export namespace Phonon::Native {
+	/* The QAudioBufferOutput of a player, shared by all nodes that read the
+	 * rendered audio. Nodes connect to audioBufferReceived with a direct
+	 * connection, which runs on the renderer thread of the player. The tap
+	 * delivers the sample rate, format and channels of the source, nodes
+	 * that need another format convert on their own threads. */
+	class AudioTap final {
+	  public:
+		AudioTap() = delete;
+
+		[[nodiscard]]
+		static auto of(QMediaPlayer* player) -> QAudioBufferOutput* {
+			if(auto* output{player->audioBufferOutput()}) {
+				return output;
+			}
+			auto* output{new Output{player}};
+			player->setAudioBufferOutput(output);
+			return output;
+		}
+
+		static auto release(QMediaPlayer* player) -> void {
+			if(auto* output{player->audioBufferOutput()}) {
+				player->setAudioBufferOutput(nullptr);
+				output->deleteLater();
+			}
+		}
+
+		/* Detaches the tap once no node is connected to it any more, the
+		 * renderer stops copying the buffers then */
+		static auto releaseUnused(QMediaPlayer* player) -> void {
+			auto* output{dynamic_cast<Output*>(player->audioBufferOutput())};
+			if(output && !output->used()) {
+				release(player);
+			}
+		}
+
+	  private:
+		class Output final: public QAudioBufferOutput {
+		  public:
+			using QAudioBufferOutput::QAudioBufferOutput;
+
+			~Output() final = default;
+			Output(const Output&) = delete;
+			Output(Output&&) = delete;
+			auto operator=(const Output&) -> Output& = delete;
+			auto operator=(Output&&) -> Output& = delete;
+
+			[[nodiscard]]
+			auto used() const -> bool {
+				return isSignalConnected(QMetaMethod::fromSignal(
+					&QAudioBufferOutput::audioBufferReceived));
+			}
+		};
+	};
+} // namespace Phonon::Native
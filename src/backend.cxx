@@ -2,19 +2,43 @@ module;
 
 #include <QAudioDevice>
 #include <QCameraDevice>
+#include <QFile>
+#include <QImage>
+#include <QJsonDocument>
 #include <QMediaDevices>
 #include <QMediaFormat>
 #include <QMimeType>
 #include <QPluginMetaDataV2>
+#include <QTimer>
 #include <QtCore/qtmochelpers.h>
 #include <phonon/BackendInterface>
 #include <phonon/GlobalDescriptionContainer>
 
 export module phonon_native;
+/* Units the tests use directly */
+export import :audiodataoutput;
+export import :audiotap;
+export import :chapterreader;
+export import :frameconverter;
+export import :readaheaddevice;
+export import :streamreader;
+export import :visualization;
 import :audiooutput;
-import :audiodataoutput;
+import :effect;
+import :effectchain;
+import :mediainfocache;
+import :keyframeindex;
+import :loadstatistics;
+import :loudnessscanner;
 import :mediaobject;
+import :playbackstatistics;
+import :playerpool;
+import :prefetchqueue;
+import :thumbnailgenerator;
 import :sinknode;
+#if defined(PHONON_EXPERIMENTAL)
+import :videodataoutput;
+#endif
 import :videowidget;
 import :volumefadereffect;
 
@@ -27,6 +51,34 @@ namespace Phonon::Native {
 		Q_OBJECT
 		Q_PLUGIN_METADATA(IID "org.kde.phonon.native" FILE "phonon-native.json")
 		Q_INTERFACES(Phonon::BackendInterface)
+		Q_PROPERTY(qint64 mediaInfoCacheHits READ mediaInfoCacheHits)
+		Q_PROPERTY(qint64 mediaInfoCacheMisses READ mediaInfoCacheMisses)
+		Q_PROPERTY(int mediaInfoCacheCapacity READ mediaInfoCacheCapacity WRITE
+				setMediaInfoCacheCapacity)
+		Q_PROPERTY(int readAheadTime READ readAheadTime WRITE setReadAheadTime)
+		Q_PROPERTY(bool audioDataNativeFormat READ audioDataNativeFormat WRITE
+				setAudioDataNativeFormat)
+		Q_PROPERTY(bool scrubbing READ scrubbing WRITE setScrubbing)
+		Q_PROPERTY(qint64 thumbnailInterval READ thumbnailInterval WRITE
+				setThumbnailInterval)
+		Q_PROPERTY(qint64 thumbnailCacheSize READ thumbnailCacheSize WRITE
+				setThumbnailCacheSize)
+		Q_PROPERTY(qint64 playerPoolHits READ playerPoolHits)
+		Q_PROPERTY(qint64 playerPoolMisses READ playerPoolMisses)
+		Q_PROPERTY(int playerPoolCapacity READ playerPoolCapacity WRITE
+				setPlayerPoolCapacity)
+		Q_PROPERTY(int prefetchDepth READ prefetchDepth WRITE setPrefetchDepth)
+		Q_PROPERTY(
+			int prefetchThreads READ prefetchThreads WRITE setPrefetchThreads)
+		Q_PROPERTY(qint64 prefetchSize READ prefetchSize WRITE setPrefetchSize)
+		Q_PROPERTY(double loudnessTarget READ loudnessTarget WRITE
+				setLoudnessTarget)
+		Q_PROPERTY(bool loudnessNormalization READ loudnessNormalization WRITE
+				setLoudnessNormalization)
+		Q_PROPERTY(int loudnessScanThreads READ loudnessScanThreads WRITE
+				setLoudnessScanThreads)
+		Q_PROPERTY(QVariantMap loadLatency READ loadLatency)
+		Q_PROPERTY(QVariantMap statistics READ statistics)
 
 	  public:
 		Backend(): Backend(nullptr, {}) {}
@@ -60,35 +112,282 @@ namespace Phonon::Native {
 				m_devices.append({VideoCaptureDeviceType,
 					{device.id(), device.description()}});
 			}
+
+			connect(ThumbnailGenerator::instance(),
+				&ThumbnailGenerator::thumbnailsChanged,
+				this,
+				&Backend::thumbnailsChanged,
+				Qt::AutoConnection);
+			connect(LoudnessScanner::instance(),
+				&LoudnessScanner::scanned,
+				this,
+				&Backend::loudnessScanned,
+				Qt::AutoConnection);
+			/* Chains record into it from their audio threads */
+			PlaybackStatistics::instance();
+			/* Loudness scans store into it from the thread pool */
+			MediaInfoCache::instance();
+			warmPlayerPool();
 		}
 
 		~Backend() final {
+			writeStatistics();
+			EffectChain::stopAll();
 			if(GlobalAudioChannels::self) {
 				delete GlobalAudioChannels::self;
 			}
 			if(GlobalSubtitles::self) {
 				delete GlobalSubtitles::self;
 			}
+			if(ThumbnailGenerator::self) {
+				delete ThumbnailGenerator::self;
+			}
+			/* Before the cache so that finished scans are saved */
+			if(LoudnessScanner::self) {
+				delete LoudnessScanner::self;
+			}
+			if(MediaInfoCache::self) {
+				delete MediaInfoCache::self;
+			}
+			if(PlayerPool::self) {
+				delete PlayerPool::self;
+			}
+			if(KeyframeIndex::self) {
+				delete KeyframeIndex::self;
+			}
+			if(PrefetchQueue::self) {
+				delete PrefetchQueue::self;
+			}
+			if(LoadStatistics::self) {
+				delete LoadStatistics::self;
+			}
+			if(PlaybackStatistics::self) {
+				delete PlaybackStatistics::self;
+			}
+			if(QuickEngine::self) {
+				delete QuickEngine::self;
+			}
+		}
+
+		[[nodiscard]]
+		auto mediaInfoCacheHits() const -> qint64 {
+			return MediaInfoCache::instance()->hits();
+		}
+
+		[[nodiscard]]
+		auto mediaInfoCacheMisses() const -> qint64 {
+			return MediaInfoCache::instance()->misses();
+		}
+
+		[[nodiscard]]
+		auto mediaInfoCacheCapacity() const -> int {
+			return MediaInfoCache::instance()->capacity();
+		}
+
+		auto setMediaInfoCacheCapacity(int capacity) -> void {
+			MediaInfoCache::instance()->setCapacity(capacity);
+		}
+
+		/* Seconds of media read ahead of local files and HTTP sources */
+		[[nodiscard]]
+		auto readAheadTime() const -> int {
+			return ReadAheadDevice::windowTime;
+		}
+
+		auto setReadAheadTime(int seconds) -> void {
+			ReadAheadDevice::windowTime = qMax(0, seconds);
+		}
+
+		/* Skips resampling audio data to 44.1 kHz Int16 stereo */
+		[[nodiscard]]
+		auto audioDataNativeFormat() const -> bool {
+			return AudioDataOutput::nativeFormat;
+		}
+
+		auto setAudioDataNativeFormat(bool enabled) -> void {
+			AudioDataOutput::nativeFormat = enabled;
+		}
+
+		/* Seek coalescing and keyframe-first seeks of all media objects */
+		[[nodiscard]]
+		auto scrubbing() const -> bool {
+			return MediaObject::scrubbing;
+		}
+
+		auto setScrubbing(bool enabled) -> void {
+			MediaObject::scrubbing = enabled;
+		}
+
+		/* Seek bar preview of the source at the position, null until it
+		 * has been generated in the background. thumbnailsChanged is
+		 * emitted as previews become available. */
+		Q_INVOKABLE auto thumbnail(const QUrl& url, qint64 position)
+			-> QImage {
+			return ThumbnailGenerator::instance()->thumbnail(url, position);
+		}
+
+		[[nodiscard]]
+		auto thumbnailInterval() const -> qint64 {
+			return ThumbnailGenerator::instance()->interval();
+		}
+
+		auto setThumbnailInterval(qint64 interval) -> void {
+			ThumbnailGenerator::instance()->setInterval(interval);
+		}
+
+		[[nodiscard]]
+		auto thumbnailCacheSize() const -> qint64 {
+			return ThumbnailGenerator::instance()->capacity();
+		}
+
+		auto setThumbnailCacheSize(qint64 size) -> void {
+			ThumbnailGenerator::instance()->setCapacity(size);
+		}
+
+		[[nodiscard]]
+		auto playerPoolHits() const -> qint64 {
+			return PlayerPool::instance()->hits();
+		}
+
+		[[nodiscard]]
+		auto playerPoolMisses() const -> qint64 {
+			return PlayerPool::instance()->misses();
+		}
+
+		[[nodiscard]]
+		auto playerPoolCapacity() const -> int {
+			return PlayerPool::instance()->capacity();
+		}
+
+		auto setPlayerPoolCapacity(int capacity) -> void {
+			PlayerPool::instance()->setCapacity(capacity);
+			warmPlayerPool();
+		}
+
+		[[nodiscard]]
+		auto prefetchDepth() const -> int {
+			return PrefetchQueue::instance()->depth();
+		}
+
+		auto setPrefetchDepth(int depth) -> void {
+			PrefetchQueue::instance()->setDepth(depth);
+		}
+
+		[[nodiscard]]
+		auto prefetchThreads() const -> int {
+			return PrefetchQueue::instance()->threads();
+		}
+
+		auto setPrefetchThreads(int threads) -> void {
+			PrefetchQueue::instance()->setThreads(threads);
+		}
+
+		[[nodiscard]]
+		auto prefetchSize() const -> qint64 {
+			return PrefetchQueue::instance()->size();
+		}
+
+		auto setPrefetchSize(qint64 size) -> void {
+			PrefetchQueue::instance()->setSize(size);
+		}
+
+		/* Measures the integrated loudness and true peak of local files in
+		 * parallel. loudnessScanned is emitted as each result is cached,
+		 * media objects normalise measured sources when loading them. */
+		Q_INVOKABLE auto scanLoudness(const QList<QUrl>& urls) -> void {
+			LoudnessScanner::instance()->scan(urls);
+		}
+
+		/* LUFS, -18 by default as with ReplayGain 2 */
+		[[nodiscard]]
+		auto loudnessTarget() const -> double {
+			return LoudnessScanner::target;
+		}
+
+		auto setLoudnessTarget(double target) -> void {
+			LoudnessScanner::target = target;
+		}
+
+		[[nodiscard]]
+		auto loudnessNormalization() const -> bool {
+			return LoudnessScanner::normalization;
+		}
+
+		auto setLoudnessNormalization(bool enabled) -> void {
+			LoudnessScanner::normalization = enabled;
+		}
+
+		/* One per core by default */
+		[[nodiscard]]
+		auto loudnessScanThreads() const -> int {
+			return LoudnessScanner::instance()->threads();
+		}
+
+		auto setLoudnessScanThreads(int threads) -> void {
+			LoudnessScanner::instance()->setThreads(threads);
+		}
+
+		/* Load latency percentiles of all media objects per phase */
+		[[nodiscard]]
+		auto loadLatency() const -> QVariantMap {
+			return LoadStatistics::instance()->toVariantMap();
+		}
+
+		/* All counters and latency percentiles, suitable for
+		 * QJsonDocument::fromVariant */
+		[[nodiscard]]
+		auto statistics() const -> QVariantMap {
+			return {{"version"_L1, QLatin1String{PHONON_MPV_VERSION}},
+				{"load"_L1, LoadStatistics::instance()->toVariantMap()},
+				{"playback"_L1, PlaybackStatistics::instance()->toVariantMap()},
+				{"videoWidget"_L1,
+					QVariantMap{
+						{"construction"_L1,
+							VideoWidget::constructionTime.toVariantMap()},
+						{"frame"_L1, VideoWidget::frameTime.toVariantMap()},
+						{"snapshot"_L1,
+							VideoWidget::snapshotTime.toVariantMap()}}},
+				{"mediaInfoCache"_L1,
+					QVariantMap{{"hits"_L1, mediaInfoCacheHits()},
+						{"misses"_L1, mediaInfoCacheMisses()}}},
+				{"playerPool"_L1,
+					QVariantMap{{"hits"_L1, playerPoolHits()},
+						{"misses"_L1, playerPoolMisses()}}}};
 		}
 
 		auto createObject(BackendInterface::Class classType, QObject* parent,
-			const QList<QVariant>& /*args*/) -> QObject* final {
+			const QList<QVariant>& args) -> QObject* final {
 			switch(classType) {
 				case MediaObjectClass:
-					return new MediaObject{parent};
+					{
+						auto* mediaObject{new MediaObject{
+							parent, PlayerPool::instance()->acquire(nullptr)}};
+						warmPlayerPool();
+						return mediaObject;
+					}
 				case AudioOutputClass:
 					return new AudioOutput{parent};
 				case AudioDataOutputClass:
 					return new AudioDataOutput(parent);
 				case EffectClass:
-					/* We have no effects */
-					return nullptr;
+					{
+						auto type{args.isEmpty() ? -1 : args.first().toInt()};
+						if(type >= 0 && type < AudioEffect::TypeCount) {
+							return new AudioEffect{
+								parent, static_cast<AudioEffect::Type>(type)};
+						}
+					}
+					break;
 				case VideoWidgetClass:
 					return new VideoWidget(qobject_cast<QWidget*>(parent));
 				case VolumeFaderEffectClass:
 					return new VolumeFaderEffect(parent);
 				case VisualizationClass:
+					return new Visualization{parent};
 				case VideoDataOutputClass:
+#if defined(PHONON_EXPERIMENTAL)
+					return new VideoDataOutput{parent};
+#endif
 				case VideoGraphicsObjectClass:
 					break;
 			}
@@ -130,7 +429,9 @@ namespace Phonon::Native {
 					}
 					break;
 				case EffectType:
-					/* We have no effects */
+					for(auto i{0}; i < AudioEffect::TypeCount; i++) {
+						list << i;
+					}
 					break;
 				case SubtitleType:
 					list << GlobalSubtitles::instance()->globalIndexes();
@@ -179,7 +480,13 @@ namespace Phonon::Native {
 					}
 					break;
 				case EffectType:
-					{ /* We have no effects */
+					if(index >= 0 && index < AudioEffect::TypeCount) {
+						const auto& description{
+							AudioEffect::descriptions[index]};
+						properties.insert("name"_ba,
+							QString::fromLatin1(description.name));
+						properties.insert("description"_ba,
+							QString::fromLatin1(description.description));
 					}
 					break;
 				case SubtitleType:
@@ -207,14 +514,13 @@ namespace Phonon::Native {
 			if(sinkNode) {
 				MediaObject* mediaObject{qobject_cast<MediaObject*>(source)};
 				if(mediaObject) {
-					sinkNode->connectToMediaPlayer(mediaObject->m_player);
+					mediaObject->addSink(sinkNode);
 					return true;
 				}
 
 				SinkNode* sinkSourceNode{dynamic_cast<SinkNode*>(source)};
 				if(sinkSourceNode) {
-					sinkNode->connectToMediaPlayer(
-						sinkSourceNode->mediaPlayer());
+					sinkSourceNode->addSink(sinkNode);
 					return true;
 				}
 			}
@@ -228,14 +534,13 @@ namespace Phonon::Native {
 				MediaObject* const mediaObject{
 					qobject_cast<MediaObject*>(source)};
 				if(mediaObject) {
-					sinkNode->disconnectFromMediaPlayer(mediaObject->m_player);
+					mediaObject->removeSink(sinkNode);
 					return true;
 				}
 
 				SinkNode* sinkSourceNode{dynamic_cast<SinkNode*>(source)};
 				if(sinkSourceNode) {
-					sinkNode->disconnectFromMediaPlayer(
-						sinkSourceNode->mediaPlayer());
+					sinkSourceNode->removeSink(sinkNode);
 					return true;
 				}
 			}
@@ -247,8 +552,32 @@ namespace Phonon::Native {
 			return true;
 		}
 
+	  private:
+		/* Refills the pool once the event loop is idle again */
+		auto warmPlayerPool() -> void {
+			QTimer::singleShot(
+				0, this, []() { PlayerPool::instance()->warm(); });
+		}
+
+		/* Saves the statistics as JSON to the file named by
+		 * PHONON_NATIVE_STATS_FILE so that runs can be compared */
+		auto writeStatistics() const -> void {
+			auto path{qEnvironmentVariable("PHONON_NATIVE_STATS_FILE")};
+			if(path.isEmpty()) {
+				return;
+			}
+			QFile file{path};
+			if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+				qDebug() << "Cannot write statistics to" << path;
+				return;
+			}
+			file.write(QJsonDocument::fromVariant(statistics()).toJson());
+		}
+
 	  signals:
 		auto objectDescriptionChanged(ObjectDescriptionType /*unused*/) -> void;
+		auto thumbnailsChanged(const QUrl& _t1) -> void;
+		auto loudnessScanned(const QUrl& _t1) -> void;
 
 	  private:
 		QVector<QPair<ObjectDescriptionType, DeviceAccess>> m_devices;
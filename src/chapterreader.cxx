@@ -0,0 +1,405 @@
+module;
+
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QString>
+#include <QtEndian>
+#include <algorithm>
+#include <optional>
+#include <string_view>
+
+#define EBML_CHAPTERS 0x1043A770
+#define EBML_EDITIONENTRY 0x45B9
+#define EBML_CHAPTERATOM 0xB6
+#define EBML_CHAPTERTIMESTART 0x91
+#define EBML_CHAPTERTIMEEND 0x92
+#define EBML_CHAPTERFLAGHIDDEN 0x98
+#define NSEC 1'000'000'000.0
+#define CHPL_UNIT 10'000'000.0
+#define OGG_PAGE_HEADER 27
+#define OGG_TAIL_SCAN 65'536
+#define MAX_CHAPTERS 4096
+
+export module phonon_native:chapterreader;
+
+import :containerreader;
+
+using Qt::Literals::StringLiterals::operator""_L1;
+
+export namespace Phonon::Native {
+	/* Reads chapter marks straight from the container of a local file.
+	 * The file is memory-mapped so only the pages holding the headers
+	 * are actually read. */
+	class ChapterReader final: private ContainerReader {
+	  public:
+		using Chapters = QList<QPair<float, float>>;
+
+		/* Returns std::nullopt if the container is unknown or broken. */
+		[[nodiscard]]
+		static auto read(const QString& path) -> std::optional<Chapters> {
+			return mapFile(
+				path, OGG_PAGE_HEADER, [](const uchar* data, qint64 size) {
+					return ChapterReader{data, size}.parse();
+				});
+		}
+
+	  private:
+		ChapterReader(const uchar* data, qint64 size):
+			ContainerReader{data, size} {}
+
+		static auto finish(Chapters chapters, double duration) -> Chapters {
+			std::sort(chapters.begin(), chapters.end());
+			for(auto i{0}; i < chapters.size(); i++) {
+				if(chapters[i].second < chapters[i].first) {
+					chapters[i].second = i + 1 < chapters.size()
+						? chapters[i + 1].first
+						: qMax(static_cast<float>(duration),
+							  chapters[i].first);
+				}
+			}
+			return chapters;
+		}
+
+		auto parse() const -> std::optional<Chapters> {
+			if(matches(0, "\x1A\x45\xDF\xA3")) {
+				return readMatroska();
+			}
+			if(matches(4, "ftyp")) {
+				return readMp4();
+			}
+			if(matches(0, "OggS")) {
+				return readOgg();
+			}
+			if(matches(0, "fLaC")) {
+				return readFlac();
+			}
+			return std::nullopt;
+		}
+
+		auto readMatroska() const -> std::optional<Chapters> {
+			auto segment{readSegment({EBML_CHAPTERS})};
+			if(!segment) {
+				return std::nullopt;
+			}
+			auto chapters{segment->elements.find(EBML_CHAPTERS)};
+
+			Chapters result;
+			if(chapters == segment->elements.end()) {
+				return result;
+			}
+			forEachElement(*chapters, [&](const Element& edition) {
+				if(edition.id != EBML_EDITIONENTRY) {
+					return true;
+				}
+				forEachElement(edition, [&](const Element& atom) {
+					if(atom.id != EBML_CHAPTERATOM) {
+						return true;
+					}
+					double start{};
+					double end{-1};
+					bool hidden{};
+					forEachElement(atom, [&](const Element& entry) {
+						if(entry.id == EBML_CHAPTERTIMESTART) {
+							start = static_cast<double>(readUnsigned(entry))
+								/ NSEC;
+						} else if(entry.id == EBML_CHAPTERTIMEEND) {
+							end = static_cast<double>(readUnsigned(entry))
+								/ NSEC;
+						} else if(entry.id == EBML_CHAPTERFLAGHIDDEN) {
+							hidden = readUnsigned(entry) != 0;
+						}
+						return true;
+					});
+					if(!hidden) {
+						result << QPair<float, float>{
+							static_cast<float>(start), static_cast<float>(end)};
+					}
+					return true;
+				});
+				/* Only the first edition is played by default */
+				return false;
+			});
+			return finish(result,
+				segment->duration * static_cast<double>(segment->timecodeScale)
+					/ NSEC);
+		}
+
+		/* MP4 / QuickTime */
+
+		auto readMp4() const -> std::optional<Chapters> {
+			auto moov{findBox({0, 0, m_size}, fourcc("moov"))};
+			if(!moov) {
+				return std::nullopt;
+			}
+			double duration{};
+			if(auto mvhd{findBox(*moov, fourcc("mvhd"))}) {
+				auto [timescale, length]{readTimescale(*mvhd)};
+				if(timescale != 0) {
+					duration = static_cast<double>(length) / timescale;
+				}
+			}
+
+			if(auto udta{findBox(*moov, fourcc("udta"))}) {
+				if(auto chpl{findBox(*udta, fourcc("chpl"))}) {
+					return finish(readChpl(*chpl), duration);
+				}
+			}
+
+			QMap<quint32, Element> tracks;
+			QList<quint32> chapterTracks;
+			forEachBox(*moov, [&](const Element& trak) {
+				if(trak.id != fourcc("trak")) {
+					return true;
+				}
+				if(auto tkhd{findBox(trak, fourcc("tkhd"))}) {
+					tracks.insert(bigEndian<quint32>(tkhd->data
+									  + (byte(tkhd->data) == 1 ? 20 : 12)),
+						trak);
+				}
+				if(auto tref{findBox(trak, fourcc("tref"))}) {
+					if(auto chap{findBox(*tref, fourcc("chap"))}) {
+						for(qint64 i{0}; i + 4 <= chap->size; i += 4) {
+							chapterTracks << bigEndian<quint32>(chap->data + i);
+						}
+					}
+				}
+				return true;
+			});
+			for(auto id: chapterTracks) {
+				if(tracks.contains(id)) {
+					return finish(readChapterTrack(tracks[id]), duration);
+				}
+			}
+			return Chapters{};
+		}
+
+		[[nodiscard]]
+		auto readChpl(const Element& chpl) const -> Chapters {
+			Chapters result;
+			auto offset{chpl.data};
+			auto end{chpl.data + chpl.size};
+			offset += byte(offset) == 1 ? 8 : 4;
+			if(offset >= end) {
+				return result;
+			}
+			auto count{m_data[offset++]};
+			for(auto i{0}; i < count && offset + 9 <= end
+				&& result.size() < MAX_CHAPTERS;
+				i++) {
+				result << QPair<float, float>{
+					static_cast<float>(
+						static_cast<double>(bigEndian<quint64>(offset))
+						/ CHPL_UNIT),
+					-1.0F};
+				offset += 9 + m_data[offset + 8];
+			}
+			return result;
+		}
+
+		/* QuickTime chapter tracks store one text sample per chapter, so
+		 * the sample timing table is all that is needed. */
+		[[nodiscard]]
+		auto readChapterTrack(const Element& trak) const -> Chapters {
+			Chapters result;
+			auto mdia{findBox(trak, fourcc("mdia"))};
+			if(!mdia) {
+				return result;
+			}
+			auto mdhd{findBox(*mdia, fourcc("mdhd"))};
+			auto stts{findBox(
+				*mdia, {fourcc("minf"), fourcc("stbl"), fourcc("stts")})};
+			if(!mdhd || !stts) {
+				return result;
+			}
+			auto [timescale, length]{readTimescale(*mdhd)};
+			if(timescale == 0) {
+				return result;
+			}
+			quint64 time{};
+			auto entries{bigEndian<quint32>(stts->data + 4)};
+			for(quint32 i{0}; i < entries
+				&& static_cast<qint64>(i) * 8 + 16 <= stts->size;
+				i++) {
+				auto count{bigEndian<quint32>(stts->data + 8 + i * 8)};
+				auto delta{bigEndian<quint32>(stts->data + 12 + i * 8)};
+				for(quint32 sample{0};
+					sample < count && result.size() < MAX_CHAPTERS;
+					sample++) {
+					result << QPair<float, float>{
+						static_cast<float>(
+							static_cast<double>(time) / timescale),
+						static_cast<float>(
+							static_cast<double>(time + delta) / timescale)};
+					time += delta;
+				}
+			}
+			return result;
+		}
+
+		/* Vorbis comments (Ogg Vorbis/Opus/FLAC and native FLAC) */
+
+		static auto parseTime(const QString& value) -> float {
+			auto time{0.0F};
+			for(const auto& part: value.trimmed().split(u':')) {
+				time = time * 60.0F + part.toFloat(nullptr);
+			}
+			return time;
+		}
+
+		static auto readComments(QByteArrayView block, double duration)
+			-> Chapters {
+			auto readLength{[&](qsizetype offset) -> qsizetype {
+				return offset + 4 <= block.size()
+					? qFromLittleEndian<quint32>(block.data() + offset)
+					: block.size();
+			}};
+			QMap<int, float> starts;
+			qsizetype offset{4 + readLength(0)};
+			auto count{readLength(offset)};
+			offset += 4;
+			for(qsizetype i{0}; i < count && offset < block.size()
+				&& starts.size() < MAX_CHAPTERS;
+				i++) {
+				auto length{readLength(offset)};
+				offset += 4;
+				if(length > block.size() - offset) {
+					break;
+				}
+				auto comment{QString::fromUtf8(block.sliced(offset, length))};
+				offset += length;
+				auto key{comment.section(u'=', 0, 0)};
+				if(!key.startsWith("CHAPTER"_L1, Qt::CaseInsensitive)) {
+					continue;
+				}
+				auto ok{false};
+				auto index{key.mid(7).toInt(&ok, 10)};
+				if(ok) {
+					starts.insert(index, parseTime(comment.section(u'=', 1)));
+				}
+			}
+			Chapters result;
+			for(auto start: starts) {
+				result << QPair<float, float>{start, -1.0F};
+			}
+			return finish(result, duration);
+		}
+
+		auto readOgg() const -> std::optional<Chapters> {
+			QByteArray packets[2];
+			QByteArray packet;
+			auto index{0};
+			quint32 serial{littleEndian<quint32>(14)};
+			qint64 offset{0};
+			while(index < 2 && matches(offset, "OggS")
+				&& available(offset, OGG_PAGE_HEADER)) {
+				auto segments{m_data[offset + 26]};
+				auto data{offset + OGG_PAGE_HEADER + segments};
+				if(!available(offset + OGG_PAGE_HEADER, segments)) {
+					return std::nullopt;
+				}
+				auto own{littleEndian<quint32>(offset + 14) == serial};
+				for(auto i{0}; i < segments && index < 2; i++) {
+					auto lacing{m_data[offset + OGG_PAGE_HEADER + i]};
+					if(!available(data, lacing)) {
+						return std::nullopt;
+					}
+					if(own) {
+						packet.append(
+							reinterpret_cast<const char*>(m_data + data),
+							lacing);
+						if(lacing < 255) {
+							packets[index++] = packet;
+							packet.clear();
+						}
+					}
+					data += lacing;
+				}
+				offset = data;
+			}
+			if(index < 2) {
+				return std::nullopt;
+			}
+
+			quint32 rate{};
+			qint64 skip{};
+			qsizetype comments{};
+			const auto& header{packets[0]};
+			if(header.startsWith("\x01vorbis") && header.size() >= 16) {
+				rate = qFromLittleEndian<quint32>(header.constData() + 12);
+				comments = 7;
+			} else if(header.startsWith("OpusHead") && header.size() >= 12) {
+				rate = 48'000;
+				skip = qFromLittleEndian<quint16>(header.constData() + 10);
+				comments = 8;
+			} else if(header.startsWith("\x7F"
+										"FLAC")
+				&& header.size() >= 30) {
+				rate = (static_cast<quint32>(static_cast<uchar>(header[27]))
+						   << 12)
+					| (static_cast<quint32>(static_cast<uchar>(header[28]))
+						<< 4)
+					| (static_cast<quint32>(static_cast<uchar>(header[29]))
+						>> 4);
+				comments = 4;
+			} else {
+				return Chapters{};
+			}
+
+			double duration{};
+			for(auto page{m_size - OGG_PAGE_HEADER};
+				rate != 0 && page >= qMax<qint64>(0, m_size - OGG_TAIL_SCAN);
+				page--) {
+				if(matches(page, "OggS")
+					&& littleEndian<quint32>(page + 14) == serial) {
+					duration = static_cast<double>(
+								   littleEndian<qint64>(page + 6) - skip)
+						/ rate;
+					break;
+				}
+			}
+			return readComments(
+				QByteArrayView{packets[1]}.sliced(
+					qMin(comments, packets[1].size())),
+				duration);
+		}
+
+		auto readFlac() const -> std::optional<Chapters> {
+			double duration{};
+			qint64 offset{4};
+			while(available(offset, 4)) {
+				auto header{m_data[offset]};
+				qint64 length{(m_data[offset + 1] << 16)
+					| (m_data[offset + 2] << 8) | m_data[offset + 3]};
+				offset += 4;
+				if(!available(offset, length)) {
+					return std::nullopt;
+				}
+				switch(header & 0x7F) {
+					case 0:
+						if(length >= 18) {
+							auto rate{(m_data[offset + 10] << 12)
+								| (m_data[offset + 11] << 4)
+								| (m_data[offset + 12] >> 4)};
+							auto samples{(static_cast<quint64>(
+												 m_data[offset + 13] & 0x0F)
+												 << 32)
+								| bigEndian<quint32>(offset + 14)};
+							if(rate != 0) {
+								duration = static_cast<double>(samples) / rate;
+							}
+						}
+						break;
+					case 4:
+						return readComments(
+							QByteArrayView{m_data + offset, length}, duration);
+				}
+				if(header & 0x80) {
+					break;
+				}
+				offset += length;
+			}
+			return Chapters{};
+		}
+	};
+} // namespace Phonon::Native
@@ -0,0 +1,19 @@
+#version 440
+
+layout(location = 0) in vec2 qt_TexCoord0;
+layout(location = 0) out vec4 fragColor;
+
+layout(std140, binding = 0) uniform buf {
+	mat4 qt_Matrix;
+	float qt_Opacity;
+	/* Brightness, contrast, saturation and hue in one affine transform */
+	mat4 colorMatrix;
+};
+
+layout(binding = 1) uniform sampler2D source;
+
+void main() {
+	vec4 color = texture(source, qt_TexCoord0);
+	vec3 rgb = clamp((colorMatrix * vec4(color.rgb, 1.0)).rgb, 0.0, 1.0);
+	fragColor = vec4(rgb, 1.0) * color.a * qt_Opacity;
+}
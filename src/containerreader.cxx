@@ -0,0 +1,346 @@
+module;
+
+#include <QFile>
+#include <QMap>
+#include <QString>
+#include <QtEndian>
+#include <algorithm>
+#include <bit>
+#include <optional>
+#include <string_view>
+
+#define EBML_HEADER 0x1A45DFA3
+#define EBML_SEGMENT 0x18538067
+#define EBML_SEEKHEAD 0x114D9B74
+#define EBML_SEEK 0x4DBB
+#define EBML_SEEKID 0x53AB
+#define EBML_SEEKPOSITION 0x53AC
+#define EBML_INFO 0x1549A966
+#define EBML_TIMECODESCALE 0x2AD7B1
+#define EBML_DURATION 0x4489
+#define EBML_CLUSTER 0x1F43B675
+
+export module phonon_native:containerreader;
+
+export namespace Phonon::Native {
+	/* Bounds-checked primitives for parsing Matroska and MP4 structures from
+	 * a memory-mapped file. */
+	class ContainerReader {
+	  public:
+		ContainerReader(const ContainerReader&) = delete;
+		ContainerReader(ContainerReader&&) = delete;
+		auto operator=(const ContainerReader&) -> ContainerReader& = delete;
+		auto operator=(ContainerReader&&) -> ContainerReader& = delete;
+
+	  protected:
+		struct Element {
+			quint64 id{};
+			qint64 data{};
+			qint64 size{};
+		};
+
+		struct Segment {
+			Element element;
+			quint64 timecodeScale{1'000'000};
+			double duration{};
+			/* Top level elements found before the first cluster or through
+			 * the seek head */
+			QMap<quint64, Element> elements;
+		};
+
+		ContainerReader(const uchar* data, qint64 size):
+			m_data{data}, m_size{size} {}
+
+		~ContainerReader() = default;
+
+		/* Maps the file and passes it to the parser, which returns an
+		 * optional. */
+		template<typename Parse>
+		static auto mapFile(const QString& path, qint64 minimum, Parse parse)
+			-> decltype(parse(nullptr, 0)) {
+			QFile file{path};
+			if(!file.open(QIODevice::ReadOnly) || file.size() < minimum) {
+				return std::nullopt;
+			}
+			auto* data{file.map(0, file.size(), QFileDevice::NoOptions)};
+			if(!data) {
+				return std::nullopt;
+			}
+			auto result{parse(data, file.size())};
+			file.unmap(data);
+			return result;
+		}
+
+		static constexpr auto fourcc(const char (&code)[5]) -> quint64 {
+			return (static_cast<quint64>(static_cast<uchar>(code[0])) << 24)
+				| (static_cast<quint64>(static_cast<uchar>(code[1])) << 16)
+				| (static_cast<quint64>(static_cast<uchar>(code[2])) << 8)
+				| static_cast<quint64>(static_cast<uchar>(code[3]));
+		}
+
+		[[nodiscard]]
+		auto available(qint64 offset, qint64 length) const -> bool {
+			return offset >= 0 && length >= 0 && offset <= m_size
+				&& length <= m_size - offset;
+		}
+
+		[[nodiscard]]
+		auto matches(qint64 offset, std::string_view magic) const -> bool {
+			return available(offset, static_cast<qint64>(magic.size()))
+				&& std::equal(magic.begin(),
+					magic.end(),
+					m_data + offset,
+					[](char lhs, uchar rhs) {
+						return static_cast<uchar>(lhs) == rhs;
+					});
+		}
+
+		[[nodiscard]]
+		auto byte(qint64 offset) const -> uchar {
+			return available(offset, 1) ? m_data[offset] : uchar{};
+		}
+
+		template<typename T>
+		[[nodiscard]]
+		auto bigEndian(qint64 offset) const -> T {
+			return available(offset, sizeof(T))
+				? qFromBigEndian<T>(m_data + offset)
+				: T{};
+		}
+
+		template<typename T>
+		[[nodiscard]]
+		auto littleEndian(qint64 offset) const -> T {
+			return available(offset, sizeof(T))
+				? qFromLittleEndian<T>(m_data + offset)
+				: T{};
+		}
+
+		/* Matroska */
+
+		auto readVint(qint64& offset, bool marker) const
+			-> std::optional<std::pair<quint64, int>> {
+			if(!available(offset, 1) || m_data[offset] == 0) {
+				return std::nullopt;
+			}
+			auto first{m_data[offset]};
+			auto length{std::countl_zero(first) + 1};
+			if(!available(offset, length)) {
+				return std::nullopt;
+			}
+			quint64 value{marker ? first : (first & (0xFFU >> length))};
+			for(auto i{1}; i < length; i++) {
+				value = (value << 8) | m_data[offset + i];
+			}
+			offset += length;
+			return std::pair{value, length};
+		}
+
+		auto readElement(qint64 offset, qint64 end) const
+			-> std::optional<Element> {
+			auto id{readVint(offset, true)};
+			auto size{readVint(offset, false)};
+			if(!id || !size || offset > end) {
+				return std::nullopt;
+			}
+			auto unknown{(quint64{1} << (7 * size->second)) - 1};
+			auto remaining{static_cast<quint64>(end - offset)};
+			return Element{id->first,
+				offset,
+				static_cast<qint64>(size->first == unknown
+						? remaining
+						: qMin(size->first, remaining))};
+		}
+
+		template<typename Visitor>
+		auto forEachElement(const Element& parent, Visitor visit) const
+			-> void {
+			auto offset{parent.data};
+			auto end{parent.data + parent.size};
+			while(offset < end) {
+				auto element{readElement(offset, end)};
+				if(!element || !visit(*element)) {
+					return;
+				}
+				offset = element->data + element->size;
+			}
+		}
+
+		[[nodiscard]]
+		auto readUnsigned(const Element& element) const -> quint64 {
+			quint64 value{};
+			for(qint64 i{0}; i < qMin<qint64>(element.size, 8); i++) {
+				value = (value << 8) | m_data[element.data + i];
+			}
+			return value;
+		}
+
+		[[nodiscard]]
+		auto readFloat(const Element& element) const -> double {
+			if(element.size == 4) {
+				return static_cast<double>(
+					std::bit_cast<float>(bigEndian<quint32>(element.data)));
+			}
+			if(element.size == 8) {
+				return std::bit_cast<double>(bigEndian<quint64>(element.data));
+			}
+			return {};
+		}
+
+		/* Reads the segment info and locates the requested top level
+		 * elements, following the seek head for those stored behind the
+		 * clusters. */
+		[[nodiscard]]
+		auto readSegment(std::initializer_list<quint64> ids) const
+			-> std::optional<Segment> {
+			auto header{readElement(0, m_size)};
+			if(!header || header->id != EBML_HEADER) {
+				return std::nullopt;
+			}
+			auto element{readElement(header->data + header->size, m_size)};
+			if(!element || element->id != EBML_SEGMENT) {
+				return std::nullopt;
+			}
+
+			Segment segment{*element};
+			QMap<quint64, qint64> positions;
+			forEachElement(*element, [&](const Element& child) {
+				switch(child.id) {
+					case EBML_SEEKHEAD:
+						forEachElement(child, [&](const Element& seek) {
+							quint64 id{};
+							qint64 position{-1};
+							forEachElement(seek, [&](const Element& entry) {
+								if(entry.id == EBML_SEEKID) {
+									id = readUnsigned(entry);
+								} else if(entry.id == EBML_SEEKPOSITION) {
+									position = static_cast<qint64>(
+										readUnsigned(entry));
+								}
+								return true;
+							});
+							if(seek.id == EBML_SEEK && position >= 0) {
+								positions.insert(id, element->data + position);
+							}
+							return true;
+						});
+						break;
+					case EBML_INFO:
+						forEachElement(child, [&](const Element& info) {
+							if(info.id == EBML_TIMECODESCALE) {
+								segment.timecodeScale = readUnsigned(info);
+							} else if(info.id == EBML_DURATION) {
+								segment.duration = readFloat(info);
+							}
+							return true;
+						});
+						break;
+					case EBML_CLUSTER:
+						return false;
+					default:
+						if(std::find(ids.begin(), ids.end(), child.id)
+							!= ids.end()) {
+							segment.elements.insert(child.id, child);
+						}
+						break;
+				}
+				return true;
+			});
+			for(auto id: ids) {
+				if(segment.elements.contains(id) || !positions.contains(id)) {
+					continue;
+				}
+				auto target{readElement(
+					positions[id], element->data + element->size)};
+				if(target && target->id == id) {
+					segment.elements.insert(id, *target);
+				}
+			}
+			return segment;
+		}
+
+		/* MP4 / QuickTime */
+
+		auto readBox(qint64 offset, qint64 end) const
+			-> std::optional<Element> {
+			if(!available(offset, 8) || end - offset < 8) {
+				return std::nullopt;
+			}
+			quint64 size{bigEndian<quint32>(offset)};
+			auto type{bigEndian<quint32>(offset + 4)};
+			qint64 header{8};
+			if(size == 1) {
+				if(end - offset < 16) {
+					return std::nullopt;
+				}
+				size = bigEndian<quint64>(offset + 8);
+				header = 16;
+			} else if(size == 0) {
+				size = static_cast<quint64>(end - offset);
+			}
+			if(size < static_cast<quint64>(header)
+				|| size > static_cast<quint64>(end - offset)) {
+				return std::nullopt;
+			}
+			return Element{
+				type, offset + header, static_cast<qint64>(size) - header};
+		}
+
+		template<typename Visitor>
+		auto forEachBox(const Element& parent, Visitor visit) const -> void {
+			auto offset{parent.data};
+			auto end{parent.data + parent.size};
+			while(offset < end) {
+				auto box{readBox(offset, end)};
+				if(!box || !visit(*box)) {
+					return;
+				}
+				offset = box->data + box->size;
+			}
+		}
+
+		[[nodiscard]]
+		auto findBox(const Element& parent, quint64 type) const
+			-> std::optional<Element> {
+			std::optional<Element> result;
+			forEachBox(parent, [&](const Element& box) {
+				if(box.id == type) {
+					result = box;
+					return false;
+				}
+				return true;
+			});
+			return result;
+		}
+
+		/* Follows a path of nested boxes, e.g. {"mdia", "minf", "stbl"} */
+		[[nodiscard]]
+		auto findBox(const Element& parent,
+			std::initializer_list<quint64> path) const
+			-> std::optional<Element> {
+			std::optional<Element> box{parent};
+			for(auto type: path) {
+				box = findBox(*box, type);
+				if(!box) {
+					break;
+				}
+			}
+			return box;
+		}
+
+		/* Returns {timescale, duration} of a mvhd or mdhd box */
+		[[nodiscard]]
+		auto readTimescale(const Element& box) const
+			-> std::pair<quint32, quint64> {
+			if(byte(box.data) == 1) {
+				return {bigEndian<quint32>(box.data + 20),
+					bigEndian<quint64>(box.data + 24)};
+			}
+			return {bigEndian<quint32>(box.data + 12),
+				bigEndian<quint32>(box.data + 16)};
+		}
+
+		const uchar* m_data;
+		qint64 m_size;
+	};
+} // namespace Phonon::Native
@@ -0,0 +1,151 @@
+module;
+
+#include <QAudioBuffer>
+#include <QAudioFormat>
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define INT16_SCALE 32767.0F
+#define SIMD_FRAMES 8
+
+export module phonon_native:deinterleave;
+
+namespace Phonon::Native {
+	auto toInt16(quint8 sample) -> qint16 {
+		return static_cast<qint16>((sample - 128) * 256);
+	}
+
+	auto toInt16(qint16 sample) -> qint16 {
+		return sample;
+	}
+
+	auto toInt16(qint32 sample) -> qint16 {
+		return static_cast<qint16>(sample >> 16);
+	}
+
+	auto toInt16(float sample) -> qint16 {
+		return static_cast<qint16>(
+			std::lrint(std::clamp(sample, -1.0F, 1.0F) * INT16_SCALE));
+	}
+
+	template<typename T>
+	auto deinterleaveScalar(const T* data, int channels, qsizetype first,
+		qsizetype frames, std::span<qint16* const> outputs) -> void {
+		for(auto channel{0}; channel < channels; channel++) {
+			auto* output{outputs[channel]};
+			if(!output) {
+				continue;
+			}
+			for(auto frame{first}; frame < frames; frame++) {
+				output[frame] = toInt16(data[frame * channels + channel]);
+			}
+		}
+	}
+
+#if defined(__SSE2__)
+	/* Returns the number of frames done, the rest is left to the scalar
+	 * loop. */
+	auto deinterleaveStereo(const qint16* data, qsizetype frames,
+		qint16* left, qint16* right) -> qsizetype {
+		qsizetype frame{0};
+		for(; frame + SIMD_FRAMES <= frames; frame += SIMD_FRAMES) {
+			/* Each 32 bit lane holds one frame, left in the low half */
+			auto low{_mm_loadu_si128(
+				reinterpret_cast<const __m128i*>(data + frame * 2))};
+			auto high{_mm_loadu_si128(
+				reinterpret_cast<const __m128i*>(data + frame * 2 + 8))};
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(left + frame),
+				_mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(low, 16), 16),
+					_mm_srai_epi32(_mm_slli_epi32(high, 16), 16)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(right + frame),
+				_mm_packs_epi32(
+					_mm_srai_epi32(low, 16), _mm_srai_epi32(high, 16)));
+		}
+		return frame;
+	}
+
+	auto deinterleaveStereo(const float* data, qsizetype frames,
+		qint16* left, qint16* right) -> qsizetype {
+		auto minimum{_mm_set1_ps(-1.0F)};
+		auto maximum{_mm_set1_ps(1.0F)};
+		auto scale{_mm_set1_ps(INT16_SCALE)};
+		auto convert{[&](__m128 samples) {
+			return _mm_cvtps_epi32(_mm_mul_ps(
+				_mm_min_ps(_mm_max_ps(samples, minimum), maximum), scale));
+		}};
+		qsizetype frame{0};
+		for(; frame + SIMD_FRAMES <= frames; frame += SIMD_FRAMES) {
+			const auto* samples{data + frame * 2};
+			auto v0{_mm_loadu_ps(samples)};
+			auto v1{_mm_loadu_ps(samples + 4)};
+			auto v2{_mm_loadu_ps(samples + 8)};
+			auto v3{_mm_loadu_ps(samples + 12)};
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(left + frame),
+				_mm_packs_epi32(
+					convert(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0))),
+					convert(_mm_shuffle_ps(v2, v3, _MM_SHUFFLE(2, 0, 2, 0)))));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(right + frame),
+				_mm_packs_epi32(
+					convert(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1))),
+					convert(_mm_shuffle_ps(v2, v3, _MM_SHUFFLE(3, 1, 3, 1)))));
+		}
+		return frame;
+	}
+#endif
+
+	template<typename T>
+	auto deinterleaveSamples(const T* data, int channels, qsizetype frames,
+		std::span<qint16* const> outputs) -> void {
+		qsizetype first{0};
+#if defined(__SSE2__)
+		if constexpr(std::is_same_v<T, qint16> || std::is_same_v<T, float>) {
+			if(channels == 2 && outputs[0] && outputs[1]) {
+				first = deinterleaveStereo(
+					data, frames, outputs[0], outputs[1]);
+			}
+		}
+#endif
+		deinterleaveScalar(data, channels, first, frames, outputs);
+	}
+} // namespace Phonon::Native
+
+export namespace Phonon::Native {
+	/* Splits the first frames of an interleaved buffer into one Int16
+	 * array per channel. outputs holds a destination for every channel of
+	 * the buffer, null for channels that are not needed. Stereo Int16 and
+	 * Float buffers take an SSE2 path where available. */
+	auto deinterleave(const QAudioBuffer& buffer, qsizetype frames,
+		std::span<qint16* const> outputs) -> void {
+		auto channels{buffer.format().channelCount()};
+		frames = qMin(frames, buffer.frameCount());
+		if(channels <= 0 || outputs.size() < static_cast<size_t>(channels)) {
+			return;
+		}
+		switch(buffer.format().sampleFormat()) {
+			case QAudioFormat::UInt8:
+				deinterleaveSamples(
+					buffer.constData<quint8>(), channels, frames, outputs);
+				break;
+			case QAudioFormat::Int16:
+				deinterleaveSamples(
+					buffer.constData<qint16>(), channels, frames, outputs);
+				break;
+			case QAudioFormat::Int32:
+				deinterleaveSamples(
+					buffer.constData<qint32>(), channels, frames, outputs);
+				break;
+			case QAudioFormat::Float:
+				deinterleaveSamples(
+					buffer.constData<float>(), channels, frames, outputs);
+				break;
+			case QAudioFormat::Unknown:
+			case QAudioFormat::NSampleFormats:
+				break;
+		}
+	}
+} // namespace Phonon::Native
@@ -0,0 +1,375 @@
+module;
+
+#include <QList>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numbers>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#define LANES 4
+#define SILENCE 1e-9F
+
+export module phonon_native:dsp;
+
+export namespace Phonon::Native {
+	/* Four channels of one frame. Audio is processed in groups of four
+	 * channels, frame after frame, so every kernel runs one SSE operation
+	 * per group where the scalar code would run one per channel. */
+	struct Float4 {
+#if defined(__SSE__)
+		__m128 value;
+
+		static auto load(const float* data) -> Float4 {
+			return {_mm_loadu_ps(data)};
+		}
+
+		static auto broadcast(float value) -> Float4 {
+			return {_mm_set1_ps(value)};
+		}
+
+		auto store(float* data) const -> void {
+			_mm_storeu_ps(data, value);
+		}
+
+		friend auto operator+(Float4 a, Float4 b) -> Float4 {
+			return {_mm_add_ps(a.value, b.value)};
+		}
+
+		friend auto operator-(Float4 a, Float4 b) -> Float4 {
+			return {_mm_sub_ps(a.value, b.value)};
+		}
+
+		friend auto operator*(Float4 a, Float4 b) -> Float4 {
+			return {_mm_mul_ps(a.value, b.value)};
+		}
+
+		[[nodiscard]]
+		auto abs() const -> Float4 {
+			return {_mm_andnot_ps(_mm_set1_ps(-0.0F), value)};
+		}
+
+		[[nodiscard]]
+		auto max(Float4 other) const -> Float4 {
+			return {_mm_max_ps(value, other.value)};
+		}
+
+		/* Largest of the four lanes */
+		[[nodiscard]]
+		auto horizontalMax() const -> float {
+			auto pairs{_mm_max_ps(
+				value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 0, 3, 2)))};
+			return _mm_cvtss_f32(_mm_max_ss(
+				pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(0, 0, 0, 1))));
+		}
+#else
+		std::array<float, LANES> value;
+
+		static auto load(const float* data) -> Float4 {
+			return {{data[0], data[1], data[2], data[3]}};
+		}
+
+		static auto broadcast(float value) -> Float4 {
+			return {{value, value, value, value}};
+		}
+
+		auto store(float* data) const -> void {
+			std::copy(value.begin(), value.end(), data);
+		}
+
+		template<typename Operation>
+		static auto apply(Float4 a, Float4 b, Operation operation) -> Float4 {
+			Float4 result{};
+			for(auto i{0}; i < LANES; i++) {
+				result.value[i] = operation(a.value[i], b.value[i]);
+			}
+			return result;
+		}
+
+		friend auto operator+(Float4 a, Float4 b) -> Float4 {
+			return apply(a, b, [](float x, float y) { return x + y; });
+		}
+
+		friend auto operator-(Float4 a, Float4 b) -> Float4 {
+			return apply(a, b, [](float x, float y) { return x - y; });
+		}
+
+		friend auto operator*(Float4 a, Float4 b) -> Float4 {
+			return apply(a, b, [](float x, float y) { return x * y; });
+		}
+
+		[[nodiscard]]
+		auto abs() const -> Float4 {
+			return apply(*this, *this, [](float x, float) {
+				return std::abs(x);
+			});
+		}
+
+		[[nodiscard]]
+		auto max(Float4 other) const -> Float4 {
+			return apply(*this, other, [](float x, float y) {
+				return std::max(x, y);
+			});
+		}
+
+		[[nodiscard]]
+		auto horizontalMax() const -> float {
+			return *std::max_element(value.begin(), value.end());
+		}
+#endif
+	};
+
+	/* b0, b1, b2, a1, a2 normalised by a0 */
+	using BiquadCoefficients = std::array<float, 5>;
+
+	/* Peaking equaliser section after the RBJ audio EQ cookbook */
+	[[nodiscard]]
+	auto peakingSection(double frequency, double gain, double q, int rate)
+		-> BiquadCoefficients {
+		auto amplitude{std::pow(10.0, gain / 40.0)};
+		auto omega{2.0 * std::numbers::pi * frequency
+			/ static_cast<double>(rate)};
+		auto alpha{std::sin(omega) / (2.0 * q)};
+		auto a0{1.0 + alpha / amplitude};
+		return {static_cast<float>((1.0 + alpha * amplitude) / a0),
+			static_cast<float>(-2.0 * std::cos(omega) / a0),
+			static_cast<float>((1.0 - alpha * amplitude) / a0),
+			static_cast<float>(-2.0 * std::cos(omega) / a0),
+			static_cast<float>((1.0 - alpha / amplitude) / a0)};
+	}
+
+	[[nodiscard]]
+	auto highPassSection(double frequency, double q, int rate)
+		-> BiquadCoefficients {
+		auto omega{2.0 * std::numbers::pi * frequency
+			/ static_cast<double>(rate)};
+		auto alpha{std::sin(omega) / (2.0 * q)};
+		auto cosine{std::cos(omega)};
+		auto a0{1.0 + alpha};
+		return {static_cast<float>((1.0 + cosine) / 2.0 / a0),
+			static_cast<float>(-(1.0 + cosine) / a0),
+			static_cast<float>((1.0 + cosine) / 2.0 / a0),
+			static_cast<float>(-2.0 * cosine / a0),
+			static_cast<float>((1.0 - alpha) / a0)};
+	}
+
+	/* Biquad sections in series, transposed direct form II. Frames hold
+	 * groups * 4 interleaved floats. */
+	class BiquadCascade final {
+	  public:
+		BiquadCascade() = default;
+		~BiquadCascade() = default;
+		BiquadCascade(const BiquadCascade&) = delete;
+		BiquadCascade(BiquadCascade&&) = delete;
+		auto operator=(const BiquadCascade&) -> BiquadCascade& = delete;
+		auto operator=(BiquadCascade&&) -> BiquadCascade& = delete;
+
+		/* Keeps the filter state unless the layout changes */
+		auto setSections(
+			const QList<BiquadCoefficients>& sections, int groups) -> void {
+			if(sections.size() != m_sections.size() || groups != m_groups) {
+				m_state.fill(0.0F, sections.size() * groups * 2 * LANES);
+			}
+			m_sections = sections;
+			m_groups = groups;
+		}
+
+		auto process(float* frames, qsizetype count) -> void {
+			auto stride{m_groups * LANES};
+			for(qsizetype section{0}; section < m_sections.size(); section++) {
+				const auto& c{m_sections[section]};
+				auto b0{Float4::broadcast(c[0])};
+				auto b1{Float4::broadcast(c[1])};
+				auto b2{Float4::broadcast(c[2])};
+				auto a1{Float4::broadcast(c[3])};
+				auto a2{Float4::broadcast(c[4])};
+				for(auto group{0}; group < m_groups; group++) {
+					auto* state{m_state.data()
+						+ (section * m_groups + group) * 2 * LANES};
+					auto z1{Float4::load(state)};
+					auto z2{Float4::load(state + LANES)};
+					auto* samples{frames + group * LANES};
+					for(qsizetype frame{0}; frame < count; frame++) {
+						auto x{Float4::load(samples)};
+						auto y{b0 * x + z1};
+						z1 = b1 * x - a1 * y + z2;
+						z2 = b2 * x - a2 * y;
+						y.store(samples);
+						samples += stride;
+					}
+					z1.store(state);
+					z2.store(state + LANES);
+				}
+			}
+		}
+
+	  private:
+		QList<BiquadCoefficients> m_sections;
+		QList<float> m_state;
+		int m_groups{};
+	};
+
+	/* Feed-forward compressor or brickwall limiter on the loudest channel
+	 * with a lookahead delay. The limiter takes the minimum of the gains
+	 * needed over the lookahead window and smooths it with a moving average
+	 * of the same length, so no delayed sample exceeds the ceiling. */
+	class Dynamics final {
+	  public:
+		struct Settings {
+			/* dB, the ceiling of the limiter */
+			float threshold{};
+			float ratio{1.0F};
+			/* ms, the limiter attacks over the lookahead */
+			float attack{};
+			float release{};
+			float lookahead{};
+			/* dB, applied after the compressor and before the limiter */
+			float gain{};
+			bool limiter{};
+		};
+
+		Dynamics() = default;
+		~Dynamics() = default;
+		Dynamics(const Dynamics&) = delete;
+		Dynamics(Dynamics&&) = delete;
+		auto operator=(const Dynamics&) -> Dynamics& = delete;
+		auto operator=(Dynamics&&) -> Dynamics& = delete;
+
+		auto configure(const Settings& settings, int rate, int groups)
+			-> void {
+			m_settings = settings;
+			auto coefficient{[&](float ms) {
+				return ms > 0.0F
+					? static_cast<float>(std::exp(
+						  -1000.0 / (static_cast<double>(ms) * rate)))
+					: 0.0F;
+			}};
+			m_attack = coefficient(settings.attack);
+			m_release = coefficient(settings.release);
+			auto linear{[](float decibels) {
+				return static_cast<float>(
+					std::pow(10.0, static_cast<double>(decibels) / 20.0));
+			}};
+			m_gainLinear = linear(settings.gain);
+			m_ceiling = linear(settings.threshold);
+			auto window{qMax<qsizetype>(1,
+				std::lround(
+					settings.lookahead * static_cast<float>(rate) / 1000.0F)
+					+ 1)};
+			if(window != m_window || groups != m_groups) {
+				m_window = window;
+				m_groups = groups;
+				m_delay.fill(0.0F, window * groups * LANES);
+				m_minimumFrames.fill(0, window);
+				m_minimumGains.fill(1.0F, window);
+				m_average.fill(1.0F, window);
+				m_averageSum = static_cast<double>(window);
+				m_minimumHead = 0;
+				m_minimumSize = 0;
+				m_position = 0;
+				m_frame = 0;
+				m_envelope = 0.0F;
+				m_gain = 1.0F;
+			}
+		}
+
+		/* Frames of delay added to the signal */
+		[[nodiscard]]
+		auto latency() const -> qsizetype {
+			return m_window - 1;
+		}
+
+		auto process(float* frames, qsizetype count) -> void {
+			auto stride{m_groups * LANES};
+			for(qsizetype frame{0}; frame < count; frame++) {
+				auto* samples{frames + frame * stride};
+				auto* slot{m_delay.data() + m_position * stride};
+				auto* delayed{
+					m_delay.data() + ((m_position + 1) % m_window) * stride};
+				auto peak{Float4::broadcast(0.0F)};
+				for(auto group{0}; group < m_groups; group++) {
+					auto x{Float4::load(samples + group * LANES)};
+					peak = peak.max(x.abs());
+					x.store(slot + group * LANES);
+				}
+				auto gain{m_settings.limiter
+						? limit(peak.horizontalMax() * m_gainLinear)
+							* m_gainLinear
+						: compress(peak.horizontalMax()) * m_gainLinear};
+				auto factor{Float4::broadcast(gain)};
+				for(auto group{0}; group < m_groups; group++) {
+					(Float4::load(delayed + group * LANES) * factor)
+						.store(samples + group * LANES);
+				}
+				m_position = (m_position + 1) % m_window;
+				m_frame++;
+			}
+		}
+
+	  private:
+		auto compress(float peak) -> float {
+			auto level{20.0F * std::log10(qMax(peak, SILENCE))};
+			auto over{level - m_settings.threshold};
+			auto target{over > 0.0F
+					? -over * (1.0F - 1.0F / qMax(1.0F, m_settings.ratio))
+					: 0.0F};
+			auto coefficient{target < m_envelope ? m_attack : m_release};
+			m_envelope = target + coefficient * (m_envelope - target);
+			return std::pow(10.0F, m_envelope / 20.0F);
+		}
+
+		auto limit(float peak) -> float {
+			auto needed{peak > m_ceiling ? m_ceiling / peak : 1.0F};
+
+			/* Minimum over the window through a monotonic queue */
+			if(m_minimumSize > 0
+				&& m_minimumFrames[m_minimumHead] <= m_frame - m_window) {
+				m_minimumHead = (m_minimumHead + 1) % m_window;
+				m_minimumSize--;
+			}
+			while(m_minimumSize > 0 && m_minimumGains[back()] >= needed) {
+				m_minimumSize--;
+			}
+			m_minimumSize++;
+			m_minimumFrames[back()] = m_frame;
+			m_minimumGains[back()] = needed;
+			auto minimum{m_minimumGains[m_minimumHead]};
+
+			auto& oldest{m_average[m_position]};
+			m_averageSum += static_cast<double>(minimum - oldest);
+			oldest = minimum;
+			auto average{static_cast<float>(
+				m_averageSum / static_cast<double>(m_window))};
+			m_gain = average < m_gain
+				? average
+				: average + m_release * (m_gain - average);
+			return m_gain;
+		}
+
+		[[nodiscard]]
+		auto back() const -> qsizetype {
+			return (m_minimumHead + m_minimumSize - 1 + m_window) % m_window;
+		}
+
+		Settings m_settings;
+		float m_attack{};
+		float m_release{};
+		float m_gainLinear{1.0F};
+		float m_ceiling{1.0F};
+		float m_envelope{};
+		float m_gain{1.0F};
+		QList<float> m_delay;
+		QList<qint64> m_minimumFrames;
+		QList<float> m_minimumGains;
+		QList<float> m_average;
+		double m_averageSum{};
+		qsizetype m_window{};
+		qsizetype m_minimumHead{};
+		qsizetype m_minimumSize{};
+		qsizetype m_position{};
+		qint64 m_frame{};
+		int m_groups{};
+	};
+} // namespace Phonon::Native
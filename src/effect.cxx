@@ -0,0 +1,305 @@
+module;
+
+#include <QMediaPlayer>
+#include <QPointer>
+#include <QVariant>
+#include <QtCore/qtmochelpers.h>
+#include <array>
+#include <atomic>
+#include <phonon/EffectInterface>
+#include <phonon/EffectParameter>
+#include <span>
+
+#define MAX_PARAMETERS 10
+#define EQUALIZER_Q 1.41
+#define BUTTERWORTH_Q1 0.5412
+#define BUTTERWORTH_Q2 1.3065
+#define MAX_CUTOFF 0.45
+
+export module phonon_native:effect;
+
+import :dsp;
+import :effectchain;
+import :sinknode;
+
+export namespace Phonon::Native {
+	/* Effect inserted between a media object and its audio output. The
+	 * parameters are set from any thread and picked up by the audio thread
+	 * of the chain at the next block. */
+	class AudioEffect final:
+		public QObject,
+		public EffectInterface,
+		public SinkNode,
+		public AudioProcessor {
+		Q_OBJECT
+		Q_INTERFACES(Phonon::EffectInterface)
+
+	  public:
+		enum Type {
+			Equalizer,
+			HighPass,
+			Compressor,
+			Limiter,
+			TypeCount
+		};
+
+		struct Description {
+			const char* name;
+			const char* description;
+		};
+
+		static constexpr std::array<Description, TypeCount> descriptions{{
+			{"Equalizer", "Ten band graphic equalizer"},
+			{"High-pass filter", "Fourth order Butterworth high-pass filter"},
+			{"Compressor", "Feed-forward compressor with lookahead"},
+			{"Limiter", "Brickwall limiter with lookahead"}}};
+
+		AudioEffect(QObject* parent, Type type):
+			QObject{parent}, m_type{type} {
+			auto table{parameterTable()};
+			for(std::size_t i{0}; i < table.size(); i++) {
+				m_values[i].store(table[i].value, std::memory_order_relaxed);
+			}
+		}
+
+		~AudioEffect() final {
+			if(m_chain) {
+				m_chain->remove(this);
+			}
+		}
+
+		AudioEffect(const AudioEffect&) = delete;
+		AudioEffect(AudioEffect&&) = delete;
+		auto operator=(const AudioEffect&) -> AudioEffect& = delete;
+		auto operator=(AudioEffect&&) -> AudioEffect& = delete;
+
+		[[nodiscard]]
+		auto parameters() const -> QList<EffectParameter> final {
+			QList<EffectParameter> list;
+			auto table{parameterTable()};
+			for(std::size_t i{0}; i < table.size(); i++) {
+				const auto& parameter{table[i]};
+				list << EffectParameter{static_cast<int>(i),
+					QString::fromLatin1(parameter.name),
+					parameter.logarithmic ? EffectParameter::LogarithmicHint
+										  : EffectParameter::Hints{},
+					static_cast<double>(parameter.value),
+					static_cast<double>(parameter.minimum),
+					static_cast<double>(parameter.maximum)};
+			}
+			return list;
+		}
+
+		[[nodiscard]]
+		auto parameterValue(const EffectParameter& parameter) const
+			-> QVariant final {
+			auto id{parameter.id()};
+			if(id < 0
+				|| static_cast<std::size_t>(id) >= parameterTable().size()) {
+				return {};
+			}
+			return static_cast<double>(
+				m_values[id].load(std::memory_order_relaxed));
+		}
+
+		auto setParameterValue(const EffectParameter& parameter,
+			const QVariant& value) -> void final {
+			auto id{parameter.id()};
+			auto table{parameterTable()};
+			if(id < 0 || static_cast<std::size_t>(id) >= table.size()) {
+				return;
+			}
+			m_values[id].store(qBound(table[id].minimum,
+								   value.toFloat(),
+								   table[id].maximum),
+				std::memory_order_relaxed);
+			m_version.fetch_add(1, std::memory_order_release);
+		}
+
+		auto connectToMediaPlayer(QMediaPlayer* player) -> void final {
+			/* Before the sinks so that the chain takes over their output */
+			m_chain = EffectChain::of(player);
+			m_chain->insert(this);
+			SinkNode::connectToMediaPlayer(player);
+		}
+
+		auto disconnectFromMediaPlayer(QMediaPlayer* player) -> void final {
+			if(m_chain) {
+				m_chain->remove(this);
+				m_chain = nullptr;
+			}
+			SinkNode::disconnectFromMediaPlayer(player);
+		}
+
+		/* Audio thread */
+		auto process(float* frames, qsizetype count, int groups, int rate)
+			-> void final {
+			auto version{m_version.load(std::memory_order_acquire)};
+			if(version != m_appliedVersion || rate != m_rate
+				|| groups != m_groups) {
+				m_appliedVersion = version;
+				m_rate = rate;
+				m_groups = groups;
+				configure();
+			}
+			switch(m_type) {
+				case Equalizer:
+				case HighPass:
+					m_filters.process(frames, count);
+					break;
+				case Compressor:
+				case Limiter:
+					m_dynamics.process(frames, count);
+					break;
+				case TypeCount:
+					break;
+			}
+		}
+
+		[[nodiscard]]
+		auto latency() const -> qsizetype final {
+			return m_type == Compressor || m_type == Limiter
+				? m_dynamics.latency()
+				: 0;
+		}
+
+	  private:
+		struct Parameter {
+			const char* name;
+			float minimum;
+			float maximum;
+			float value;
+			bool logarithmic;
+		};
+
+		static constexpr std::array<float, MAX_PARAMETERS> bandFrequencies{
+			31.25F,
+			62.5F,
+			125.0F,
+			250.0F,
+			500.0F,
+			1000.0F,
+			2000.0F,
+			4000.0F,
+			8000.0F,
+			16000.0F};
+
+		static constexpr std::array<Parameter, MAX_PARAMETERS> equalizer{{
+			{"31 Hz (dB)", -12.0F, 12.0F, 0.0F, false},
+			{"62 Hz (dB)", -12.0F, 12.0F, 0.0F, false},
+			{"125 Hz (dB)", -12.0F, 12.0F, 0.0F, false},
+			{"250 Hz (dB)", -12.0F, 12.0F, 0.0F, false},
+			{"500 Hz (dB)", -12.0F, 12.0F, 0.0F, false},
+			{"1 kHz (dB)", -12.0F, 12.0F, 0.0F, false},
+			{"2 kHz (dB)", -12.0F, 12.0F, 0.0F, false},
+			{"4 kHz (dB)", -12.0F, 12.0F, 0.0F, false},
+			{"8 kHz (dB)", -12.0F, 12.0F, 0.0F, false},
+			{"16 kHz (dB)", -12.0F, 12.0F, 0.0F, false}}};
+
+		static constexpr std::array<Parameter, 1> highPass{{
+			{"Cutoff (Hz)", 20.0F, 1000.0F, 80.0F, true}}};
+
+		static constexpr std::array<Parameter, 6> compressor{{
+			{"Threshold (dB)", -60.0F, 0.0F, -18.0F, false},
+			{"Ratio", 1.0F, 20.0F, 4.0F, false},
+			{"Attack (ms)", 0.1F, 100.0F, 5.0F, true},
+			{"Release (ms)", 10.0F, 2000.0F, 100.0F, true},
+			{"Lookahead (ms)", 0.0F, 20.0F, 0.0F, false},
+			{"Makeup gain (dB)", 0.0F, 24.0F, 0.0F, false}}};
+
+		static constexpr std::array<Parameter, 4> limiter{{
+			{"Ceiling (dB)", -12.0F, 0.0F, -1.0F, false},
+			{"Input gain (dB)", 0.0F, 24.0F, 0.0F, false},
+			{"Release (ms)", 10.0F, 2000.0F, 100.0F, true},
+			{"Lookahead (ms)", 1.0F, 20.0F, 5.0F, false}}};
+
+		[[nodiscard]]
+		auto parameterTable() const -> std::span<const Parameter> {
+			switch(m_type) {
+				case Equalizer:
+					return equalizer;
+				case HighPass:
+					return highPass;
+				case Compressor:
+					return compressor;
+				case Limiter:
+					return limiter;
+				case TypeCount:
+					break;
+			}
+			return {};
+		}
+
+		/* Audio thread, rebuilds the kernel from the parameters */
+		auto configure() -> void {
+			auto value{[this](int id) {
+				return m_values[id].load(std::memory_order_relaxed);
+			}};
+			auto highest{static_cast<double>(m_rate) * MAX_CUTOFF};
+			switch(m_type) {
+				case Equalizer:
+					{
+						QList<BiquadCoefficients> sections;
+						for(auto band{0}; band < MAX_PARAMETERS; band++) {
+							auto frequency{
+								static_cast<double>(bandFrequencies[band])};
+							if(frequency < highest) {
+								sections << peakingSection(frequency,
+									static_cast<double>(value(band)),
+									EQUALIZER_Q,
+									m_rate);
+							}
+						}
+						m_filters.setSections(sections, m_groups);
+					}
+					break;
+				case HighPass:
+					{
+						auto cutoff{
+							qMin(static_cast<double>(value(0)), highest)};
+						m_filters.setSections(
+							{highPassSection(cutoff, BUTTERWORTH_Q1, m_rate),
+								highPassSection(
+									cutoff, BUTTERWORTH_Q2, m_rate)},
+							m_groups);
+					}
+					break;
+				case Compressor:
+					m_dynamics.configure({.threshold = value(0),
+											 .ratio = value(1),
+											 .attack = value(2),
+											 .release = value(3),
+											 .lookahead = value(4),
+											 .gain = value(5),
+											 .limiter = false},
+						m_rate,
+						m_groups);
+					break;
+				case Limiter:
+					m_dynamics.configure({.threshold = value(0),
+											 .release = value(2),
+											 .lookahead = value(3),
+											 .gain = value(1),
+											 .limiter = true},
+						m_rate,
+						m_groups);
+					break;
+				case TypeCount:
+					break;
+			}
+		}
+
+		Type m_type;
+		QPointer<EffectChain> m_chain;
+		std::array<std::atomic<float>, MAX_PARAMETERS> m_values{};
+		std::atomic<quint32> m_version{};
+		/* Owned by the audio thread */
+		quint32 m_appliedVersion{};
+		int m_rate{};
+		int m_groups{};
+		BiquadCascade m_filters;
+		Dynamics m_dynamics;
+	};
+} // namespace Phonon::Native
+
+#include "effect.moc"
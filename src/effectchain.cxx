@@ -0,0 +1,479 @@
+module;
+
+#include <QAudioBuffer>
+#include <QAudioBufferOutput>
+#include <QAudioDevice>
+#include <QAudioOutput>
+#include <QAudioSink>
+#include <QElapsedTimer>
+#include <QMediaDevices>
+#include <QMediaPlayer>
+#include <QPointer>
+#include <QThread>
+#include <QTimer>
+#include <QtCore/qtmochelpers.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#define TAP_CAPACITY 64
+#define SINK_BUFFER 40
+#define MAX_PENDING 250
+#define RETRY_INTERVAL 5
+#define LANES 4
+#define INT16_RANGE 32768.0F
+#define INT16_SCALE 32767.0F
+#define USEC 1'000'000
+
+export module phonon_native:effectchain;
+
+import :audiotap;
+import :playbackstatistics;
+import :ringbuffer;
+
+using Qt::Literals::StringLiterals::operator""_L1;
+
+export namespace Phonon::Native {
+	/* Stage of an effect chain, called on the audio thread of the chain */
+	class AudioProcessor {
+	  public:
+		AudioProcessor() = default;
+		AudioProcessor(const AudioProcessor&) = delete;
+		AudioProcessor(AudioProcessor&&) = delete;
+		auto operator=(const AudioProcessor&) -> AudioProcessor& = delete;
+		auto operator=(AudioProcessor&&) -> AudioProcessor& = delete;
+		virtual ~AudioProcessor() = default;
+
+		/* Each frame holds groups * 4 floats, lanes past the channels of
+		 * the source are zero */
+		virtual auto process(float* frames, qsizetype count, int groups,
+			int rate) -> void = 0;
+
+		/* Frames of delay added by the stage */
+		[[nodiscard]]
+		virtual auto latency() const -> qsizetype {
+			return 0;
+		}
+	};
+
+	/* Routes the audio of a player through its effects while any are
+	 * connected. The rendered audio is taken from the tap of the player and
+	 * processed on a dedicated audio thread, which plays it through a
+	 * QAudioSink. The QAudioOutput of the player is detached meanwhile and
+	 * only supplies the device, volume and mute state. */
+	class EffectChain final: public QObject {
+		Q_OBJECT
+
+	  public:
+		~EffectChain() final {
+			instances.removeOne(this);
+			m_worker->deleteLater();
+			m_thread.quit();
+			m_thread.wait();
+		}
+
+		EffectChain(const EffectChain&) = delete;
+		EffectChain(EffectChain&&) = delete;
+		auto operator=(const EffectChain&) -> EffectChain& = delete;
+		auto operator=(EffectChain&&) -> EffectChain& = delete;
+
+		[[nodiscard]]
+		static auto of(QMediaPlayer* player) -> EffectChain* {
+			if(auto* chain{player->findChild<EffectChain*>(
+				   Qt::FindDirectChildrenOnly)}) {
+				return chain;
+			}
+			return new EffectChain{player};
+		}
+
+		/* Deletes all chains, which restores the outputs of their players.
+		 * Their audio threads have stopped once this returns. */
+		static auto stopAll() -> void {
+			for(auto* chain: QList{instances}) {
+				if(chain->m_count > 0) {
+					chain->deactivate();
+				}
+				delete chain;
+			}
+		}
+
+		/* Appends the stage, the chain is active from the first one on */
+		auto insert(AudioProcessor* processor) -> void {
+			QMetaObject::invokeMethod(
+				m_worker,
+				[=, this]() { m_processors << processor; },
+				Qt::QueuedConnection);
+			if(m_count++ == 0) {
+				activate();
+			}
+		}
+
+		/* The stage is no longer called once this returns */
+		auto remove(AudioProcessor* processor) -> void {
+			QMetaObject::invokeMethod(
+				m_worker,
+				[=, this]() { m_processors.removeOne(processor); },
+				Qt::BlockingQueuedConnection);
+			if(--m_count == 0) {
+				deactivate();
+			}
+		}
+
+	  private:
+		/* Only used from the GUI thread */
+		static inline QList<EffectChain*> instances{};
+
+		explicit EffectChain(QMediaPlayer* player):
+			QObject{player}, m_player{player}, m_worker{new QObject{}},
+			m_retry{new QTimer{m_worker}}, m_buffers{TAP_CAPACITY},
+			m_statistics{PlaybackStatistics::instance()} {
+			instances << this;
+			m_retry->setSingleShot(true);
+			m_retry->setInterval(RETRY_INTERVAL);
+			connect(
+				m_retry,
+				&QTimer::timeout,
+				m_worker,
+				[=, this]() { write(); },
+				Qt::AutoConnection);
+			m_worker->moveToThread(&m_thread);
+			m_thread.setObjectName("EffectChain"_L1);
+			m_thread.start(QThread::TimeCriticalPriority);
+		}
+
+		auto activate() -> void {
+			m_tap = AudioTap::of(m_player);
+			connect(
+				m_tap,
+				&QAudioBufferOutput::audioBufferReceived,
+				this,
+				[=, this](const QAudioBuffer& buffer) { enqueue(buffer); },
+				Qt::DirectConnection);
+			connect(
+				m_player,
+				&QMediaPlayer::audioOutputChanged,
+				this,
+				[=, this]() { divert(); },
+				Qt::AutoConnection);
+			connect(
+				m_player,
+				&QMediaPlayer::playbackStateChanged,
+				this,
+				[=, this](QMediaPlayer::PlaybackState state) {
+					if(state == QMediaPlayer::StoppedState) {
+						post([this]() { closeSink(); });
+					}
+				},
+				Qt::AutoConnection);
+			divert();
+			updateDevice();
+			updateVolume();
+		}
+
+		auto deactivate() -> void {
+			if(m_tap) {
+				disconnect(m_tap, nullptr, this, nullptr);
+			}
+			disconnect(m_player, nullptr, this, nullptr);
+			if(m_output) {
+				disconnect(m_output, nullptr, this, nullptr);
+				/* Unless another output took its place meanwhile */
+				if(!m_player->audioOutput()) {
+					m_player->setAudioOutput(m_output);
+				}
+				m_output = nullptr;
+			}
+			post([this]() {
+				m_buffers.clear();
+				closeSink();
+			});
+		}
+
+		/* Takes over the settings of the output attached to the player */
+		auto divert() -> void {
+			auto* output{m_player->audioOutput()};
+			if(!output) {
+				return;
+			}
+			if(output != m_output) {
+				if(m_output) {
+					disconnect(m_output, nullptr, this, nullptr);
+				}
+				m_output = output;
+				connect(
+					output,
+					&QAudioOutput::volumeChanged,
+					this,
+					[=, this]() { updateVolume(); },
+					Qt::AutoConnection);
+				connect(
+					output,
+					&QAudioOutput::mutedChanged,
+					this,
+					[=, this]() { updateVolume(); },
+					Qt::AutoConnection);
+				connect(
+					output,
+					&QAudioOutput::deviceChanged,
+					this,
+					[=, this]() { updateDevice(); },
+					Qt::AutoConnection);
+			}
+			m_player->setAudioOutput(nullptr);
+			updateDevice();
+			updateVolume();
+		}
+
+		auto updateVolume() -> void {
+			auto volume{!m_output ? 1.0F
+					: m_output->isMuted() ? 0.0F
+										  : m_output->volume()};
+			post([=, this]() {
+				m_volume = volume;
+				if(m_sink) {
+					m_sink->setVolume(volume);
+				}
+			});
+		}
+
+		auto updateDevice() -> void {
+			auto device{m_output ? m_output->device() : QAudioDevice{}};
+			if(device.isNull()) {
+				device = QMediaDevices::defaultAudioOutput();
+			}
+			post([=, this]() {
+				if(device != m_device) {
+					m_device = device;
+					m_sinkFailed = false;
+					closeSink();
+				}
+			});
+		}
+
+		template<typename Function>
+		auto post(Function function) -> void {
+			QMetaObject::invokeMethod(
+				m_worker, std::move(function), Qt::QueuedConnection);
+		}
+
+		/* Renderer thread, must not block */
+		auto enqueue(const QAudioBuffer& buffer) -> void {
+			if(!m_buffers.push(buffer)) {
+				return;
+			}
+			if(!m_drainPosted.exchange(true, std::memory_order_acq_rel)) {
+				post([this]() { drain(); });
+			}
+		}
+
+		/* Audio thread from here on */
+
+		auto drain() -> void {
+			m_drainPosted.store(false, std::memory_order_release);
+			while(auto buffer{m_buffers.pop()}) {
+				render(*buffer);
+			}
+			write();
+		}
+
+		auto render(const QAudioBuffer& buffer) -> void {
+			const auto& format{buffer.format()};
+			auto channels{format.channelCount()};
+			auto rate{format.sampleRate()};
+			auto frames{buffer.frameCount()};
+			if(channels <= 0 || rate <= 0 || frames <= 0) {
+				return;
+			}
+			if(format != m_format || (!m_sink && !m_sinkFailed)) {
+				m_format = format;
+				openSink();
+			}
+			if(!m_sink) {
+				return;
+			}
+			auto groups{(channels + LANES - 1) / LANES};
+			m_lanes.resize(frames * groups * LANES);
+			toLanes(buffer, groups);
+
+			QElapsedTimer clock;
+			clock.start();
+			qsizetype latency{};
+			for(auto* processor: m_processors) {
+				processor->process(m_lanes.data(), frames, groups, rate);
+				latency += processor->latency();
+			}
+			m_statistics->record(PlaybackStatistics::EffectProcessing,
+				clock.nsecsElapsed() / 1000);
+
+			fromLanes(frames, channels, groups);
+			auto buffered{m_pending.size() + m_sink->bufferSize()
+				- m_sink->bytesFree()};
+			m_statistics->record(PlaybackStatistics::EffectLatency,
+				latency * USEC / rate
+					+ m_sinkFormat.durationForBytes(
+						static_cast<qint32>(buffered)));
+		}
+
+		auto toLanes(const QAudioBuffer& buffer, int groups) -> void {
+			const auto& format{buffer.format()};
+			auto channels{format.channelCount()};
+			auto frames{buffer.frameCount()};
+			auto stride{groups * LANES};
+			auto* lanes{m_lanes.data()};
+			if(channels % LANES != 0) {
+				std::fill(m_lanes.begin(), m_lanes.end(), 0.0F);
+			}
+			switch(format.sampleFormat()) {
+				case QAudioFormat::Float:
+					{
+						const auto* data{buffer.constData<float>()};
+						for(qsizetype frame{0}; frame < frames; frame++) {
+							std::copy_n(data + frame * channels,
+								channels,
+								lanes + frame * stride);
+						}
+					}
+					break;
+				case QAudioFormat::Int16:
+					{
+						const auto* data{buffer.constData<qint16>()};
+						for(qsizetype frame{0}; frame < frames; frame++) {
+							auto* row{lanes + frame * stride};
+							const auto* input{data + frame * channels};
+							for(auto i{0}; i < channels; i++) {
+								row[i] = input[i] / INT16_RANGE;
+							}
+						}
+					}
+					break;
+				case QAudioFormat::UInt8:
+				case QAudioFormat::Int32:
+				case QAudioFormat::Unknown:
+				case QAudioFormat::NSampleFormats:
+					{
+						const auto* data{buffer.constData<char>()};
+						auto size{format.bytesPerSample()};
+						for(qsizetype frame{0}; frame < frames; frame++) {
+							auto* row{lanes + frame * stride};
+							const auto* input{data + frame * channels * size};
+							for(auto i{0}; i < channels; i++) {
+								row[i] = format.normalizedSampleValue(
+									input + i * size);
+							}
+						}
+					}
+					break;
+			}
+		}
+
+		auto fromLanes(qsizetype frames, int channels, int groups) -> void {
+			auto stride{groups * LANES};
+			const auto* lanes{m_lanes.constData()};
+			auto offset{m_pending.size()};
+			m_pending.resize(offset + frames * m_sinkFormat.bytesPerFrame());
+			if(m_sinkFormat.sampleFormat() == QAudioFormat::Float) {
+				auto* output{
+					reinterpret_cast<float*>(m_pending.data() + offset)};
+				for(qsizetype frame{0}; frame < frames; frame++) {
+					std::copy_n(lanes + frame * stride,
+						channels,
+						output + frame * channels);
+				}
+				return;
+			}
+			auto* output{reinterpret_cast<qint16*>(m_pending.data() + offset)};
+			for(qsizetype frame{0}; frame < frames; frame++) {
+				for(auto channel{0}; channel < channels; channel++) {
+					output[frame * channels + channel] = static_cast<qint16>(
+						std::lrint(std::clamp(lanes[frame * stride + channel],
+									   -1.0F,
+									   1.0F)
+							* INT16_SCALE));
+				}
+			}
+		}
+
+		/* Plays Float samples where the device takes them, Int16 otherwise */
+		auto openSink() -> void {
+			closeSink();
+			m_sinkFormat = m_format;
+			m_sinkFormat.setSampleFormat(QAudioFormat::Float);
+			if(!m_device.isFormatSupported(m_sinkFormat)) {
+				m_sinkFormat.setSampleFormat(QAudioFormat::Int16);
+			}
+			m_sink = new QAudioSink{m_device, m_sinkFormat, m_worker};
+			m_sink->setBufferSize(
+				m_sinkFormat.bytesForDuration(SINK_BUFFER * 1000));
+			m_sink->setVolume(m_volume);
+			m_io = m_sink->start();
+			m_sinkFailed = !m_io;
+			if(!m_io) {
+				qDebug() << "Cannot open effect chain output"
+						 << m_device.description() << m_sink->error();
+				closeSink();
+			}
+		}
+
+		auto closeSink() -> void {
+			m_retry->stop();
+			m_pending.clear();
+			m_io = nullptr;
+			if(m_sink) {
+				m_sink->stop();
+				delete m_sink;
+				m_sink = nullptr;
+			}
+		}
+
+		/* Writes what the sink takes and retries shortly for the rest. The
+		 * oldest audio is dropped when the sink falls behind. */
+		auto write() -> void {
+			if(!m_io) {
+				return;
+			}
+			auto frameSize{m_sinkFormat.bytesPerFrame()};
+			auto limit{m_sinkFormat.bytesForDuration(MAX_PENDING * 1000)};
+			if(m_pending.size() > limit) {
+				m_pending.remove(
+					0, (m_pending.size() - limit) / frameSize * frameSize);
+			}
+			auto size{qMin<qsizetype>(m_pending.size(), m_sink->bytesFree())
+				/ frameSize * frameSize};
+			if(size > 0) {
+				auto written{m_io->write(m_pending.constData(), size)};
+				if(written > 0) {
+					m_pending.remove(0, written);
+				}
+			}
+			if(!m_pending.isEmpty() && !m_retry->isActive()) {
+				m_retry->start();
+			}
+		}
+
+		QMediaPlayer* m_player;
+		QPointer<QAudioBufferOutput> m_tap;
+		QPointer<QAudioOutput> m_output;
+		int m_count{};
+		QThread m_thread;
+		QObject* m_worker;
+		QTimer* m_retry;
+		RingBuffer<QAudioBuffer> m_buffers;
+		/* Created on the GUI thread, outlives all chains */
+		PlaybackStatistics* m_statistics;
+		std::atomic<bool> m_drainPosted{};
+		/* Owned by the audio thread */
+		QList<AudioProcessor*> m_processors;
+		QAudioDevice m_device;
+		QAudioFormat m_format;
+		QAudioFormat m_sinkFormat;
+		QAudioSink* m_sink{};
+		QIODevice* m_io{};
+		QList<float> m_lanes;
+		QByteArray m_pending;
+		float m_volume{1.0F};
+		bool m_sinkFailed{};
+	};
+} // namespace Phonon::Native
+
+#include "effectchain.moc"
@@ -0,0 +1,154 @@
+module;
+
+#include <QList>
+#include <bit>
+#include <cmath>
+#include <numbers>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#define SIMD_WIDTH 4
+
+export module phonon_native:fft;
+
+export namespace Phonon::Native {
+	/* Real-input FFT of a power of two size. The input is packed into a
+	 * complex FFT of half the size on split real and imaginary arrays,
+	 * whose butterflies run four at a time with SSE. */
+	class RealFft final {
+	  public:
+		explicit RealFft(qsizetype size):
+			m_size{roundSize(size)}, m_half{m_size / 2}, m_re(m_half),
+			m_im(m_half),
+			m_stageRe(m_half), m_stageIm(m_half), m_postRe(m_half),
+			m_postIm(m_half), m_reversed(m_half) {
+			auto bits{std::countr_zero(static_cast<quint64>(m_half))};
+			for(qsizetype i{0}; i < m_half; i++) {
+				m_reversed[i] = static_cast<qsizetype>(
+					reverse(static_cast<quint64>(i), bits));
+			}
+			/* Twiddles of each stage are stored contiguously at offset
+			 * half - 1 so the butterflies can load them as vectors */
+			for(qsizetype half{1}; half < m_half; half *= 2) {
+				for(qsizetype j{0}; j < half; j++) {
+					auto angle{-std::numbers::pi * static_cast<double>(j)
+						/ static_cast<double>(half)};
+					m_stageRe[half - 1 + j] =
+						static_cast<float>(std::cos(angle));
+					m_stageIm[half - 1 + j] =
+						static_cast<float>(std::sin(angle));
+				}
+			}
+			for(qsizetype k{0}; k < m_half; k++) {
+				auto angle{-2.0 * std::numbers::pi * static_cast<double>(k)
+					/ static_cast<double>(m_size)};
+				m_postRe[k] = static_cast<float>(std::cos(angle));
+				m_postIm[k] = static_cast<float>(std::sin(angle));
+			}
+		}
+
+		~RealFft() = default;
+		RealFft(const RealFft&) = delete;
+		RealFft(RealFft&&) = delete;
+		auto operator=(const RealFft&) -> RealFft& = delete;
+		auto operator=(RealFft&&) -> RealFft& = delete;
+
+		[[nodiscard]]
+		auto size() const -> qsizetype {
+			return m_size;
+		}
+
+		/* Writes the magnitudes of bins 0 to size / 2 - 1 of the size real
+		 * input samples. */
+		auto magnitudes(const float* input, float* output) -> void {
+			for(qsizetype i{0}; i < m_half; i++) {
+				m_re[m_reversed[i]] = input[2 * i];
+				m_im[m_reversed[i]] = input[2 * i + 1];
+			}
+			transform();
+
+			/* Split the packed spectrum into the one of the real input */
+			for(qsizetype k{0}; k < m_half; k++) {
+				auto a{m_re[k]};
+				auto b{m_im[k]};
+				auto c{m_re[(m_half - k) % m_half]};
+				auto d{m_im[(m_half - k) % m_half]};
+				auto evenRe{(a + c) / 2};
+				auto evenIm{(b - d) / 2};
+				auto oddRe{(b + d) / 2};
+				auto oddIm{(c - a) / 2};
+				auto re{evenRe + m_postRe[k] * oddRe - m_postIm[k] * oddIm};
+				auto im{evenIm + m_postRe[k] * oddIm + m_postIm[k] * oddRe};
+				output[k] = std::sqrt(re * re + im * im);
+			}
+		}
+
+	  private:
+		static auto roundSize(qsizetype size) -> qsizetype {
+			return static_cast<qsizetype>(
+				std::bit_ceil(static_cast<quint64>(qMax<qsizetype>(size, 4))));
+		}
+
+		static auto reverse(quint64 value, int bits) -> quint64 {
+			quint64 result{};
+			for(auto i{0}; i < bits; i++) {
+				result = (result << 1) | ((value >> i) & 1U);
+			}
+			return result;
+		}
+
+		/* In-place radix-2 decimation in time on bit-reversed input */
+		auto transform() -> void {
+			auto* re{m_re.data()};
+			auto* im{m_im.data()};
+			for(qsizetype half{1}; half < m_half; half *= 2) {
+				const auto* wRe{m_stageRe.constData() + half - 1};
+				const auto* wIm{m_stageIm.constData() + half - 1};
+				for(qsizetype start{0}; start < m_half; start += 2 * half) {
+					auto* uRe{re + start};
+					auto* uIm{im + start};
+					auto* vRe{re + start + half};
+					auto* vIm{im + start + half};
+					qsizetype j{0};
+#if defined(__SSE__)
+					for(; j + SIMD_WIDTH <= half; j += SIMD_WIDTH) {
+						auto cr{_mm_loadu_ps(wRe + j)};
+						auto ci{_mm_loadu_ps(wIm + j)};
+						auto xr{_mm_loadu_ps(vRe + j)};
+						auto xi{_mm_loadu_ps(vIm + j)};
+						auto tr{
+							_mm_sub_ps(_mm_mul_ps(cr, xr), _mm_mul_ps(ci, xi))};
+						auto ti{
+							_mm_add_ps(_mm_mul_ps(cr, xi), _mm_mul_ps(ci, xr))};
+						auto ur{_mm_loadu_ps(uRe + j)};
+						auto ui{_mm_loadu_ps(uIm + j)};
+						_mm_storeu_ps(uRe + j, _mm_add_ps(ur, tr));
+						_mm_storeu_ps(uIm + j, _mm_add_ps(ui, ti));
+						_mm_storeu_ps(vRe + j, _mm_sub_ps(ur, tr));
+						_mm_storeu_ps(vIm + j, _mm_sub_ps(ui, ti));
+					}
+#endif
+					for(; j < half; j++) {
+						auto tr{wRe[j] * vRe[j] - wIm[j] * vIm[j]};
+						auto ti{wRe[j] * vIm[j] + wIm[j] * vRe[j]};
+						vRe[j] = uRe[j] - tr;
+						vIm[j] = uIm[j] - ti;
+						uRe[j] += tr;
+						uIm[j] += ti;
+					}
+				}
+			}
+		}
+
+		qsizetype m_size;
+		qsizetype m_half;
+		QList<float> m_re;
+		QList<float> m_im;
+		QList<float> m_stageRe;
+		QList<float> m_stageIm;
+		QList<float> m_postRe;
+		QList<float> m_postIm;
+		QList<qsizetype> m_reversed;
+	};
+} // namespace Phonon::Native
@@ -0,0 +1,264 @@
+module;
+
+#include <QImage>
+#include <QList>
+#include <QTransform>
+#include <QVideoFrame>
+#include <QVideoFrameFormat>
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define PRECISION 6
+#define BLOCK 8
+#define LUMA_OFFSET 16
+#define CHROMA_OFFSET 128
+#define LIMITED_LUMA 219.0
+#define LIMITED_CHROMA 224.0
+#define FULL_RANGE 255.0
+#define SD_HEIGHT 576
+#define OVERSAMPLING 2
+
+export module phonon_native:frameconverter;
+
+export namespace Phonon::Native {
+	/* Converts video frames to images without going through the full
+	 * resolution RGB image. Planar and semi-planar 8 bit 4:2:0 frames are
+	 * point sampled down to twice the requested size and converted eight
+	 * pixels at a time, the small image is then scaled smoothly. Other
+	 * formats fall back to QVideoFrame::toImage(). */
+	class FrameConverter final {
+	  public:
+		/* Frame as displayed, scaled to size with the mode, or at its own
+		 * size if size is empty. Safe to call from any thread. */
+		[[nodiscard]]
+		static auto convert(QVideoFrame frame,
+			QSize size,
+			Qt::AspectRatioMode mode) -> QImage {
+			if(!frame.isValid()) {
+				return {};
+			}
+			auto rotation{frame.rotation()};
+			auto transposed{rotation == QtVideo::Rotation::Clockwise90
+				|| rotation == QtVideo::Rotation::Clockwise270};
+			auto display{transposed ? frame.size().transposed() : frame.size()};
+			auto target{
+				size.isEmpty() ? display : display.scaled(size, mode)};
+			if(target.isEmpty()) {
+				return {};
+			}
+
+			auto image{convertPlanes(
+				frame, transposed ? target.transposed() : target)};
+			if(image.isNull()) {
+				return frame.toImage().scaled(
+					target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+			}
+			/* Like QVideoFrame::toImage(), the two horizontal mirrors
+			 * cancel out and bottom-up frames are flipped vertically */
+			auto horizontal{
+				frame.mirrored() != frame.surfaceFormat().isMirrored()};
+			auto vertical{frame.surfaceFormat().scanLineDirection()
+				== QVideoFrameFormat::BottomToTop};
+			if(horizontal || vertical) {
+				image = image.mirrored(horizontal, vertical);
+			}
+			if(rotation != QtVideo::Rotation::None) {
+				image = image.transformed(
+					QTransform{}.rotate(static_cast<qreal>(rotation)));
+			}
+			return image;
+		}
+
+	  private:
+		/* Fixed point factors with PRECISION fractional bits */
+		struct Coefficients {
+			qint16 luma;
+			qint16 lumaOffset;
+			qint16 redV;
+			qint16 greenU;
+			qint16 greenV;
+			qint16 blueU;
+		};
+
+		static auto coefficients(const QVideoFrameFormat& format)
+			-> Coefficients {
+			auto red{0.2126};
+			auto blue{0.0722};
+			switch(format.colorSpace()) {
+				case QVideoFrameFormat::ColorSpace_BT601:
+					red = 0.299;
+					blue = 0.114;
+					break;
+				case QVideoFrameFormat::ColorSpace_BT2020:
+					red = 0.2627;
+					blue = 0.0593;
+					break;
+				case QVideoFrameFormat::ColorSpace_Undefined:
+					if(format.frameHeight() <= SD_HEIGHT) {
+						red = 0.299;
+						blue = 0.114;
+					}
+					break;
+				case QVideoFrameFormat::ColorSpace_BT709:
+				case QVideoFrameFormat::ColorSpace_AdobeRgb:
+					break;
+			}
+			auto green{1.0 - red - blue};
+			auto full{
+				format.colorRange() == QVideoFrameFormat::ColorRange_Full};
+			auto luma{full ? 1.0 : FULL_RANGE / LIMITED_LUMA};
+			auto chroma{full ? 1.0 : FULL_RANGE / LIMITED_CHROMA};
+			auto fixed{[](double value) {
+				return static_cast<qint16>(
+					std::lround(value * (1 << PRECISION)));
+			}};
+			return {fixed(luma),
+				static_cast<qint16>(full ? 0 : LUMA_OFFSET),
+				fixed(2.0 * (1.0 - red) * chroma),
+				fixed(2.0 * (1.0 - blue) * blue / green * chroma),
+				fixed(2.0 * (1.0 - red) * red / green * chroma),
+				fixed(2.0 * (1.0 - blue) * chroma)};
+		}
+
+		/* Null if the format has no fast path or the frame cannot be
+		 * mapped, the result is scaled to size. */
+		static auto convertPlanes(QVideoFrame& frame, QSize size) -> QImage {
+			auto format{frame.pixelFormat()};
+			if(format != QVideoFrameFormat::Format_NV12
+				&& format != QVideoFrameFormat::Format_NV21
+				&& format != QVideoFrameFormat::Format_YUV420P
+				&& format != QVideoFrameFormat::Format_YV12) {
+				return {};
+			}
+			if(!frame.map(QVideoFrame::ReadOnly)) {
+				return {};
+			}
+
+			auto width{frame.width()};
+			auto height{frame.height()};
+			QSize sampled{qMin(width, size.width() * OVERSAMPLING),
+				qMin(height, size.height() * OVERSAMPLING)};
+			QImage image{sampled, QImage::Format_RGB32};
+			auto factors{coefficients(frame.surfaceFormat())};
+
+			/* Source column of every sampled pixel, at the pixel centre */
+			QList<int> columns(sampled.width());
+			for(auto x{0}; x < sampled.width(); x++) {
+				columns[x] = static_cast<int>(
+					(2LL * x + 1) * width / (2LL * sampled.width()));
+			}
+			QList<uchar> luma(sampled.width());
+			QList<uchar> blueDifference(sampled.width());
+			QList<uchar> redDifference(sampled.width());
+
+			auto interleaved{format == QVideoFrameFormat::Format_NV12
+				|| format == QVideoFrameFormat::Format_NV21};
+			auto swapped{format == QVideoFrameFormat::Format_NV21
+				|| format == QVideoFrameFormat::Format_YV12};
+			for(auto y{0}; y < sampled.height(); y++) {
+				auto row{static_cast<int>(
+					(2LL * y + 1) * height / (2LL * sampled.height()))};
+				const auto* lumaLine{
+					frame.bits(0) + qsizetype{row} * frame.bytesPerLine(0)};
+				const auto* firstLine{
+					frame.bits(1) + qsizetype{row / 2} * frame.bytesPerLine(1)};
+				const auto* secondLine{interleaved
+						? firstLine + 1
+						: frame.bits(2)
+							+ qsizetype{row / 2} * frame.bytesPerLine(2)};
+				auto step{interleaved ? 2 : 1};
+				for(auto x{0}; x < sampled.width(); x++) {
+					auto column{columns[x]};
+					luma[x] = lumaLine[column];
+					auto first{firstLine[column / 2 * step]};
+					auto second{secondLine[column / 2 * step]};
+					blueDifference[x] = swapped ? second : first;
+					redDifference[x] = swapped ? first : second;
+				}
+				convertRow(luma.constData(),
+					blueDifference.constData(),
+					redDifference.constData(),
+					reinterpret_cast<quint32*>(image.scanLine(y)),
+					sampled.width(),
+					factors);
+			}
+			frame.unmap();
+
+			if(sampled != size) {
+				return image.scaled(
+					size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+			}
+			return image;
+		}
+
+		static auto convertRow(const uchar* y,
+			const uchar* u,
+			const uchar* v,
+			quint32* rgb,
+			int count,
+			const Coefficients& factors) -> void {
+			auto x{0};
+#if defined(__SSE2__)
+			auto zero{_mm_setzero_si128()};
+			auto alpha{_mm_set1_epi8(static_cast<char>(0xFF))};
+			auto luma{_mm_set1_epi16(factors.luma)};
+			auto lumaOffset{_mm_set1_epi16(factors.lumaOffset)};
+			auto chromaOffset{_mm_set1_epi16(CHROMA_OFFSET)};
+			auto rounding{_mm_set1_epi16(1 << (PRECISION - 1))};
+			auto redV{_mm_set1_epi16(factors.redV)};
+			auto greenU{_mm_set1_epi16(factors.greenU)};
+			auto greenV{_mm_set1_epi16(factors.greenV)};
+			auto blueU{_mm_set1_epi16(factors.blueU)};
+			auto widen{[zero](const uchar* data) {
+				return _mm_unpacklo_epi8(
+					_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data)),
+					zero);
+			}};
+			for(; x + BLOCK <= count; x += BLOCK) {
+				auto scaled{_mm_add_epi16(
+					_mm_mullo_epi16(
+						_mm_sub_epi16(widen(y + x), lumaOffset), luma),
+					rounding)};
+				auto blue{_mm_sub_epi16(widen(u + x), chromaOffset)};
+				auto red{_mm_sub_epi16(widen(v + x), chromaOffset)};
+				/* Saturating, the sums of bright saturated colours exceed
+				 * 16 bits before the shift */
+				auto r{_mm_adds_epi16(scaled, _mm_mullo_epi16(red, redV))};
+				auto g{_mm_subs_epi16(
+					_mm_subs_epi16(scaled, _mm_mullo_epi16(blue, greenU)),
+					_mm_mullo_epi16(red, greenV))};
+				auto b{_mm_adds_epi16(scaled, _mm_mullo_epi16(blue, blueU))};
+				auto r8{_mm_packus_epi16(_mm_srai_epi16(r, PRECISION), zero)};
+				auto g8{_mm_packus_epi16(_mm_srai_epi16(g, PRECISION), zero)};
+				auto b8{_mm_packus_epi16(_mm_srai_epi16(b, PRECISION), zero)};
+				/* Format_RGB32 is 0xffRRGGBB, B G R A in memory */
+				auto blueGreen{_mm_unpacklo_epi8(b8, g8)};
+				auto redAlpha{_mm_unpacklo_epi8(r8, alpha)};
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(rgb + x),
+					_mm_unpacklo_epi16(blueGreen, redAlpha));
+				_mm_storeu_si128(
+					reinterpret_cast<__m128i*>(rgb + x + BLOCK / 2),
+					_mm_unpackhi_epi16(blueGreen, redAlpha));
+			}
+#endif
+			auto clamp{[](int value) {
+				return static_cast<quint32>(qBound(
+					0, value >> PRECISION, static_cast<int>(FULL_RANGE)));
+			}};
+			for(; x < count; x++) {
+				auto scaled{(y[x] - factors.lumaOffset) * factors.luma
+					+ (1 << (PRECISION - 1))};
+				auto blue{u[x] - CHROMA_OFFSET};
+				auto red{v[x] - CHROMA_OFFSET};
+				rgb[x] = 0xFF000000U
+					| clamp(scaled + red * factors.redV) << 16U
+					| clamp(scaled - blue * factors.greenU
+							  - red * factors.greenV)
+						<< 8U
+					| clamp(scaled + blue * factors.blueU);
+			}
+		}
+	};
+} // namespace Phonon::Native
@@ -0,0 +1,300 @@
+module;
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <algorithm>
+#include <optional>
+
+#define EBML_TRACKS 0x1654AE6B
+#define EBML_TRACKENTRY 0xAE
+#define EBML_TRACKNUMBER 0xD7
+#define EBML_TRACKTYPE 0x83
+#define EBML_TRACKTYPE_VIDEO 1
+#define EBML_CUES 0x1C53BB6B
+#define EBML_CUEPOINT 0xBB
+#define EBML_CUETIME 0xB3
+#define EBML_CUETRACKPOSITIONS 0xB7
+#define EBML_CUETRACK 0xF7
+#define NSEC_PER_MSEC 1'000'000
+#define MSEC 1000
+#define MIN_FILE_SIZE 16
+#define MAX_KEYFRAMES (1 << 20)
+#define INDEX_CAPACITY 16
+
+export module phonon_native:keyframeindex;
+
+import :containerreader;
+
+export namespace Phonon::Native {
+	/* Reads the positions of the video keyframes from the seek index of a
+	 * local Matroska or MP4 file. */
+	class KeyframeReader final: private ContainerReader {
+	  public:
+		using Keyframes = QList<qint64>;
+
+		/* Returns the sorted keyframe times in milliseconds or std::nullopt
+		 * if the container has no usable index. */
+		[[nodiscard]]
+		static auto read(const QString& path) -> std::optional<Keyframes> {
+			return mapFile(
+				path, MIN_FILE_SIZE, [](const uchar* data, qint64 size) {
+					return KeyframeReader{data, size}.parse();
+				});
+		}
+
+		/* Returns the keyframe closest to the position, or the position
+		 * itself without an index. */
+		[[nodiscard]]
+		static auto nearest(const Keyframes& keyframes, qint64 position)
+			-> qint64 {
+			if(keyframes.isEmpty()) {
+				return position;
+			}
+			auto next{
+				std::lower_bound(keyframes.begin(), keyframes.end(), position)};
+			if(next == keyframes.end()) {
+				return keyframes.last();
+			}
+			if(next == keyframes.begin()
+				|| *next - position < position - *std::prev(next)) {
+				return *next;
+			}
+			return *std::prev(next);
+		}
+
+	  private:
+		KeyframeReader(const uchar* data, qint64 size):
+			ContainerReader{data, size} {}
+
+		static auto finish(Keyframes keyframes) -> std::optional<Keyframes> {
+			if(keyframes.isEmpty()) {
+				return std::nullopt;
+			}
+			std::sort(keyframes.begin(), keyframes.end());
+			keyframes.erase(std::unique(keyframes.begin(), keyframes.end()),
+				keyframes.end());
+			return keyframes;
+		}
+
+		auto parse() const -> std::optional<Keyframes> {
+			if(matches(0, "\x1A\x45\xDF\xA3")) {
+				return readMatroska();
+			}
+			if(matches(4, "ftyp")) {
+				return readMp4();
+			}
+			return std::nullopt;
+		}
+
+		/* Matroska cue points are usually only written for video
+		 * keyframes, the track is checked anyway. */
+		auto readMatroska() const -> std::optional<Keyframes> {
+			auto segment{readSegment({EBML_TRACKS, EBML_CUES})};
+			if(!segment || !segment->elements.contains(EBML_CUES)) {
+				return std::nullopt;
+			}
+			QList<quint64> videoTracks;
+			if(segment->elements.contains(EBML_TRACKS)) {
+				forEachElement(segment->elements[EBML_TRACKS],
+					[&](const Element& entry) {
+						if(entry.id != EBML_TRACKENTRY) {
+							return true;
+						}
+						quint64 number{};
+						quint64 type{};
+						forEachElement(entry, [&](const Element& field) {
+							if(field.id == EBML_TRACKNUMBER) {
+								number = readUnsigned(field);
+							} else if(field.id == EBML_TRACKTYPE) {
+								type = readUnsigned(field);
+							}
+							return true;
+						});
+						if(type == EBML_TRACKTYPE_VIDEO) {
+							videoTracks << number;
+						}
+						return true;
+					});
+			}
+
+			Keyframes result;
+			forEachElement(
+				segment->elements[EBML_CUES], [&](const Element& point) {
+					if(point.id != EBML_CUEPOINT) {
+						return true;
+					}
+					quint64 time{};
+					bool video{videoTracks.isEmpty()};
+					forEachElement(point, [&](const Element& field) {
+						if(field.id == EBML_CUETIME) {
+							time = readUnsigned(field);
+						} else if(field.id == EBML_CUETRACKPOSITIONS) {
+							forEachElement(field, [&](const Element& position) {
+								if(position.id == EBML_CUETRACK
+									&& videoTracks.contains(
+										readUnsigned(position))) {
+									video = true;
+								}
+								return true;
+							});
+						}
+						return true;
+					});
+					if(video) {
+						result << static_cast<qint64>(
+							time * segment->timecodeScale / NSEC_PER_MSEC);
+					}
+					return result.size() < MAX_KEYFRAMES;
+				});
+			return finish(result);
+		}
+
+		/* Uses the sync sample table of the first video track. Tracks
+		 * without one consist of keyframes only and need no index. */
+		auto readMp4() const -> std::optional<Keyframes> {
+			auto moov{findBox({0, 0, m_size}, fourcc("moov"))};
+			if(!moov) {
+				return std::nullopt;
+			}
+			std::optional<Keyframes> result;
+			forEachBox(*moov, [&](const Element& trak) {
+				if(trak.id != fourcc("trak")) {
+					return true;
+				}
+				auto mdia{findBox(trak, fourcc("mdia"))};
+				auto hdlr{mdia ? findBox(*mdia, fourcc("hdlr")) : std::nullopt};
+				if(!hdlr
+					|| bigEndian<quint32>(hdlr->data + 8) != fourcc("vide")) {
+					return true;
+				}
+				result = readSyncSamples(*mdia);
+				return false;
+			});
+			return result;
+		}
+
+		[[nodiscard]]
+		auto readSyncSamples(const Element& mdia) const
+			-> std::optional<Keyframes> {
+			auto mdhd{findBox(mdia, fourcc("mdhd"))};
+			auto stbl{findBox(mdia, {fourcc("minf"), fourcc("stbl")})};
+			auto stss{stbl ? findBox(*stbl, fourcc("stss")) : std::nullopt};
+			auto stts{stbl ? findBox(*stbl, fourcc("stts")) : std::nullopt};
+			if(!mdhd || !stss || !stts) {
+				return std::nullopt;
+			}
+			auto [timescale, length]{readTimescale(*mdhd)};
+			if(timescale == 0) {
+				return std::nullopt;
+			}
+
+			/* Sync samples are numbered from 1 in ascending order */
+			auto syncCount{qMin<quint32>(bigEndian<quint32>(stss->data + 4),
+				static_cast<quint32>(qMax<qint64>(0, (stss->size - 8) / 4)))};
+			auto entries{bigEndian<quint32>(stts->data + 4)};
+			Keyframes result;
+			quint32 sync{0};
+			quint64 sample{1};
+			quint64 time{};
+			for(quint32 i{0}; i < entries && sync < syncCount
+				&& static_cast<qint64>(i) * 8 + 16 <= stts->size
+				&& result.size() < MAX_KEYFRAMES;
+				i++) {
+				auto count{bigEndian<quint32>(stts->data + 8 + i * 8)};
+				auto delta{bigEndian<quint32>(stts->data + 12 + i * 8)};
+				while(sync < syncCount) {
+					quint64 number{
+						bigEndian<quint32>(stss->data + 8 + sync * 4)};
+					if(number < sample) {
+						sync++;
+						continue;
+					}
+					if(number >= sample + count) {
+						break;
+					}
+					result << static_cast<qint64>(
+						(time + (number - sample) * delta) * MSEC / timescale);
+					sync++;
+				}
+				sample += count;
+				time += static_cast<quint64>(count) * delta;
+			}
+			return finish(result);
+		}
+	};
+
+	/* In-memory index of the keyframes of recently seeked files, validated
+	 * against the file size and modification time. */
+	class KeyframeIndex final {
+	  public:
+		KeyframeIndex() = default;
+		~KeyframeIndex() = default;
+		KeyframeIndex(const KeyframeIndex&) = delete;
+		KeyframeIndex(KeyframeIndex&&) = delete;
+		auto operator=(const KeyframeIndex&) -> KeyframeIndex& = delete;
+		auto operator=(KeyframeIndex&&) -> KeyframeIndex& = delete;
+
+		static inline KeyframeIndex* self{};
+
+		static auto instance() -> KeyframeIndex* {
+			if(!self) {
+				self = new KeyframeIndex{};
+			}
+			return self;
+		}
+
+		[[nodiscard]]
+		auto find(const QString& path)
+			-> std::optional<KeyframeReader::Keyframes> {
+			QFileInfo file{path};
+			QMutexLocker locker{&m_mutex};
+			auto entry{m_entries.find(file.absoluteFilePath())};
+			if(entry == m_entries.end()) {
+				return std::nullopt;
+			}
+			if(entry->size != file.size()
+				|| entry->modified != file.lastModified().toMSecsSinceEpoch()) {
+				m_entries.erase(entry);
+				return std::nullopt;
+			}
+			entry->lastUsed = ++m_clock;
+			return entry->keyframes;
+		}
+
+		auto insert(const QString& path,
+			const KeyframeReader::Keyframes& keyframes) -> void {
+			QFileInfo file{path};
+			QMutexLocker locker{&m_mutex};
+			if(m_entries.size() >= INDEX_CAPACITY
+				&& !m_entries.contains(file.absoluteFilePath())) {
+				auto oldest{std::min_element(m_entries.begin(),
+					m_entries.end(),
+					[](const Entry& lhs, const Entry& rhs) {
+						return lhs.lastUsed < rhs.lastUsed;
+					})};
+				m_entries.erase(oldest);
+			}
+			m_entries.insert(file.absoluteFilePath(),
+				{keyframes,
+					file.size(),
+					file.lastModified().toMSecsSinceEpoch(),
+					++m_clock});
+		}
+
+	  private:
+		struct Entry {
+			KeyframeReader::Keyframes keyframes;
+			qint64 size{};
+			qint64 modified{};
+			quint64 lastUsed{};
+		};
+
+		QMutex m_mutex;
+		QHash<QString, Entry> m_entries;
+		quint64 m_clock{};
+	};
+} // namespace Phonon::Native
@@ -0,0 +1,148 @@
+module;
+
+#include <QVariantMap>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+
+#define HISTOGRAM_BUCKETS 64
+#define PERCENTILE_50 0.50
+#define PERCENTILE_95 0.95
+#define PERCENTILE_99 0.99
+#define USEC_PER_MSEC 1000.0
+
+export module phonon_native:loadstatistics;
+
+using Qt::Literals::StringLiterals::operator""_L1;
+
+export namespace Phonon::Native {
+	/* Histogram of durations in microseconds. Each power of two is split
+	 * into two buckets, so recording is a few integer operations and the
+	 * reported percentiles are at most 1.5 times the real value. Counters
+	 * are atomic so that audio threads can record without a lock. */
+	class LatencyHistogram final {
+	  public:
+		LatencyHistogram() = default;
+		~LatencyHistogram() = default;
+		LatencyHistogram(const LatencyHistogram&) = delete;
+		LatencyHistogram(LatencyHistogram&&) = delete;
+		auto operator=(const LatencyHistogram&) -> LatencyHistogram& = delete;
+		auto operator=(LatencyHistogram&&) -> LatencyHistogram& = delete;
+
+		auto record(qint64 usec) -> void {
+			m_buckets[bucket(usec)].fetch_add(1, std::memory_order_relaxed);
+			m_count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		[[nodiscard]]
+		auto count() const -> qint64 {
+			return m_count.load(std::memory_order_relaxed);
+		}
+
+		/* {count, p50, p95, p99} with the percentiles in ms */
+		[[nodiscard]]
+		auto toVariantMap() const -> QVariantMap {
+			return {{"count"_L1, count()},
+				{"p50"_L1, percentile(PERCENTILE_50)},
+				{"p95"_L1, percentile(PERCENTILE_95)},
+				{"p99"_L1, percentile(PERCENTILE_99)}};
+		}
+
+	  private:
+		/* Two buckets per power of two */
+		static auto bucket(qint64 usec) -> int {
+			auto value{static_cast<quint64>(qMax<qint64>(usec, 1))};
+			auto exponent{std::bit_width(value) - 1};
+			auto upperHalf{
+				exponent > 0 && ((value >> (exponent - 1)) & 1U) != 0};
+			return qMin(exponent * 2 + (upperHalf ? 1 : 0),
+				HISTOGRAM_BUCKETS - 1);
+		}
+
+		/* Upper bound of the bucket holding the percentile */
+		[[nodiscard]]
+		auto percentile(double fraction) const -> double {
+			auto rank{static_cast<qint64>(
+				std::ceil(fraction * static_cast<double>(count())))};
+			qint64 seen{};
+			for(auto i{0}; i < HISTOGRAM_BUCKETS; i++) {
+				seen += m_buckets[i].load(std::memory_order_relaxed);
+				if(seen >= rank) {
+					auto exponent{i / 2};
+					auto bound{static_cast<double>(quint64{1} << exponent)
+						* (i % 2 == 0 ? 1.5 : 2.0)};
+					return bound / USEC_PER_MSEC;
+				}
+			}
+			return {};
+		}
+
+		std::array<std::atomic<quint32>, HISTOGRAM_BUCKETS> m_buckets{};
+		std::atomic<qint64> m_count{};
+	};
+
+	/* Latency of the phases of loading a source, measured from the call to
+	 * setSource. */
+	class LoadStatistics final {
+	  public:
+		enum Phase {
+			Loading,
+			Loaded,
+			ChapterProbe,
+			TrackRegistration,
+			Play,
+			FirstPosition,
+			FirstAudio,
+			FirstFrame,
+			PhaseCount
+		};
+
+		static constexpr std::array<const char*, PhaseCount> phaseNames{
+			"loading",
+			"loaded",
+			"chapterProbe",
+			"trackRegistration",
+			"play",
+			"firstPosition",
+			"firstAudio",
+			"firstFrame"};
+
+		LoadStatistics() = default;
+		~LoadStatistics() = default;
+		LoadStatistics(const LoadStatistics&) = delete;
+		LoadStatistics(LoadStatistics&&) = delete;
+		auto operator=(const LoadStatistics&) -> LoadStatistics& = delete;
+		auto operator=(LoadStatistics&&) -> LoadStatistics& = delete;
+
+		/* Aggregate of all media objects */
+		static inline LoadStatistics* self{};
+
+		static auto instance() -> LoadStatistics* {
+			if(!self) {
+				self = new LoadStatistics{};
+			}
+			return self;
+		}
+
+		auto record(Phase phase, qint64 usec) -> void {
+			m_histograms[phase].record(usec);
+		}
+
+		/* {phase: {count, p50, p95, p99}} */
+		[[nodiscard]]
+		auto toVariantMap() const -> QVariantMap {
+			QVariantMap phases;
+			for(auto phase{0}; phase < PhaseCount; phase++) {
+				if(m_histograms[phase].count() > 0) {
+					phases.insert(QLatin1String{phaseNames[phase]},
+						m_histograms[phase].toVariantMap());
+				}
+			}
+			return phases;
+		}
+
+	  private:
+		std::array<LatencyHistogram, PhaseCount> m_histograms{};
+	};
+} // namespace Phonon::Native
@@ -0,0 +1,195 @@
+module;
+
+#include <QList>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numbers>
+#include <optional>
+
+#define ABSOLUTE_GATE -70.0
+#define RELATIVE_GATE -10.0
+#define LOUDNESS_OFFSET -0.691
+#define SUBBLOCKS_PER_SECOND 10
+#define SUBBLOCKS_PER_BLOCK 4
+#define OVERSAMPLING 4
+#define INTERPOLATION_TAPS 12
+
+export module phonon_native:loudnessmeter;
+
+export namespace Phonon::Native {
+	/* Integrated loudness after EBU R128 / ITU-R BS.1770 and the true peak
+	 * through 4x oversampling. */
+	class LoudnessMeter final {
+	  public:
+		/* One weight per channel: 1.0 for front, 1.41 for surround and 0
+		 * for LFE channels */
+		LoudnessMeter(int rate, const QList<double>& weights):
+			m_weights{weights}, m_channels(weights.size()),
+			m_subBlockLength{qMax(1, rate / SUBBLOCKS_PER_SECOND)} {
+			/* K-weighting: high shelf followed by a high-pass, computed for
+			 * the sample rate */
+			auto shelf{std::tan(std::numbers::pi * 1681.974450955533 / rate)};
+			auto gain{std::pow(10.0, 3.999843853973347 / 20.0)};
+			auto band{std::pow(gain, 0.4996667741545416)};
+			auto q{0.7071752369554196};
+			auto a0{1.0 + shelf / q + shelf * shelf};
+			m_shelf = {(gain + band * shelf / q + shelf * shelf) / a0,
+				2.0 * (shelf * shelf - gain) / a0,
+				(gain - band * shelf / q + shelf * shelf) / a0,
+				2.0 * (shelf * shelf - 1.0) / a0,
+				(1.0 - shelf / q + shelf * shelf) / a0};
+			auto pass{std::tan(std::numbers::pi * 38.13547087602444 / rate)};
+			q = 0.5003270373238773;
+			a0 = 1.0 + pass / q + pass * pass;
+			m_highPass = {1.0,
+				-2.0,
+				1.0,
+				2.0 * (pass * pass - 1.0) / a0,
+				(1.0 - pass / q + pass * pass) / a0};
+
+			/* Windowed sinc interpolator, one phase per oversampled
+			 * position */
+			constexpr auto taps{OVERSAMPLING * INTERPOLATION_TAPS};
+			for(auto i{0}; i < taps; i++) {
+				auto x{(i - (taps - 1) / 2.0) / OVERSAMPLING};
+				auto sinc{x == 0.0 ? 1.0
+								   : std::sin(std::numbers::pi * x)
+										 / (std::numbers::pi * x)};
+				auto window{0.5
+					- 0.5
+						* std::cos(2.0 * std::numbers::pi * (i + 0.5) / taps)};
+				m_interpolator[i % OVERSAMPLING][i / OVERSAMPLING] =
+					static_cast<float>(sinc * window);
+			}
+		}
+
+		~LoudnessMeter() = default;
+		LoudnessMeter(const LoudnessMeter&) = delete;
+		LoudnessMeter(LoudnessMeter&&) = delete;
+		auto operator=(const LoudnessMeter&) -> LoudnessMeter& = delete;
+		auto operator=(LoudnessMeter&&) -> LoudnessMeter& = delete;
+
+		/* Interleaved samples in the range -1 to 1 */
+		auto process(const float* samples, qsizetype frames) -> void {
+			auto channels{m_channels.size()};
+			for(qsizetype frame{0}; frame < frames; frame++) {
+				for(qsizetype i{0}; i < channels; i++) {
+					auto sample{samples[frame * channels + i]};
+					auto& channel{m_channels[i]};
+					measurePeak(channel, sample);
+					if(m_weights[i] > 0.0) {
+						auto weighted{filter(m_highPass,
+							channel.highPass,
+							filter(m_shelf, channel.shelf, sample))};
+						channel.energy += weighted * weighted;
+					}
+				}
+				if(++m_subBlockFrames == m_subBlockLength) {
+					finishSubBlock();
+				}
+			}
+		}
+
+		/* LUFS, std::nullopt if everything was below the absolute gate */
+		[[nodiscard]]
+		auto integrated() const -> std::optional<double> {
+			QList<double> blocks;
+			for(auto i{SUBBLOCKS_PER_BLOCK - 1}; i < m_subBlocks.size(); i++) {
+				double sum{};
+				for(auto j{0}; j < SUBBLOCKS_PER_BLOCK; j++) {
+					sum += m_subBlocks[i - j];
+				}
+				blocks << sum / SUBBLOCKS_PER_BLOCK;
+			}
+			auto gated{[&](double threshold) -> std::optional<double> {
+				double sum{};
+				qsizetype count{};
+				for(auto energy: blocks) {
+					if(loudness(energy) > threshold) {
+						sum += energy;
+						count++;
+					}
+				}
+				if(count == 0) {
+					return std::nullopt;
+				}
+				return sum / static_cast<double>(count);
+			}};
+			auto absolute{gated(ABSOLUTE_GATE)};
+			if(!absolute) {
+				return std::nullopt;
+			}
+			auto relative{gated(loudness(*absolute) + RELATIVE_GATE)};
+			return loudness(relative ? *relative : *absolute);
+		}
+
+		/* Linear, 1.0 is full scale */
+		[[nodiscard]]
+		auto truePeak() const -> double {
+			return m_peak;
+		}
+
+	  private:
+		/* b0, b1, b2, a1, a2 */
+		using Coefficients = std::array<double, 5>;
+
+		struct Channel {
+			std::array<double, 2> shelf{};
+			std::array<double, 2> highPass{};
+			std::array<float, INTERPOLATION_TAPS> history{};
+			double energy{};
+		};
+
+		static auto loudness(double energy) -> double {
+			return LOUDNESS_OFFSET + 10.0 * std::log10(energy);
+		}
+
+		/* Transposed direct form II */
+		static auto filter(const Coefficients& c, std::array<double, 2>& z,
+			double input) -> double {
+			auto output{c[0] * input + z[0]};
+			z[0] = c[1] * input - c[3] * output + z[1];
+			z[1] = c[2] * input - c[4] * output;
+			return output;
+		}
+
+		auto measurePeak(Channel& channel, float sample) -> void {
+			auto& history{channel.history};
+			std::copy_backward(
+				history.begin(), history.end() - 1, history.end());
+			history[0] = sample;
+			for(const auto& phase: m_interpolator) {
+				float value{};
+				for(auto i{0}; i < INTERPOLATION_TAPS; i++) {
+					value += phase[i] * history[i];
+				}
+				m_peak = qMax(m_peak, static_cast<double>(std::abs(value)));
+			}
+			m_peak = qMax(m_peak, static_cast<double>(std::abs(sample)));
+		}
+
+		auto finishSubBlock() -> void {
+			double energy{};
+			for(qsizetype i{0}; i < m_channels.size(); i++) {
+				energy +=
+					m_weights[i] * m_channels[i].energy / m_subBlockLength;
+				m_channels[i].energy = 0.0;
+			}
+			m_subBlocks << energy;
+			m_subBlockFrames = 0;
+		}
+
+		QList<double> m_weights;
+		QList<Channel> m_channels;
+		Coefficients m_shelf{};
+		Coefficients m_highPass{};
+		std::array<std::array<float, INTERPOLATION_TAPS>, OVERSAMPLING>
+			m_interpolator{};
+		/* Mean square of each 100 ms, blocks are four of them */
+		QList<double> m_subBlocks;
+		int m_subBlockLength;
+		int m_subBlockFrames{};
+		double m_peak{};
+	};
+} // namespace Phonon::Native
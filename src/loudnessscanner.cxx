@@ -0,0 +1,213 @@
+module;
+
+#include <QAudioBuffer>
+#include <QAudioDecoder>
+#include <QEventLoop>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <QUrl>
+#include <QtCore/qtmochelpers.h>
+#include <atomic>
+#include <cmath>
+#include <memory>
+
+#define LOUDNESS_TARGET -18.0
+#define SURROUND_WEIGHT 1.41
+
+export module phonon_native:loudnessscanner;
+
+import :loudnessmeter;
+import :mediainfocache;
+
+export namespace Phonon::Native {
+	/* Measures the integrated loudness and true peak of local files on a
+	 * thread pool, one file per thread, and stores them in the media info
+	 * cache. Media objects apply the resulting gain when they load a
+	 * measured source. */
+	class LoudnessScanner final: public QObject {
+		Q_OBJECT
+
+	  public:
+		LoudnessScanner() {
+			m_pool.setMaxThreadCount(QThread::idealThreadCount());
+		}
+
+		~LoudnessScanner() final {
+			m_cancelled.store(true, std::memory_order_relaxed);
+			m_pool.clear();
+			m_pool.waitForDone();
+		}
+
+		LoudnessScanner(const LoudnessScanner&) = delete;
+		LoudnessScanner(LoudnessScanner&&) = delete;
+		auto operator=(const LoudnessScanner&) -> LoudnessScanner& = delete;
+		auto operator=(LoudnessScanner&&) -> LoudnessScanner& = delete;
+
+		static inline LoudnessScanner* self{};
+		/* Integrated loudness sources are normalised to, in LUFS */
+		static inline double target{LOUDNESS_TARGET};
+		static inline bool normalization{true};
+
+		static auto instance() -> LoudnessScanner* {
+			if(!self) {
+				self = new LoudnessScanner{};
+			}
+			return self;
+		}
+
+		/* Gain that brings a measured source to the target without letting
+		 * its true peak exceed full scale, 1.0 for unmeasured sources */
+		[[nodiscard]]
+		static auto gain(const MediaInfo& info) -> float {
+			if(!normalization || !info.loudnessMeasured) {
+				return 1.0F;
+			}
+			auto gain{std::pow(10.0, (target - info.loudness) / 20.0)};
+			if(info.truePeak > 0.0) {
+				gain = qMin(gain, 1.0 / info.truePeak);
+			}
+			return static_cast<float>(gain);
+		}
+
+		/* Queues the local files that have not been measured yet */
+		auto scan(const QList<QUrl>& urls) -> void {
+			for(const auto& url: urls) {
+				if(!url.isLocalFile()) {
+					continue;
+				}
+				auto info{MediaInfoCache::instance()->find(url)};
+				if(info && info->loudnessMeasured) {
+					continue;
+				}
+				{
+					QMutexLocker locker{&m_mutex};
+					if(m_pending.contains(url)) {
+						continue;
+					}
+					m_pending.insert(url);
+				}
+				m_pool.start([=, this]() { measure(url); });
+			}
+		}
+
+		[[nodiscard]]
+		auto threads() const -> int {
+			return m_pool.maxThreadCount();
+		}
+
+		auto setThreads(int threads) -> void {
+			m_pool.setMaxThreadCount(
+				threads > 0 ? threads : QThread::idealThreadCount());
+		}
+
+	  signals:
+		/* Emitted from the pool once the result is in the cache */
+		auto scanned(const QUrl& _t1) -> void;
+
+	  private:
+		/* Runs on the pool */
+		auto measure(const QUrl& url) -> void {
+			std::unique_ptr<LoudnessMeter> meter;
+			QList<float> samples;
+			QEventLoop loop;
+			QAudioDecoder decoder;
+			connect(
+				&decoder,
+				&QAudioDecoder::bufferReady,
+				&loop,
+				[&]() {
+					if(m_cancelled.load(std::memory_order_relaxed)) {
+						decoder.stop();
+						loop.quit();
+						return;
+					}
+					auto buffer{decoder.read()};
+					auto format{buffer.format()};
+					if(!meter) {
+						meter = std::make_unique<LoudnessMeter>(
+							format.sampleRate(), weights(format));
+					}
+					auto count{buffer.sampleCount()};
+					if(format.sampleFormat() == QAudioFormat::Float) {
+						meter->process(
+							buffer.constData<float>(), buffer.frameCount());
+						return;
+					}
+					samples.resize(count);
+					const auto* data{buffer.constData<char>()};
+					auto stride{format.bytesPerSample()};
+					for(qsizetype i{0}; i < count; i++) {
+						samples[i] =
+							format.normalizedSampleValue(data + i * stride);
+					}
+					meter->process(samples.constData(), buffer.frameCount());
+				},
+				Qt::DirectConnection);
+			connect(&decoder,
+				&QAudioDecoder::finished,
+				&loop,
+				&QEventLoop::quit,
+				Qt::DirectConnection);
+			connect(
+				&decoder,
+				qOverload<QAudioDecoder::Error>(&QAudioDecoder::error),
+				&loop,
+				[&]() { loop.quit(); },
+				Qt::DirectConnection);
+			decoder.setSource(url);
+			decoder.start();
+			loop.exec();
+
+			{
+				QMutexLocker locker{&m_mutex};
+				m_pending.remove(url);
+			}
+			if(m_cancelled.load(std::memory_order_relaxed) || !meter) {
+				return;
+			}
+			if(decoder.error() != QAudioDecoder::NoError) {
+				qDebug() << "Cannot measure loudness of" << url << ":"
+						 << decoder.errorString();
+				return;
+			}
+			/* Silence is stored as measured with no gain change */
+			auto loudness{meter->integrated().value_or(target)};
+			MediaInfoCache::instance()->setLoudness(
+				url, loudness, meter->truePeak());
+			emit scanned(url);
+		}
+
+		/* BS.1770 channel weights in the order of the frames */
+		static auto weights(QAudioFormat format) -> QList<double> {
+			if(format.channelConfig() == QAudioFormat::ChannelConfigUnknown) {
+				format.setChannelConfig(
+					QAudioFormat::defaultChannelConfigForChannelCount(
+						format.channelCount()));
+			}
+			QList<double> result(qMax(0, format.channelCount()), 1.0);
+			auto weight{[&](QAudioFormat::AudioChannelPosition position,
+							double value) {
+				auto offset{format.channelOffset(position)};
+				if(offset >= 0 && offset < result.size()) {
+					result[offset] = value;
+				}
+			}};
+			weight(QAudioFormat::BackLeft, SURROUND_WEIGHT);
+			weight(QAudioFormat::BackRight, SURROUND_WEIGHT);
+			weight(QAudioFormat::SideLeft, SURROUND_WEIGHT);
+			weight(QAudioFormat::SideRight, SURROUND_WEIGHT);
+			weight(QAudioFormat::LFE, 0.0);
+			weight(QAudioFormat::LFE2, 0.0);
+			return result;
+		}
+
+		QThreadPool m_pool;
+		QMutex m_mutex;
+		QSet<QUrl> m_pending;
+		std::atomic<bool> m_cancelled{};
+	};
+} // namespace Phonon::Native
+
+#include "loudnessscanner.moc"
@@ -0,0 +1,300 @@
+module;
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMultiMap>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+#include <QUrl>
+#include <optional>
+
+#define CACHE_MAGIC 0x504E4D43
+#define CACHE_VERSION 2
+#define CACHE_CAPACITY 2048
+#define SAVE_DELAY 2000
+
+export module phonon_native:mediainfocache;
+
+using Qt::Literals::StringLiterals::operator""_L1;
+
+export namespace Phonon::Native {
+	struct MediaInfo {
+		QList<QPair<float, float>> chapters;
+		QStringList audioTracks;
+		QStringList subtitleTracks;
+		QMultiMap<QString, QString> metaData;
+		qint64 duration{};
+		/* Integrated loudness in LUFS and linear true peak */
+		double loudness{};
+		double truePeak{};
+		bool chaptersProbed{};
+		bool loudnessMeasured{};
+	};
+
+	/* Persistent index of probed media info, keyed by local path and
+	 * validated against the file size and modification time. Written
+	 * SAVE_DELAY ms after the last new entry or loudness, and on exit. */
+	class MediaInfoCache final {
+	  public:
+		/* Created on the GUI thread, the save timer runs there */
+		MediaInfoCache() {
+			load();
+			m_saveTimer.setSingleShot(true);
+			m_saveTimer.setInterval(SAVE_DELAY);
+			QObject::connect(
+				&m_saveTimer,
+				&QTimer::timeout,
+				&m_saveTimer,
+				[this]() { save(); },
+				Qt::AutoConnection);
+		}
+
+		~MediaInfoCache() {
+			save();
+		}
+
+		MediaInfoCache(const MediaInfoCache&) = delete;
+		MediaInfoCache(MediaInfoCache&&) = delete;
+		auto operator=(const MediaInfoCache&) -> MediaInfoCache& = delete;
+		auto operator=(MediaInfoCache&&) -> MediaInfoCache& = delete;
+
+		static inline MediaInfoCache* self{};
+
+		static auto instance() -> MediaInfoCache* {
+			if(!self) {
+				self = new MediaInfoCache{};
+			}
+			return self;
+		}
+
+		[[nodiscard]]
+		auto find(const QUrl& url) -> std::optional<MediaInfo> {
+			if(!url.isLocalFile()) {
+				return std::nullopt;
+			}
+			QFileInfo file{url.toLocalFile()};
+			QMutexLocker locker{&m_mutex};
+			auto entry{m_entries.find(file.absoluteFilePath())};
+			if(entry == m_entries.end()) {
+				m_misses++;
+				return std::nullopt;
+			}
+			if(entry->size != file.size()
+				|| entry->modified
+					   != file.lastModified().toMSecsSinceEpoch()) {
+				m_entries.erase(entry);
+				m_dirty = true;
+				m_misses++;
+				return std::nullopt;
+			}
+			entry->lastUsed = ++m_clock;
+			m_dirty = true;
+			m_hits++;
+			return entry->info;
+		}
+
+		auto insert(const QUrl& url, const MediaInfo& info) -> void {
+			if(!url.isLocalFile()) {
+				return;
+			}
+			QFileInfo file{url.toLocalFile()};
+			if(!file.exists()) {
+				return;
+			}
+			QMutexLocker locker{&m_mutex};
+			auto entry{valid(file)};
+			Entry updated{info,
+				file.size(),
+				file.lastModified().toMSecsSinceEpoch(),
+				++m_clock};
+			if(entry != m_entries.end() && entry->info.loudnessMeasured
+				&& !info.loudnessMeasured) {
+				/* Keep a loudness measured in the background */
+				updated.info.loudness = entry->info.loudness;
+				updated.info.truePeak = entry->info.truePeak;
+				updated.info.loudnessMeasured = true;
+			}
+			m_entries.insert(file.absoluteFilePath(), updated);
+			m_dirty = true;
+			evict();
+			scheduleSave();
+		}
+
+		/* Adds the loudness to the entry of the file, creating one that
+		 * only holds the loudness if there is none */
+		auto setLoudness(const QUrl& url, double loudness, double truePeak)
+			-> void {
+			if(!url.isLocalFile()) {
+				return;
+			}
+			QFileInfo file{url.toLocalFile()};
+			if(!file.exists()) {
+				return;
+			}
+			QMutexLocker locker{&m_mutex};
+			auto entry{valid(file)};
+			if(entry == m_entries.end()) {
+				entry = m_entries.insert(file.absoluteFilePath(),
+					{{},
+						file.size(),
+						file.lastModified().toMSecsSinceEpoch(),
+						++m_clock});
+			}
+			entry->info.loudness = loudness;
+			entry->info.truePeak = truePeak;
+			entry->info.loudnessMeasured = true;
+			m_dirty = true;
+			evict();
+			scheduleSave();
+		}
+
+		[[nodiscard]]
+		auto hits() -> qint64 {
+			QMutexLocker locker{&m_mutex};
+			return m_hits;
+		}
+
+		[[nodiscard]]
+		auto misses() -> qint64 {
+			QMutexLocker locker{&m_mutex};
+			return m_misses;
+		}
+
+		[[nodiscard]]
+		auto capacity() -> int {
+			QMutexLocker locker{&m_mutex};
+			return m_capacity;
+		}
+
+		auto setCapacity(int capacity) -> void {
+			QMutexLocker locker{&m_mutex};
+			m_capacity = qMax(0, capacity);
+			evict();
+		}
+
+		auto save() -> void {
+			QMutexLocker locker{&m_mutex};
+			if(!m_dirty) {
+				return;
+			}
+			QDir{}.mkpath(QFileInfo{path()}.absolutePath());
+			QSaveFile file{path()};
+			if(!file.open(QIODevice::WriteOnly)) {
+				qDebug() << "Cannot write media info cache:"
+						 << file.errorString();
+				return;
+			}
+			QDataStream stream{&file};
+			stream.setVersion(QDataStream::Qt_6_0);
+			stream << quint32{CACHE_MAGIC} << quint32{CACHE_VERSION}
+				   << static_cast<quint32>(m_entries.size());
+			for(auto entry{m_entries.cbegin()}; entry != m_entries.cend();
+				entry++) {
+				const auto& info{entry->info};
+				stream << entry.key() << entry->size << entry->modified
+					   << entry->lastUsed << info.chapters << info.audioTracks
+					   << info.subtitleTracks << info.metaData << info.duration
+					   << info.chaptersProbed << info.loudness << info.truePeak
+					   << info.loudnessMeasured;
+			}
+			if(file.commit()) {
+				m_dirty = false;
+			}
+		}
+
+	  private:
+		struct Entry {
+			MediaInfo info;
+			qint64 size{};
+			qint64 modified{};
+			quint64 lastUsed{};
+		};
+
+		static auto path() -> QString {
+			return QStandardPaths::writableLocation(
+					   QStandardPaths::GenericCacheLocation)
+				+ "/phonon-native/mediainfo.cache"_L1;
+		}
+
+		auto load() -> void {
+			QFile file{path()};
+			if(!file.open(QIODevice::ReadOnly)) {
+				return;
+			}
+			QDataStream stream{&file};
+			stream.setVersion(QDataStream::Qt_6_0);
+			quint32 magic{};
+			quint32 version{};
+			quint32 count{};
+			stream >> magic >> version >> count;
+			if(magic != CACHE_MAGIC || version != CACHE_VERSION) {
+				return;
+			}
+			for(quint32 i{0};
+				i < count && stream.status() == QDataStream::Ok;
+				i++) {
+				QString key;
+				Entry entry;
+				auto& info{entry.info};
+				stream >> key >> entry.size >> entry.modified
+					>> entry.lastUsed >> info.chapters >> info.audioTracks
+					>> info.subtitleTracks >> info.metaData >> info.duration
+					>> info.chaptersProbed >> info.loudness >> info.truePeak
+					>> info.loudnessMeasured;
+				if(stream.status() == QDataStream::Ok) {
+					m_clock = qMax(m_clock, entry.lastUsed);
+					m_entries.insert(key, entry);
+				}
+			}
+			evict();
+		}
+
+		/* Restarts the timer, callable from any thread */
+		auto scheduleSave() -> void {
+			QMetaObject::invokeMethod(&m_saveTimer,
+				qOverload<>(&QTimer::start),
+				Qt::QueuedConnection);
+		}
+
+		/* The entry of the file if it is still up to date */
+		auto valid(const QFileInfo& file) -> QHash<QString, Entry>::iterator {
+			auto entry{m_entries.find(file.absoluteFilePath())};
+			if(entry != m_entries.end()
+				&& (entry->size != file.size()
+					|| entry->modified
+						   != file.lastModified().toMSecsSinceEpoch())) {
+				return m_entries.end();
+			}
+			return entry;
+		}
+
+		auto evict() -> void {
+			while(m_entries.size() > m_capacity) {
+				auto oldest{m_entries.begin()};
+				for(auto entry{m_entries.begin()}; entry != m_entries.end();
+					entry++) {
+					if(entry->lastUsed < oldest->lastUsed) {
+						oldest = entry;
+					}
+				}
+				m_entries.erase(oldest);
+				m_dirty = true;
+			}
+		}
+
+		QMutex m_mutex;
+		QHash<QString, Entry> m_entries;
+		quint64 m_clock{};
+		qint64 m_hits{};
+		qint64 m_misses{};
+		int m_capacity{CACHE_CAPACITY};
+		bool m_dirty{};
+		QTimer m_saveTimer;
+	};
+} // namespace Phonon::Native
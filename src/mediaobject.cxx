@@ -1,28 +1,70 @@
 module;
 
+#include <QAudioBuffer>
+#include <QAudioBufferOutput>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QLoggingCategory>
 #include <QMediaMetaData>
 #include <QMediaPlayer>
+#include <QPointer>
 #include <QProcess>
+#include <QTimer>
+#include <QVideoFrame>
+#include <QVideoSink>
+#include <QtConcurrentRun>
 #include <QtCore/qtmochelpers.h>
+#include <array>
+#include <cstdlib>
+#include <utility>
 #include <phonon/AddonInterface>
 #include <phonon/GlobalDescriptionContainer>
 #include <phonon/MediaController>
+#include <phonon/MediaObject>
 #include <phonon/MediaObjectInterface>
 
 #define ABOUT_TO_FINISH 2000
+#define FADE_INTERVAL 20
+#define TRANSITION_RETRY 100
 #define TO_MSEC 1000.0F
 #define BASE10 10
+#define SEEK_INTERVAL 50
+#define SEEK_SETTLE 200
+#define SEEK_FRAME_TOLERANCE 100
 
 export module phonon_native:mediaobject;
 
+import :audiotap;
+import :chapterreader;
+import :keyframeindex;
+import :loadstatistics;
+import :loudnessscanner;
+import :mediainfocache;
+import :playbackstatistics;
+import :playerpool;
+import :prefetchqueue;
+import :readaheaddevice;
+import :sinknode;
+import :streamreader;
+import :timeeventscheduler;
+import :transitionfade;
+
 using Qt::Literals::StringLiterals::operator""_L1;
 
 namespace Phonon::Native {
+	/* One line per load with the time of each phase, enabled with
+	 * QT_LOGGING_RULES="phonon.native.load.info=true" */
+	Q_LOGGING_CATEGORY(loadLog, "phonon.native.load", QtWarningMsg)
+	/* Seek latencies and transition gaps, enabled with
+	 * QT_LOGGING_RULES="phonon.native.playback.debug=true" */
+	Q_LOGGING_CATEGORY(playbackLog, "phonon.native.playback", QtWarningMsg)
+
 	class Backend;
 
 	class MediaObject final:
@@ -31,58 +73,74 @@ namespace Phonon::Native {
 		public AddonInterface {
 		Q_OBJECT
 		Q_INTERFACES(Phonon::MediaObjectInterface Phonon::AddonInterface)
+		Q_PROPERTY(qint64 transitionGap READ transitionGap)
+		Q_PROPERTY(qint64 seekLatency READ seekLatency)
+		Q_PROPERTY(QVariantMap loadLatency READ loadLatency)
 
 	  public:
-		explicit MediaObject(QObject* parent):
+		/* Coalesces seeks and lands on keyframes first while scrubbing,
+		 * off unless an application asks for it */
+		static inline bool scrubbing{false};
+
+		MediaObject(QObject* parent, QMediaPlayer* player):
 			QObject{parent},
-			m_player{new QMediaPlayer{this}},
-			m_process{new QProcess{this}} {
-			connect(m_player,
-				&QMediaPlayer::positionChanged,
+			m_player{player},
+			m_fadeTimer{new QTimer{this}},
+			m_seekTimer{new QTimer{this}},
+			m_settleTimer{new QTimer{this}},
+			m_scheduler{this,
+				[this](TimeEventScheduler::Event event, qint64 time) {
+					onTimeEvent(event, time);
+				}} {
+			m_player->setParent(this);
+			m_scheduler.setAboutToFinishTime(ABOUT_TO_FINISH);
+			m_fadeTimer->setTimerType(Qt::PreciseTimer);
+			m_fadeTimer->setInterval(FADE_INTERVAL);
+			connect(m_fadeTimer,
+				&QTimer::timeout,
 				this,
-				&MediaObject::timeChanged,
+				&MediaObject::updateCrossfade,
 				Qt::AutoConnection);
-			connect(m_player,
-				&QMediaPlayer::hasVideoChanged,
+			m_seekTimer->setSingleShot(true);
+			m_seekTimer->setInterval(SEEK_INTERVAL);
+			connect(m_seekTimer,
+				&QTimer::timeout,
 				this,
-				&MediaObject::hasVideoChanged,
+				&MediaObject::onSeekInterval,
 				Qt::AutoConnection);
-			connect(m_player,
-				&QMediaPlayer::seekableChanged,
+			m_settleTimer->setSingleShot(true);
+			m_settleTimer->setInterval(SEEK_SETTLE);
+			connect(m_settleTimer,
+				&QTimer::timeout,
 				this,
-				&MediaObject::seekableChanged,
-				Qt::AutoConnection);
-			connect(m_player,
-				&QMediaPlayer::mediaStatusChanged,
-				this,
-				&MediaObject::onMediaStatusChanged,
-				Qt::AutoConnection);
-			connect(
-				m_player,
-				&QMediaPlayer::bufferProgressChanged,
-				this,
-				[=, this](float progress) {
-					emit bufferStatus(static_cast<int>(progress * 100.0F));
-				},
-				Qt::AutoConnection);
-			connect(m_player,
-				&QMediaPlayer::durationChanged,
-				this,
-				&MediaObject::totalTimeChanged,
-				Qt::AutoConnection);
-			connect(m_player,
-				&QMediaPlayer::metaDataChanged,
-				this,
-				&MediaObject::onMetadataChanged,
-				Qt::AutoConnection);
-			connect(m_player,
-				&QMediaPlayer::tracksChanged,
-				this,
-				&MediaObject::availableSubtitlesChanged,
+				&MediaObject::onSeekSettled,
 				Qt::AutoConnection);
+			connectPlayer(m_player);
 		}
 
-		~MediaObject() final = default;
+		~MediaObject() final {
+			m_fadeTimer->stop();
+			if(PrefetchQueue::self) {
+				PrefetchQueue::self->forget(this);
+			}
+			qDeleteAll(m_transitions);
+			if(m_sourceDevice) {
+				releaseSourceDevice(
+					m_player, std::exchange(m_sourceDevice, nullptr));
+			}
+			if(m_outgoingDevice) {
+				releaseSourceDevice(
+					m_outgoing, std::exchange(m_outgoingDevice, nullptr));
+			}
+			/* During a crossfade the outgoing player is also the standby */
+			for(auto* player: {m_player,
+					m_standby,
+					m_outgoing != m_standby ? m_outgoing : nullptr}) {
+				if(player) {
+					PlayerPool::instance()->release(player);
+				}
+			}
+		}
 
 		MediaObject(const MediaObject&) = delete;
 		MediaObject(MediaObject&&) = delete;
@@ -90,33 +148,52 @@ namespace Phonon::Native {
 		auto operator=(MediaObject&&) -> MediaObject& = delete;
 
 		auto play() -> void final {
+			markLoadPhase(LoadStatistics::Play);
 			if(m_state == PausedState) {
 				m_player->play();
+				m_scheduler.start(m_player->position());
 				emit stateChanged(PlayingState, m_state);
 				m_state = PlayingState;
 			}
 		}
 
 		auto pause() -> void final {
+			finishCrossfade();
 			if(m_state == BufferingState || m_state == PlayingState) {
 				m_player->pause();
+				m_scheduler.stop(m_player->position());
 				emit stateChanged(PausedState, m_state);
 				m_state = PausedState;
 			}
 		}
 
 		auto stop() -> void final {
-			m_nextSource = {};
+			finishCrossfade();
+			discardNextSource();
+			cancelSeek();
 			m_player->stop();
+			m_scheduler.stop(0);
 			emit stateChanged(StoppedState, m_state);
 			m_state = StoppedState;
 		}
 
 		auto seek(qint64 milliseconds) -> void final {
-			m_player->setPosition(milliseconds);
-			if(milliseconds < m_lastTick) {
-				m_lastTick = milliseconds;
+			m_scheduler.seek(milliseconds);
+			if(!scrubbing) {
+				setPlayerPosition(milliseconds);
+				return;
+			}
+			loadKeyframes();
+			m_seekTarget = milliseconds;
+			m_settleTimer->start();
+			if(m_seekTimer->isActive()) {
+				/* Replaces the target of the seek waiting for the interval */
+				m_seekQueued = true;
+				return;
 			}
+			setPlayerPosition(
+				KeyframeReader::nearest(m_keyframes, milliseconds));
+			m_seekTimer->start();
 		}
 
 		[[nodiscard]]
@@ -126,6 +203,7 @@ namespace Phonon::Native {
 
 		auto setTickInterval(qint32 interval) -> void final {
 			m_tickInterval = interval;
+			m_scheduler.setTickInterval(interval);
 		}
 
 		[[nodiscard]]
@@ -160,7 +238,8 @@ namespace Phonon::Native {
 
 		[[nodiscard]]
 		auto totalTime() const -> qint64 final {
-			return m_player->duration();
+			return m_player->duration() > 0 ? m_player->duration()
+											: m_mediaInfo.duration;
 		}
 
 		[[nodiscard]]
@@ -169,7 +248,12 @@ namespace Phonon::Native {
 		}
 
 		auto setSource(const MediaSource& source) -> void final {
-			QByteArray url;
+			startLoadTimeline();
+			finishCrossfade();
+			if(m_sourceDevice) {
+				releaseSourceDevice(
+					m_player, std::exchange(m_sourceDevice, nullptr));
+			}
 			switch(source.type()) {
 				case MediaSource::Invalid:
 					qDebug() << Q_FUNC_INFO
@@ -178,7 +262,18 @@ namespace Phonon::Native {
 				case MediaSource::LocalFile:
 				case MediaSource::Url:
 					qDebug() << "MediaSource::Url:" << source.url();
-					m_player->setSource(source.url());
+					if(ReadAheadDevice::supports(source.url())) {
+						auto* readAhead{new ReadAheadDevice{source.url(), this}};
+						connect(readAhead,
+							&ReadAheadDevice::bufferStatusChanged,
+							this,
+							&MediaObject::bufferStatus,
+							Qt::AutoConnection);
+						m_sourceDevice = readAhead;
+						m_player->setSourceDevice(readAhead, source.url());
+					} else {
+						m_player->setSource(source.url());
+					}
 					break;
 				case MediaSource::Disc:
 				case MediaSource::AudioVideoCapture:
@@ -189,10 +284,11 @@ namespace Phonon::Native {
 					qDebug() << Q_FUNC_INFO << "MediaSource is empty.";
 					break;
 				case MediaSource::Stream:
+					m_sourceDevice = new StreamReader{source, this};
+					m_player->setSourceDevice(m_sourceDevice, QUrl{});
 					break;
 			}
-			m_mediaSource = source;
-			emit currentSourceChanged(m_mediaSource);
+			loadSourceInfo(source);
 		}
 
 		auto setNextSource(const MediaSource& source) -> void final {
@@ -200,6 +296,640 @@ namespace Phonon::Native {
 				setSource(source);
 			} else {
 				m_nextSource = source;
+				prerollNextSource();
+				prefetchUpcoming();
+			}
+		}
+
+		[[nodiscard]]
+		auto transitionGap() const -> qint64 {
+			return m_transitionGap;
+		}
+
+		[[nodiscard]]
+		auto seekLatency() const -> qint64 {
+			return m_seekLatency;
+		}
+
+		/* Load latency histograms of this media object */
+		[[nodiscard]]
+		auto loadLatency() const -> QVariantMap {
+			return m_loadStatistics.toVariantMap();
+		}
+
+	  private:
+		auto loadSourceInfo(const MediaSource& source) -> void {
+			m_mediaSource = source;
+			emit currentSourceChanged(m_mediaSource);
+			resetChapters();
+			m_mediaInfo = {};
+			m_mediaInfoCached = false;
+			m_tracksRegistered = false;
+			cancelSeek();
+			resetKeyframes();
+			if(source.type() == MediaSource::LocalFile
+				|| source.type() == MediaSource::Url) {
+				auto info{MediaInfoCache::instance()->find(source.url())};
+				setLoudnessGain(info ? LoudnessScanner::gain(*info) : 1.0F);
+				if(info && info->loudnessMeasured) {
+					m_mediaInfo.loudness = info->loudness;
+					m_mediaInfo.truePeak = info->truePeak;
+					m_mediaInfo.loudnessMeasured = true;
+				}
+				if(info && info->chaptersProbed) {
+					m_mediaInfo = *info;
+					m_mediaInfoCached = true;
+					markLoadPhase(LoadStatistics::ChapterProbe);
+					setChapters(m_mediaInfo.chapters);
+					if(!m_mediaInfo.metaData.isEmpty()) {
+						emit metaDataChanged(m_mediaInfo.metaData);
+					}
+				} else {
+					probeChapters(source.url());
+				}
+			} else {
+				setLoudnessGain(1.0F);
+			}
+			prefetchUpcoming();
+		}
+
+		auto setLoudnessGain(float gain) -> void {
+			m_loudnessGain = gain;
+			for(auto* sink: m_sinks) {
+				sink->setGain(SinkNode::LoudnessGain, gain);
+			}
+		}
+
+		auto connectPlayer(QMediaPlayer* player) -> void {
+			connect(
+				player,
+				&QMediaPlayer::videoOutputChanged,
+				this,
+				[=, this]() { watchFirstFrame(); },
+				Qt::AutoConnection);
+			connect(player,
+				&QMediaPlayer::positionChanged,
+				this,
+				&MediaObject::timeChanged,
+				Qt::AutoConnection);
+			connect(player,
+				&QMediaPlayer::hasVideoChanged,
+				this,
+				&MediaObject::hasVideoChanged,
+				Qt::AutoConnection);
+			connect(player,
+				&QMediaPlayer::seekableChanged,
+				this,
+				&MediaObject::seekableChanged,
+				Qt::AutoConnection);
+			connect(player,
+				&QMediaPlayer::mediaStatusChanged,
+				this,
+				&MediaObject::onMediaStatusChanged,
+				Qt::AutoConnection);
+			connect(
+				player,
+				&QMediaPlayer::bufferProgressChanged,
+				this,
+				[=, this](float progress) {
+					/* The read-ahead reports its own fill level */
+					if(!qobject_cast<ReadAheadDevice*>(m_sourceDevice)) {
+						emit bufferStatus(static_cast<int>(progress * 100.0F));
+					}
+				},
+				Qt::AutoConnection);
+			connect(
+				player,
+				&QMediaPlayer::durationChanged,
+				this,
+				[=, this](qint64 duration) {
+					if(duration > 0 && duration != m_mediaInfo.duration) {
+						m_mediaInfo.duration = duration;
+						storeMediaInfo();
+					}
+					m_scheduler.setDuration(duration);
+					if(auto* readAhead{
+						   qobject_cast<ReadAheadDevice*>(m_sourceDevice)}) {
+						readAhead->setDuration(duration);
+					}
+					emit totalTimeChanged(duration);
+				},
+				Qt::AutoConnection);
+			connect(player,
+				&QMediaPlayer::playbackRateChanged,
+				this,
+				[=, this](qreal rate) { m_scheduler.setRate(rate); },
+				Qt::AutoConnection);
+			connect(player,
+				&QMediaPlayer::metaDataChanged,
+				this,
+				&MediaObject::onMetadataChanged,
+				Qt::AutoConnection);
+			connect(player,
+				&QMediaPlayer::tracksChanged,
+				this,
+				&MediaObject::availableSubtitlesChanged,
+				Qt::AutoConnection);
+		}
+
+		/* Opens the next source on the standby player so that it can be
+		 * switched in without waiting for the container to load. */
+		auto prerollNextSource() -> void {
+			if(m_nextSource.type() != MediaSource::LocalFile
+				&& m_nextSource.type() != MediaSource::Url) {
+				return;
+			}
+			if(m_outgoing) {
+				/* The standby player is still fading out */
+				return;
+			}
+			if(!m_standby) {
+				m_standby = PlayerPool::instance()->acquire(this);
+				updateTransitionStages();
+			}
+			if(m_standby->source() != m_nextSource.url()) {
+				m_standby->setSource(m_nextSource.url());
+				m_standby->pause();
+			}
+		}
+
+		/* Probes the next source and the queue of the frontend ahead of
+		 * time. The frontend is the parent of the backend object. */
+		auto prefetchUpcoming() -> void {
+			QList<QUrl> urls;
+			if(m_nextSource.type() == MediaSource::LocalFile) {
+				urls << m_nextSource.url();
+			}
+			if(auto* frontend{qobject_cast<Phonon::MediaObject*>(parent())}) {
+				for(const auto& source: frontend->queue()) {
+					if(source.type() == MediaSource::LocalFile) {
+						urls << source.url();
+					}
+				}
+			}
+			PrefetchQueue::instance()->prefetch(this, urls);
+		}
+
+		auto discardNextSource() -> void {
+			m_nextSource = {};
+			if(m_standby) {
+				m_standby->setSource({});
+			}
+		}
+
+		[[nodiscard]]
+		auto nextSourcePrerolled() const -> bool {
+			if(!m_standby || m_standby->source() != m_nextSource.url()) {
+				return false;
+			}
+			switch(m_standby->mediaStatus()) {
+				case QMediaPlayer::LoadedMedia:
+				case QMediaPlayer::BufferingMedia:
+				case QMediaPlayer::BufferedMedia:
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		/* Called at the end of the current source. Returns false if there is
+		 * nothing to continue with. */
+		auto switchToNextSource() -> bool {
+			if(m_nextSource.type() == MediaSource::Invalid
+				|| m_nextSource.type() == MediaSource::Empty) {
+				return false;
+			}
+			if(m_transitionTime < 0) {
+				QTimer::singleShot(-m_transitionTime,
+					this,
+					[=, this]() { beginTransition(false); });
+			} else {
+				beginTransition(false);
+			}
+			return true;
+		}
+
+		auto beginTransition(bool crossfade) -> void {
+			if(m_nextSource.type() == MediaSource::Invalid
+				|| m_nextSource.type() == MediaSource::Empty) {
+				return;
+			}
+			auto next{m_nextSource};
+			m_nextSource = {};
+			if(!nextSourcePrerolled()) {
+				setSource(next);
+				return;
+			}
+
+			auto* outgoing{m_player};
+			disconnect(outgoing, nullptr, this, nullptr);
+			auto* fadeOut{m_transitions.value(outgoing)};
+			auto* fadeIn{m_transitions.value(m_standby)};
+			if(crossfade && fadeOut && fadeIn) {
+				/* The outgoing chain keeps playing with the settings of
+				 * the output it took over */
+				fadeOut->start(TransitionFade::Out, m_transitionTime);
+				fadeIn->start(TransitionFade::In, m_transitionTime);
+				m_outgoing = outgoing;
+			} else if(fadeIn) {
+				fadeIn->start(TransitionFade::None, 0);
+			}
+			for(auto* sink: m_sinks) {
+				sink->disconnectFromMediaPlayer(outgoing);
+			}
+			auto* device{std::exchange(m_sourceDevice, nullptr)};
+			m_player = m_standby;
+			m_standby = outgoing;
+			connectPlayer(m_player);
+			for(auto* sink: m_sinks) {
+				sink->connectToMediaPlayer(m_player);
+			}
+			if(m_outgoing) {
+				m_outgoingDevice = device;
+				m_fadeTimer->start();
+			} else {
+				outgoing->stop();
+				releaseSourceDevice(outgoing, device);
+			}
+
+			measureTransitionGap();
+			m_player->play();
+			m_scheduler.setDuration(m_player->duration());
+			m_scheduler.setRate(m_player->playbackRate());
+			m_scheduler.start(m_player->position());
+			loadSourceInfo(next);
+			registerTracks();
+			emit availableAudioChannelsChanged();
+			emit availableSubtitlesChanged();
+			emit totalTimeChanged(m_player->duration());
+			emit hasVideoChanged(m_player->hasVideo());
+			emit seekableChanged(m_player->isSeekable());
+		}
+
+		/* While crossfades are enabled the audio of both players runs
+		 * through a transition stage in their effect chains, from the
+		 * start so that a crossfade does not reroute playing audio. */
+		auto updateTransitionStages() -> void {
+			for(auto* player: {m_player, m_standby}) {
+				if(!player || player == m_outgoing) {
+					continue;
+				}
+				if(m_transitionTime > 0 && !m_transitions.contains(player)) {
+					auto* stage{new TransitionFade{}};
+					stage->attach(player);
+					m_transitions.insert(player, stage);
+				} else if(m_transitionTime <= 0) {
+					delete m_transitions.take(player);
+				}
+			}
+		}
+
+		/* The gains are applied per frame on the audio threads, this only
+		 * stops the outgoing player once it faded to silence */
+		auto updateCrossfade() -> void {
+			if(m_outgoing && m_transitions.value(m_outgoing)->finished()) {
+				finishCrossfade();
+			}
+		}
+
+		auto finishCrossfade() -> void {
+			if(!m_outgoing) {
+				return;
+			}
+			m_fadeTimer->stop();
+			m_outgoing->stop();
+			m_outgoing->setAudioOutput(nullptr);
+			releaseSourceDevice(
+				m_outgoing, std::exchange(m_outgoingDevice, nullptr));
+			m_transitions.value(m_outgoing)->start(TransitionFade::None, 0);
+			m_outgoing = nullptr;
+			updateTransitionStages();
+			prerollNextSource();
+		}
+
+		/* Detaches the player from its source. Pending reads on the device
+		 * are failed first since the player waits for its demuxer. */
+		auto releaseSourceDevice(QMediaPlayer* player, QIODevice* device)
+			-> void {
+			if(auto* stream{qobject_cast<StreamReader*>(device)}) {
+				stream->abort();
+			} else if(auto* readAhead{
+						  qobject_cast<ReadAheadDevice*>(device)}) {
+				readAhead->abort();
+			}
+			player->setSource({});
+			if(device) {
+				disconnect(device, nullptr, this, nullptr);
+				device->deleteLater();
+			}
+		}
+
+		auto onTimeEvent(TimeEventScheduler::Event event, qint64 time)
+			-> void {
+			switch(event) {
+				case TimeEventScheduler::Tick:
+					emit tick(time);
+					break;
+				case TimeEventScheduler::PrefinishMark:
+					emit prefinishMarkReached(
+						static_cast<qint32>(totalTime() - time));
+					break;
+				case TimeEventScheduler::AboutToFinish:
+					emit aboutToFinish();
+					prerollNextSource();
+					break;
+				case TimeEventScheduler::Transition:
+					if(m_transitionTime <= 0 || m_outgoing) {
+						break;
+					}
+					if(nextSourcePrerolled()) {
+						beginTransition(true);
+					} else if(time + TRANSITION_RETRY < totalTime()) {
+						m_scheduler.schedule(TimeEventScheduler::Transition,
+							time + TRANSITION_RETRY);
+					}
+					break;
+				case TimeEventScheduler::Chapter:
+					{
+						auto chapter{m_scheduler.chapterAt(time)};
+						if(chapter != m_currentChapter) {
+							m_currentChapter = chapter;
+							emit chapterChanged(m_currentChapter);
+						}
+					}
+					break;
+			}
+		}
+
+		/* Seeks */
+
+		auto setPlayerPosition(qint64 position) -> void {
+			m_seekPosition = position;
+			m_seekClock.start();
+			watchSeekFrame();
+			m_seeking = true;
+			m_player->setPosition(position);
+			m_seeking = false;
+		}
+
+		auto onSeekInterval() -> void {
+			if(m_seekQueued) {
+				m_seekQueued = false;
+				setPlayerPosition(
+					KeyframeReader::nearest(m_keyframes, m_seekTarget));
+				m_seekTimer->start();
+			}
+		}
+
+		/* Second stage, refines the keyframe to the exact target */
+		auto onSeekSettled() -> void {
+			m_seekTimer->stop();
+			m_seekQueued = false;
+			if(m_seekTarget >= 0 && m_seekPosition != m_seekTarget) {
+				setPlayerPosition(m_seekTarget);
+			}
+			m_seekTarget = -1;
+		}
+
+		auto cancelSeek() -> void {
+			m_seekTimer->stop();
+			m_settleTimer->stop();
+			m_seekQueued = false;
+			m_seekTarget = -1;
+			m_seekClock.invalidate();
+			disconnect(m_seekFrameConnection);
+			m_seekFrameWatched = false;
+		}
+
+		auto resetKeyframes() -> void {
+			if(m_keyframeReader) {
+				disconnect(m_keyframeReader, nullptr, this, nullptr);
+				m_keyframeReader->deleteLater();
+				m_keyframeReader = nullptr;
+			}
+			m_keyframes.clear();
+			m_keyframesRequested = false;
+		}
+
+		/* Video seeks are measured up to the first frame at the seek
+		 * position reaching the video sink, frames still in flight from
+		 * before the seek are skipped */
+		auto watchSeekFrame() -> void {
+			disconnect(m_seekFrameConnection);
+			auto* sink{m_player->videoSink()};
+			m_seekFrameWatched = sink && m_player->hasVideo();
+			if(!m_seekFrameWatched) {
+				return;
+			}
+			m_seekFrameConnection = connect(
+				sink,
+				&QVideoSink::videoFrameChanged,
+				this,
+				[=, this](const QVideoFrame& frame) {
+					if(frame.startTime() >= 0
+						&& std::abs(frame.startTime() / 1000 - m_seekPosition)
+							> SEEK_FRAME_TOLERANCE) {
+						return;
+					}
+					disconnect(m_seekFrameConnection);
+					m_seekFrameWatched = false;
+					measureSeekLatency();
+				},
+				Qt::AutoConnection);
+		}
+
+		/* Measures the time until the first frame after a seek is shown,
+		 * or the player reports the position for sources without video.
+		 * Reports sent from within setPosition are not counted. */
+		auto measureSeekLatency() -> void {
+			if(m_seeking || m_seekFrameWatched || !m_seekClock.isValid()) {
+				return;
+			}
+			m_seekLatency = m_seekClock.elapsed();
+			PlaybackStatistics::instance()->record(
+				PlaybackStatistics::Seek, m_seekClock.nsecsElapsed() / 1000);
+			m_seekClock.invalidate();
+			qCDebug(playbackLog) << "Seek to" << m_seekPosition << "took"
+								 << m_seekLatency << "ms";
+		}
+
+		/* Builds the keyframe index on the first seek into a file */
+		auto loadKeyframes() -> void {
+			if(m_keyframesRequested || !m_mediaSource.url().isLocalFile()) {
+				return;
+			}
+			m_keyframesRequested = true;
+			auto path{m_mediaSource.url().toLocalFile()};
+			if(auto keyframes{KeyframeIndex::instance()->find(path)}) {
+				m_keyframes = *keyframes;
+				return;
+			}
+			auto* watcher{
+				new QFutureWatcher<std::optional<KeyframeReader::Keyframes>>{
+					this}};
+			m_keyframeReader = watcher;
+			connect(
+				watcher,
+				&QFutureWatcherBase::finished,
+				this,
+				[=, this]() {
+					watcher->deleteLater();
+					if(watcher != m_keyframeReader) {
+						return;
+					}
+					m_keyframeReader = nullptr;
+					auto keyframes{watcher->result()};
+					if(keyframes) {
+						m_keyframes = *keyframes;
+						KeyframeIndex::instance()->insert(path, m_keyframes);
+					}
+				},
+				Qt::AutoConnection);
+			watcher->setFuture(QtConcurrent::run(&KeyframeReader::read, path));
+		}
+
+		/* Load latency */
+
+		auto startLoadTimeline() -> void {
+			m_loadPhases.fill(-1);
+			m_loadClock.start();
+			watchFirstFrame();
+			watchFirstAudio();
+		}
+
+		auto markLoadPhase(LoadStatistics::Phase phase) -> void {
+			if(!m_loadClock.isValid() || m_loadPhases[phase] >= 0) {
+				return;
+			}
+			auto usec{m_loadClock.nsecsElapsed() / 1000};
+			m_loadPhases[phase] = usec;
+			m_loadStatistics.record(phase, usec);
+			LoadStatistics::instance()->record(phase, usec);
+			/* Without video the timeline ends with the first audio if
+			 * that is watched, else with the first position */
+			auto last{m_audioWatched ? LoadStatistics::FirstAudio
+									 : LoadStatistics::FirstPosition};
+			if(phase == LoadStatistics::FirstFrame
+				|| (phase == last && !m_player->hasVideo())) {
+				finishLoadTimeline();
+			}
+		}
+
+		auto finishLoadTimeline() -> void {
+			m_loadClock.invalidate();
+			disconnect(m_frameConnection);
+			disconnect(m_audioConnection);
+			if(!loadLog().isInfoEnabled()) {
+				return;
+			}
+			QString line;
+			for(auto phase{0}; phase < LoadStatistics::PhaseCount; phase++) {
+				if(m_loadPhases[phase] >= 0) {
+					line += " "_L1
+						+ QLatin1String{LoadStatistics::phaseNames[phase]}
+						+ "="_L1
+						+ QString::number(
+							static_cast<double>(m_loadPhases[phase]) / 1000.0,
+							'f',
+							1)
+						+ "ms"_L1;
+				}
+			}
+			qCInfo(loadLog).noquote()
+				<< m_mediaSource.url().toDisplayString() << line;
+		}
+
+		/* The first frame reaching the video sink of the current player */
+		auto watchFirstFrame() -> void {
+			disconnect(m_frameConnection);
+			auto* sink{m_player->videoSink()};
+			if(!sink || !m_loadClock.isValid()) {
+				return;
+			}
+			m_frameConnection = connect(
+				sink,
+				&QVideoSink::videoFrameChanged,
+				this,
+				[=, this]() { markLoadPhase(LoadStatistics::FirstFrame); },
+				Qt::SingleShotConnection);
+		}
+
+		/* The first buffer reaching the audio tap of the current player,
+		 * only if a node has attached one already */
+		auto watchFirstAudio() -> void {
+			disconnect(m_audioConnection);
+			auto* tap{m_player->audioBufferOutput()};
+			m_audioWatched = tap && m_loadClock.isValid();
+			if(!m_audioWatched) {
+				return;
+			}
+			m_audioConnection = connect(
+				tap,
+				&QAudioBufferOutput::audioBufferReceived,
+				this,
+				[=, this]() {
+					QMetaObject::invokeMethod(
+						this,
+						[=, this]() {
+							markLoadPhase(LoadStatistics::FirstAudio);
+						},
+						Qt::QueuedConnection);
+				},
+				static_cast<Qt::ConnectionType>(
+					Qt::DirectConnection | Qt::SingleShotConnection));
+		}
+
+		/* Time from the switch until the incoming player renders its
+		 * first audio, less the media time that audio starts at. Taken
+		 * on the renderer thread when the first buffer arrives, a tap
+		 * attached only for that is detached again. */
+		auto measureTransitionGap() -> void {
+			QElapsedTimer clock;
+			clock.start();
+			QPointer<QMediaPlayer> player{m_player};
+			connect(
+				AudioTap::of(m_player),
+				&QAudioBufferOutput::audioBufferReceived,
+				this,
+				[=, this](const QAudioBuffer& buffer) {
+					auto gap{clock.nsecsElapsed() - buffer.startTime() * 1000};
+					auto rate{buffer.format().sampleRate()};
+					QMetaObject::invokeMethod(
+						this,
+						[=, this]() {
+							recordTransitionGap(gap, rate);
+							/* Unless a node reads the audio as well */
+							if(player) {
+								AudioTap::releaseUnused(player);
+							}
+						},
+						Qt::QueuedConnection);
+				},
+				static_cast<Qt::ConnectionType>(
+					Qt::DirectConnection | Qt::SingleShotConnection));
+		}
+
+		auto recordTransitionGap(qint64 gap, int rate) -> void {
+			m_transitionGap = gap * rate / 1'000'000'000;
+			PlaybackStatistics::instance()->record(
+				PlaybackStatistics::TransitionGap, gap / 1000);
+			qCDebug(playbackLog) << "Transition to" << m_player->source()
+								 << "took" << m_transitionGap << "samples";
+		}
+
+	  public:
+		auto addSink(SinkNode* sink) -> void {
+			m_sinks << sink;
+			sink->setGain(SinkNode::LoudnessGain, m_loudnessGain);
+			sink->connectToMediaPlayer(m_player);
+			if(!m_audioWatched) {
+				watchFirstAudio();
+			}
+		}
+
+		auto removeSink(SinkNode* sink) -> void {
+			if(m_sinks.removeOne(sink)) {
+				sink->disconnectFromMediaPlayer(m_player);
 			}
 		}
 
@@ -210,6 +940,7 @@ namespace Phonon::Native {
 
 		auto setPrefinishMark(qint32 mark) -> void final {
 			m_prefinishMark = mark;
+			m_scheduler.setPrefinishMark(mark);
 		}
 
 		[[nodiscard]]
@@ -219,6 +950,9 @@ namespace Phonon::Native {
 
 		auto setTransitionTime(qint32 time) -> void final {
 			m_transitionTime = time;
+			m_scheduler.setTransitionTime(qMax(0, time));
+			m_scheduler.setAboutToFinishTime(ABOUT_TO_FINISH + qMax(0, time));
+			updateTransitionStages();
 		}
 
 		[[nodiscard]]
@@ -246,9 +980,10 @@ namespace Phonon::Native {
 						case AddonInterface::chapter:
 							return m_currentChapter;
 						case AddonInterface::setChapter:
-							m_player->setPosition(static_cast<qint64>(
+							seek(static_cast<qint64>(
 								m_chapters.at(arguments.first().toInt(nullptr))
-									.first));
+									.first
+								* TO_MSEC));
 							return true;
 					}
 				case AngleInterface:
@@ -325,38 +1060,190 @@ namespace Phonon::Native {
 			return {};
 		}
 
-	  private slots:
+	  private:
+		auto resetChapters() -> void {
+			cancelChapterProbe();
+			m_currentChapter = 0;
+			if(!m_chapters.isEmpty()) {
+				setChapters({});
+			}
+		}
 
-		auto timeChanged(qint64 time) -> void {
-			if(m_state == PlayingState || m_state == BufferingState
-				|| m_state == PausedState) {
-				if(m_tickInterval != 0
-					&& (time + m_tickInterval >= m_lastTick)) {
-					m_lastTick = time;
-					emit tick(time);
-				}
+		auto setChapters(const ChapterReader::Chapters& chapters) -> void {
+			m_chapters = chapters;
+			QList<qint64> starts;
+			starts.reserve(m_chapters.size());
+			for(const auto& chapter: m_chapters) {
+				starts << static_cast<qint64>(chapter.first * TO_MSEC);
 			}
-			if(m_state == PlayingState || m_state == BufferingState) {
-				if(time >= m_player->duration() - m_prefinishMark) {
-					emit prefinishMarkReached(
-						static_cast<qint32>(m_player->duration() - time));
-				}
-				if(m_player->duration() > 0
-					&& time >= m_player->duration() - ABOUT_TO_FINISH) {
-					emit aboutToFinish();
-				}
-				for(auto i{0}; i < m_chapters.size(); i++) {
-					auto start{
-						static_cast<qint64>(m_chapters[i].first * TO_MSEC)};
-					auto end{
-						static_cast<qint64>(m_chapters[i].second * TO_MSEC)};
-					if(i != m_currentChapter && start <= time && time <= end) {
-						m_currentChapter = i;
-						emit chapterChanged(m_currentChapter);
-						break;
+			m_scheduler.setChapters(starts);
+			emit availableChaptersChanged(static_cast<int>(m_chapters.size()));
+		}
+
+		auto probeChapters(const QUrl& url) -> void {
+			if(!url.isLocalFile()) {
+				runFfprobe(url);
+				return;
+			}
+			if(auto chapters{PrefetchQueue::instance()->take(url)}) {
+				onChaptersProbed(*chapters);
+				return;
+			}
+			auto* watcher{
+				new QFutureWatcher<std::optional<ChapterReader::Chapters>>{
+					this}};
+			m_chapterReader = watcher;
+			connect(
+				watcher,
+				&QFutureWatcherBase::finished,
+				this,
+				[=, this]() {
+					watcher->deleteLater();
+					if(watcher != m_chapterReader) {
+						return;
+					}
+					m_chapterReader = nullptr;
+					auto chapters{watcher->result()};
+					if(chapters) {
+						onChaptersProbed(*chapters);
+					} else {
+						runFfprobe(url);
+					}
+				},
+				Qt::AutoConnection);
+			watcher->setFuture(
+				QtConcurrent::run(&ChapterReader::read, url.toLocalFile()));
+		}
+
+		auto runFfprobe(const QUrl& url) -> void {
+			auto* process{new QProcess{this}};
+			m_process = process;
+			connect(
+				process,
+				&QProcess::finished,
+				this,
+				[=, this](int exitCode, QProcess::ExitStatus exitStatus) {
+					if(process != m_process) {
+						return;
+					}
+					m_process = nullptr;
+					process->deleteLater();
+					if(exitStatus == QProcess::NormalExit && exitCode == 0) {
+						onFfprobeFinished(process->readAllStandardOutput());
 					}
+				},
+				Qt::AutoConnection);
+			connect(
+				process,
+				&QProcess::errorOccurred,
+				this,
+				[=, this](QProcess::ProcessError error) {
+					if(error == QProcess::FailedToStart
+						&& process == m_process) {
+						qDebug() << "Chapter probe failed:"
+								 << process->errorString();
+						m_process = nullptr;
+						process->deleteLater();
+					}
+				},
+				Qt::AutoConnection);
+			process->start("ffprobe",
+				QStringList()
+					<< "-i"
+					<< (url.isLocalFile() ? url.toLocalFile() : url.toString())
+					<< "-show_chapters"
+					<< "-print_format"
+					<< "json",
+				QIODeviceBase::ReadOnly);
+		}
+
+		auto cancelChapterProbe() -> void {
+			if(m_chapterReader) {
+				disconnect(m_chapterReader, nullptr, this, nullptr);
+				m_chapterReader->deleteLater();
+				m_chapterReader = nullptr;
+			}
+			if(m_process) {
+				disconnect(m_process, nullptr, this, nullptr);
+				m_process->kill();
+				m_process->deleteLater();
+				m_process = nullptr;
+			}
+		}
+
+		auto onFfprobeFinished(const QByteArray& json) -> void {
+			auto output{QJsonDocument::fromJson(json, nullptr).object()};
+			ChapterReader::Chapters chapters;
+			for(auto chapter: output.value("chapters").toArray()) {
+				chapters << QPair<float, float>{
+					chapter.toObject()["start_time"].toString({}).toFloat(
+						nullptr),
+					chapter.toObject()["end_time"].toString({}).toFloat(
+						nullptr)};
+			}
+			onChaptersProbed(chapters);
+		}
+
+		auto onChaptersProbed(const ChapterReader::Chapters& chapters)
+			-> void {
+			markLoadPhase(LoadStatistics::ChapterProbe);
+			m_mediaInfo.chaptersProbed = true;
+			if(chapters.isEmpty()) {
+				storeMediaInfo();
+				return;
+			}
+			m_mediaInfo.chapters = chapters;
+			storeMediaInfo();
+			setChapters(chapters);
+		}
+
+		auto storeMediaInfo() -> void {
+			if(m_mediaInfo.chaptersProbed && m_tracksRegistered) {
+				MediaInfoCache::instance()->insert(
+					m_mediaSource.url(), m_mediaInfo);
+			}
+		}
+
+		auto registerTracks() -> void {
+			if(!m_mediaInfoCached) {
+				m_mediaInfo.audioTracks.clear();
+				for(const auto& track: m_player->audioTracks()) {
+					m_mediaInfo.audioTracks
+						<< track[QMediaMetaData::Title].toString();
+				}
+				m_mediaInfo.subtitleTracks.clear();
+				for(const auto& track: m_player->subtitleTracks()) {
+					m_mediaInfo.subtitleTracks
+						<< track[QMediaMetaData::Title].toString();
 				}
 			}
+			m_tracksRegistered = true;
+			storeMediaInfo();
+			GlobalAudioChannels::instance()->clearListFor(this);
+			for(auto i{0}; i < m_mediaInfo.audioTracks.size(); i++) {
+				GlobalAudioChannels::instance()->add(
+					this, i, m_mediaInfo.audioTracks[i], "");
+			}
+			GlobalSubtitles::instance()->clearListFor(this);
+			for(auto i{0}; i < m_mediaInfo.subtitleTracks.size(); i++) {
+				auto title{m_mediaInfo.subtitleTracks[i]};
+				GlobalSubtitles::instance()->add(this,
+					i,
+					(title.isEmpty() ? "Subtitle " + QString::number(i, BASE10)
+									 : title),
+					"");
+			}
+			markLoadPhase(LoadStatistics::TrackRegistration);
+		}
+
+	  private slots:
+
+		auto timeChanged(qint64 time) -> void {
+			if(time > 0) {
+				markLoadPhase(LoadStatistics::FirstPosition);
+			}
+			measureSeekLatency();
+			m_scheduler.synchronize(time);
 		}
 
 		auto onMediaStatusChanged(QMediaPlayer::MediaStatus status) -> void {
@@ -367,6 +1254,7 @@ namespace Phonon::Native {
 					break;
 				case QMediaPlayer::LoadedMedia:
 					{
+						markLoadPhase(LoadStatistics::Loaded);
 						if(m_state == PlayingState) {
 							return;
 						}
@@ -375,60 +1263,12 @@ namespace Phonon::Native {
 						emit availableTitlesChanged(1);
 						emit angleChanged(0);
 						emit availableAnglesChanged(1);
-						GlobalAudioChannels::instance()->clearListFor(this);
-						auto tracks{m_player->audioTracks()};
-						for(auto i{0}; i < tracks.size(); i++) {
-							auto title{tracks[i][QMediaMetaData::Title]};
-							GlobalAudioChannels::instance()->add(this,
-								i,
-
-								title.toString(),
-								"");
-						}
-						GlobalSubtitles::instance()->clearListFor(this);
-						auto subtitles{m_player->subtitleTracks()};
-						for(auto i{0}; i < subtitles.size(); i++) {
-							auto title{subtitles[i][QMediaMetaData::Title]};
-							GlobalSubtitles::instance()->add(this,
-								i,
-								(title.toString().isEmpty()
-										? "Subtitle "
-											  + QString::number(i, BASE10)
-										: title.toString()),
-								"");
-						}
-						m_process->start("ffprobe",
-							QStringList()
-								<< "-i" << m_player->source().toLocalFile()
-								<< "-show_chapters"
-								<< "-print_format"
-								<< "json",
-							QIODeviceBase::ReadWrite);
-						if(m_process->waitForFinished(-1)) {
-							auto output{QJsonDocument::fromJson(
-								m_process->readAllStandardOutput(), nullptr)
-											.object()};
-							if(output.contains("chapters")) {
-								m_chapters.clear();
-								for(auto chapter:
-									output.value("chapters").toArray()) {
-									m_chapters << QPair<float, float>{
-										chapter.toObject()["start_time"]
-											.toString({})
-											.toFloat(nullptr),
-										chapter.toObject()["end_time"]
-											.toString({})
-											.toFloat(nullptr)};
-								}
-								emit availableChaptersChanged(
-									static_cast<int>(m_chapters.size()));
-							}
-						}
-						m_lastTick = 0;
+						registerTracks();
 						newState = PausedState;
 						break;
 					}
 				case QMediaPlayer::LoadingMedia:
+					markLoadPhase(LoadStatistics::Loading);
 					newState = LoadingState;
 					break;
 				case QMediaPlayer::StalledMedia:
@@ -443,9 +1283,11 @@ namespace Phonon::Native {
 					}
 					break;
 				case QMediaPlayer::EndOfMedia:
+					if(switchToNextSource()) {
+						return;
+					}
 					emit finished();
 					newState = StoppedState;
-					m_lastTick = 0;
 					break;
 				case QMediaPlayer::InvalidMedia:
 					newState = ErrorState;
@@ -453,6 +1295,11 @@ namespace Phonon::Native {
 			}
 			emit stateChanged(newState, m_state);
 			m_state = newState;
+			if(m_state == PlayingState) {
+				m_scheduler.start(m_player->position());
+			} else {
+				m_scheduler.stop(m_player->position());
+			}
 			if(status == QMediaPlayer::LoadedMedia) {
 				play();
 			}
@@ -474,6 +1321,10 @@ namespace Phonon::Native {
 					metadata[QMediaMetaData::Copyright].toString()},
 				{"URL"_L1, metadata[QMediaMetaData::Url].toString()}};
 
+			if(metaDataMap != m_mediaInfo.metaData) {
+				m_mediaInfo.metaData = metaDataMap;
+				storeMediaInfo();
+			}
 			emit metaDataChanged(metaDataMap);
 		}
 
@@ -500,17 +1351,49 @@ namespace Phonon::Native {
 
 	  private:
 		QMediaPlayer* m_player{};
+		QMediaPlayer* m_standby{};
+		QIODevice* m_sourceDevice{};
+		QMediaPlayer* m_outgoing{};
+		QIODevice* m_outgoingDevice{};
+		QTimer* m_fadeTimer{};
+		QTimer* m_seekTimer{};
+		QTimer* m_settleTimer{};
+		TimeEventScheduler m_scheduler;
+		QList<SinkNode*> m_sinks;
+		QElapsedTimer m_seekClock;
+		qint64 m_seekTarget{-1};
+		qint64 m_seekPosition{-1};
+		qint64 m_seekLatency{};
+		bool m_seekQueued{};
+		bool m_seeking{};
+		QFutureWatcherBase* m_keyframeReader{};
+		KeyframeReader::Keyframes m_keyframes;
+		bool m_keyframesRequested{};
+		QElapsedTimer m_loadClock;
+		std::array<qint64, LoadStatistics::PhaseCount> m_loadPhases{};
+		LoadStatistics m_loadStatistics;
+		QMetaObject::Connection m_frameConnection;
+		QMetaObject::Connection m_audioConnection;
+		bool m_audioWatched{};
+		QMetaObject::Connection m_seekFrameConnection;
+		bool m_seekFrameWatched{};
+		QHash<QMediaPlayer*, TransitionFade*> m_transitions;
+		qint64 m_transitionGap{};
+		float m_loudnessGain{1.0F};
 		QProcess* m_process{};
+		QFutureWatcherBase* m_chapterReader{};
 		MediaSource m_nextSource;
 		MediaSource m_mediaSource;
 		Phonon::State m_state{};
 		qint32 m_prefinishMark{};
 		qint32 m_tickInterval{};
 		qint32 m_transitionTime{};
-		qint64 m_lastTick{};
 		QList<QPair<float, float>> m_chapters;
 		int m_currentChapter{};
 		int m_angle{};
+		MediaInfo m_mediaInfo;
+		bool m_mediaInfoCached{};
+		bool m_tracksRegistered{};
 		friend Backend;
 	};
 } // namespace Phonon::Native
@@ -0,0 +1,70 @@
+module;
+
+#include <QVariantMap>
+#include <array>
+
+export module phonon_native:playbackstatistics;
+
+import :loadstatistics;
+
+export namespace Phonon::Native {
+	/* Latency of the recurring operations of all media objects: seeks, gapless
+	 * transitions, the backend work per tick without the slots connected to
+	 * the signal and the processing time and added latency of each block run
+	 * through an effect chain. */
+	class PlaybackStatistics final {
+	  public:
+		enum Metric {
+			Seek,
+			TransitionGap,
+			Tick,
+			EffectProcessing,
+			EffectLatency,
+			MetricCount
+		};
+
+		static constexpr std::array<const char*, MetricCount> metricNames{
+			"seek",
+			"transitionGap",
+			"tick",
+			"effectProcessing",
+			"effectLatency"};
+
+		PlaybackStatistics() = default;
+		~PlaybackStatistics() = default;
+		PlaybackStatistics(const PlaybackStatistics&) = delete;
+		PlaybackStatistics(PlaybackStatistics&&) = delete;
+		auto operator=(const PlaybackStatistics&) -> PlaybackStatistics& =
+			delete;
+		auto operator=(PlaybackStatistics&&) -> PlaybackStatistics& = delete;
+
+		static inline PlaybackStatistics* self{};
+
+		static auto instance() -> PlaybackStatistics* {
+			if(!self) {
+				self = new PlaybackStatistics{};
+			}
+			return self;
+		}
+
+		auto record(Metric metric, qint64 usec) -> void {
+			m_histograms[metric].record(usec);
+		}
+
+		/* {metric: {count, p50, p95, p99}} */
+		[[nodiscard]]
+		auto toVariantMap() const -> QVariantMap {
+			QVariantMap metrics;
+			for(auto metric{0}; metric < MetricCount; metric++) {
+				if(m_histograms[metric].count() > 0) {
+					metrics.insert(QLatin1String{metricNames[metric]},
+						m_histograms[metric].toVariantMap());
+				}
+			}
+			return metrics;
+		}
+
+	  private:
+		std::array<LatencyHistogram, MetricCount> m_histograms{};
+	};
+} // namespace Phonon::Native
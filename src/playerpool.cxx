@@ -0,0 +1,104 @@
+module;
+
+#include <QList>
+#include <QMediaPlayer>
+
+#define POOL_CAPACITY 2
+
+export module phonon_native:playerpool;
+
+import :audiotap;
+
+export namespace Phonon::Native {
+	/* Idle players that already went through the setup of the multimedia
+	 * backend, handed out to new media objects. Only used from the GUI
+	 * thread. */
+	class PlayerPool final {
+	  public:
+		PlayerPool() = default;
+
+		~PlayerPool() {
+			qDeleteAll(m_players);
+		}
+
+		PlayerPool(const PlayerPool&) = delete;
+		PlayerPool(PlayerPool&&) = delete;
+		auto operator=(const PlayerPool&) -> PlayerPool& = delete;
+		auto operator=(PlayerPool&&) -> PlayerPool& = delete;
+
+		static inline PlayerPool* self{};
+
+		static auto instance() -> PlayerPool* {
+			if(!self) {
+				self = new PlayerPool{};
+			}
+			return self;
+		}
+
+		[[nodiscard]]
+		auto acquire(QObject* parent) -> QMediaPlayer* {
+			if(m_players.isEmpty()) {
+				m_misses++;
+				return new QMediaPlayer{parent};
+			}
+			m_hits++;
+			auto* player{m_players.takeLast()};
+			player->setParent(parent);
+			return player;
+		}
+
+		/* Resets the player to its initial state and keeps it for the next
+		 * media object if there is room. */
+		auto release(QMediaPlayer* player) -> void {
+			player->disconnect();
+			player->stop();
+			player->setAudioOutput(nullptr);
+			player->setVideoOutput(nullptr);
+			AudioTap::release(player);
+			player->setSource({});
+			player->setPlaybackRate(1.0);
+			player->setLoops(1);
+			player->setParent(nullptr);
+			if(m_players.size() < m_capacity) {
+				m_players << player;
+			} else {
+				delete player;
+			}
+		}
+
+		/* Creates players until the pool is full */
+		auto warm() -> void {
+			while(m_players.size() < m_capacity) {
+				m_players << new QMediaPlayer{};
+			}
+		}
+
+		[[nodiscard]]
+		auto hits() const -> qint64 {
+			return m_hits;
+		}
+
+		[[nodiscard]]
+		auto misses() const -> qint64 {
+			return m_misses;
+		}
+
+		[[nodiscard]]
+		auto capacity() const -> int {
+			return m_capacity;
+		}
+
+		auto setCapacity(int capacity) -> void {
+			m_capacity = qMax(0, capacity);
+			while(m_players.size() > m_capacity) {
+				delete m_players.takeLast();
+			}
+		}
+
+	  private:
+		QList<QMediaPlayer*> m_players;
+		qint64 m_hits{};
+		qint64 m_misses{};
+		int m_capacity{POOL_CAPACITY};
+	};
+} // namespace Phonon::Native
@@ -0,0 +1,192 @@
+module;
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+#include <QUrl>
+#include <optional>
+#include <utility>
+
+#define PREFETCH_DEPTH 3
+#define PREFETCH_THREADS 2
+#define PREFETCH_SIZE (4 << 20)
+#define PREFETCH_BLOCK (256 << 10)
+
+export module phonon_native:prefetchqueue;
+
+import :chapterreader;
+
+export namespace Phonon::Native {
+	/* Probes the upcoming local files of a playlist on a thread pool: the
+	 * chapters are read from the container and the head of each file is
+	 * read once so that opening it later is served from the page cache.
+	 * Each media object has a lookahead of its own. */
+	class PrefetchQueue final {
+	  public:
+		PrefetchQueue() {
+			m_pool.setMaxThreadCount(PREFETCH_THREADS);
+		}
+
+		~PrefetchQueue() {
+			{
+				QMutexLocker locker{&m_mutex};
+				m_pending.clear();
+			}
+			m_pool.clear();
+			m_pool.waitForDone();
+		}
+
+		PrefetchQueue(const PrefetchQueue&) = delete;
+		PrefetchQueue(PrefetchQueue&&) = delete;
+		auto operator=(const PrefetchQueue&) -> PrefetchQueue& = delete;
+		auto operator=(PrefetchQueue&&) -> PrefetchQueue& = delete;
+
+		static inline PrefetchQueue* self{};
+
+		static auto instance() -> PrefetchQueue* {
+			if(!self) {
+				self = new PrefetchQueue{};
+			}
+			return self;
+		}
+
+		/* Replaces the lookahead of the owner with the first entries of
+		 * the list. Results of sources that are no longer upcoming for any
+		 * owner are dropped. */
+		auto prefetch(const QObject* owner, const QList<QUrl>& urls) -> void {
+			QList<QString> paths;
+			for(const auto& url: urls) {
+				if(paths.size() >= m_depth) {
+					break;
+				}
+				if(url.isLocalFile() && !paths.contains(url.toLocalFile())) {
+					paths << url.toLocalFile();
+				}
+			}
+
+			QMutexLocker locker{&m_mutex};
+			m_lookahead.insert(owner, paths);
+			update();
+		}
+
+		/* Drops the lookahead of an owner that goes away */
+		auto forget(const QObject* owner) -> void {
+			QMutexLocker locker{&m_mutex};
+			if(m_lookahead.remove(owner)) {
+				update();
+			}
+		}
+
+		/* Returns the chapters of a prefetched file and forgets them */
+		[[nodiscard]]
+		auto take(const QUrl& url) -> std::optional<ChapterReader::Chapters> {
+			if(!url.isLocalFile()) {
+				return std::nullopt;
+			}
+			QMutexLocker locker{&m_mutex};
+			auto entry{m_chapters.find(url.toLocalFile())};
+			if(entry == m_chapters.end()) {
+				return std::nullopt;
+			}
+			auto chapters{*entry};
+			m_chapters.erase(entry);
+			return chapters;
+		}
+
+		[[nodiscard]]
+		auto depth() const -> int {
+			return m_depth;
+		}
+
+		auto setDepth(int depth) -> void {
+			m_depth = qMax(0, depth);
+		}
+
+		[[nodiscard]]
+		auto threads() const -> int {
+			return m_pool.maxThreadCount();
+		}
+
+		auto setThreads(int threads) -> void {
+			m_pool.setMaxThreadCount(qMax(1, threads));
+		}
+
+		/* Bytes read from the head of each upcoming file */
+		[[nodiscard]]
+		auto size() const -> qint64 {
+			return m_size;
+		}
+
+		auto setSize(qint64 size) -> void {
+			m_size = qMax<qint64>(0, size);
+		}
+
+	  private:
+		/* Probes the files upcoming for any owner, called locked */
+		auto update() -> void {
+			QSet<QString> paths;
+			for(const auto& lookahead: std::as_const(m_lookahead)) {
+				for(const auto& path: lookahead) {
+					paths.insert(path);
+				}
+			}
+			for(auto entry{m_chapters.begin()}; entry != m_chapters.end();) {
+				entry = paths.contains(entry.key()) ? std::next(entry)
+													: m_chapters.erase(entry);
+			}
+			for(auto path{m_pending.begin()}; path != m_pending.end();) {
+				path = paths.contains(*path) ? std::next(path)
+											 : m_pending.erase(path);
+			}
+			for(const auto& path: std::as_const(paths)) {
+				if(m_chapters.contains(path) || m_pending.contains(path)) {
+					continue;
+				}
+				m_pending.insert(path);
+				auto size{m_size};
+				m_pool.start([=, this]() { probe(path, size); });
+			}
+		}
+
+		/* Runs on the pool */
+		auto probe(const QString& path, qint64 size) -> void {
+			if(!isPending(path)) {
+				return;
+			}
+			QFile file{path};
+			if(file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+				QByteArray block{PREFETCH_BLOCK, Qt::Uninitialized};
+				for(qint64 read{0}; read < size && isPending(path);) {
+					auto length{file.read(
+						block.data(), qMin<qint64>(block.size(), size - read))};
+					if(length <= 0) {
+						break;
+					}
+					read += length;
+				}
+			}
+			auto chapters{ChapterReader::read(path)};
+			QMutexLocker locker{&m_mutex};
+			if(m_pending.remove(path) && chapters) {
+				m_chapters.insert(path, *chapters);
+			}
+		}
+
+		auto isPending(const QString& path) -> bool {
+			QMutexLocker locker{&m_mutex};
+			return m_pending.contains(path);
+		}
+
+		QThreadPool m_pool;
+		QMutex m_mutex;
+		QSet<QString> m_pending;
+		QHash<QString, ChapterReader::Chapters> m_chapters;
+		QHash<const QObject*, QList<QString>> m_lookahead;
+		qint64 m_size{PREFETCH_SIZE};
+		int m_depth{PREFETCH_DEPTH};
+	};
+} // namespace Phonon::Native
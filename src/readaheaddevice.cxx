@@ -0,0 +1,590 @@
+module;
+
+#include <QFile>
+#include <QIODevice>
+#include <QList>
+#include <QMutex>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QThread>
+#include <QUrl>
+#include <QWaitCondition>
+#include <QtCore/qtmochelpers.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <utility>
+
+#define READ_AHEAD_BLOCK (1024 * 1024)
+#define READ_AHEAD_HTTP_BUFFER (4 * READ_AHEAD_BLOCK)
+#define READ_AHEAD_BYTE_RATE (512 * 1024)
+#define READ_AHEAD_MIN_WINDOW (256 * 1024)
+#define READ_AHEAD_MAX_WINDOW (256 * 1024 * 1024)
+#define PERCENT 100
+
+export module phonon_native:readaheaddevice;
+
+using Qt::Literals::StringLiterals::operator""_L1;
+using Qt::Literals::StringLiterals::operator""_ba;
+
+export namespace Phonon::Native {
+	/* Window of prefetched bytes following the read position. Filled by the
+	 * I/O thread and drained by the demuxer of the player. Every restart of
+	 * the prefetch at another offset starts a new generation, data of older
+	 * generations is dropped. */
+	class ReadAheadBuffer final {
+	  public:
+		ReadAheadBuffer() = default;
+		~ReadAheadBuffer() = default;
+		ReadAheadBuffer(const ReadAheadBuffer&) = delete;
+		ReadAheadBuffer(ReadAheadBuffer&&) = delete;
+		auto operator=(const ReadAheadBuffer&) -> ReadAheadBuffer& = delete;
+		auto operator=(ReadAheadBuffer&&) -> ReadAheadBuffer& = delete;
+
+		/* Producer side */
+
+		/* Returns the number of bytes that still fit into the window or -1
+		 * if the generation is outdated. */
+		[[nodiscard]]
+		auto wanted(quint64 generation) -> qint64 {
+			QMutexLocker locker{&m_mutex};
+			if(m_aborted || generation != m_generation) {
+				return -1;
+			}
+			auto room{m_window - m_buffered};
+			if(room <= 0) {
+				m_fetching = false;
+			}
+			return room;
+		}
+
+		auto append(quint64 generation, const QByteArray& data) -> void {
+			QMutexLocker locker{&m_mutex};
+			if(generation != m_generation || data.isEmpty()) {
+				return;
+			}
+			m_blocks << data;
+			m_buffered += data.size();
+			m_dataArrived.wakeAll();
+		}
+
+		auto finish(quint64 generation, bool failed) -> void {
+			QMutexLocker locker{&m_mutex};
+			if(generation != m_generation) {
+				return;
+			}
+			m_endOfData = true;
+			m_failed = failed;
+			m_fetching = false;
+			m_dataArrived.wakeAll();
+		}
+
+		auto setSize(qint64 size) -> void {
+			m_size = size;
+		}
+
+		auto setSeekable(bool seekable) -> void {
+			m_seekable = seekable;
+		}
+
+		/* Consumer side */
+
+		[[nodiscard]]
+		auto read(char* data, qint64 maxSize) -> qint64 {
+			QMutexLocker locker{&m_mutex};
+			while(m_blocks.isEmpty() && !m_endOfData && !m_aborted) {
+				m_dataArrived.wait(&m_mutex);
+			}
+			if(m_aborted || (m_blocks.isEmpty() && m_failed)) {
+				return -1;
+			}
+			qint64 copied{0};
+			while(copied < maxSize && !m_blocks.isEmpty()) {
+				const auto& block{m_blocks.first()};
+				auto length{qMin<qint64>(
+					maxSize - copied, block.size() - m_blockOffset)};
+				std::memcpy(data + copied, block.constData() + m_blockOffset,
+					static_cast<std::size_t>(length));
+				copied += length;
+				consume(length);
+			}
+			return copied;
+		}
+
+		/* Moves the read position forward if the target is already inside
+		 * of the window. */
+		[[nodiscard]]
+		auto skip(qint64 position) -> bool {
+			QMutexLocker locker{&m_mutex};
+			if(position < m_position || position > m_position + m_buffered) {
+				return false;
+			}
+			consume(position - m_position);
+			return true;
+		}
+
+		/* Drops the window and returns the generation to fetch the data at
+		 * the new position with. */
+		[[nodiscard]]
+		auto restart(qint64 position) -> quint64 {
+			QMutexLocker locker{&m_mutex};
+			m_blocks.clear();
+			m_blockOffset = 0;
+			m_position = position;
+			m_buffered = 0;
+			m_endOfData = false;
+			m_failed = false;
+			m_fetching = true;
+			return ++m_generation;
+		}
+
+		/* Returns true if the producer went idle and should continue now
+		 * that the window is half empty. */
+		[[nodiscard]]
+		auto needsResume() -> bool {
+			QMutexLocker locker{&m_mutex};
+			if(m_fetching || m_endOfData || m_aborted
+				|| m_buffered >= m_window / 2) {
+				return false;
+			}
+			m_fetching = true;
+			return true;
+		}
+
+		auto abort() -> void {
+			QMutexLocker locker{&m_mutex};
+			m_aborted = true;
+			m_dataArrived.wakeAll();
+		}
+
+		auto setWindow(qint64 window) -> void {
+			QMutexLocker locker{&m_mutex};
+			m_window = window;
+		}
+
+		/* Fill level of the window in percent */
+		[[nodiscard]]
+		auto fill() const -> int {
+			QMutexLocker locker{&m_mutex};
+			if(m_endOfData) {
+				return PERCENT;
+			}
+			if(m_window <= 0) {
+				return 0;
+			}
+			return static_cast<int>(
+				qMin<qint64>(PERCENT, m_buffered * PERCENT / m_window));
+		}
+
+		[[nodiscard]]
+		auto buffered() const -> qint64 {
+			QMutexLocker locker{&m_mutex};
+			return m_buffered;
+		}
+
+		[[nodiscard]]
+		auto atEnd() const -> bool {
+			QMutexLocker locker{&m_mutex};
+			return m_endOfData && m_buffered == 0;
+		}
+
+		[[nodiscard]]
+		auto size() const -> qint64 {
+			return m_size;
+		}
+
+		[[nodiscard]]
+		auto isSeekable() const -> bool {
+			return m_seekable;
+		}
+
+	  private:
+		auto consume(qint64 length) -> void {
+			m_position += length;
+			m_buffered -= length;
+			while(length > 0) {
+				auto available{m_blocks.first().size() - m_blockOffset};
+				if(length < available) {
+					m_blockOffset += length;
+					return;
+				}
+				length -= available;
+				m_blocks.removeFirst();
+				m_blockOffset = 0;
+			}
+		}
+
+		mutable QMutex m_mutex;
+		QWaitCondition m_dataArrived;
+		QList<QByteArray> m_blocks;
+		qsizetype m_blockOffset{};
+		qint64 m_position{};
+		qint64 m_buffered{};
+		qint64 m_window{};
+		quint64 m_generation{};
+		bool m_endOfData{};
+		bool m_failed{};
+		bool m_fetching{true};
+		bool m_aborted{};
+		std::atomic<qint64> m_size{-1};
+		std::atomic<bool> m_seekable{};
+	};
+
+	/* Fills a ReadAheadBuffer, lives in the I/O thread */
+	class ReadAheadWorker: public QObject {
+		Q_OBJECT
+
+	  public:
+		explicit ReadAheadWorker(ReadAheadBuffer* buffer): m_buffer{buffer} {}
+		~ReadAheadWorker() override = default;
+		ReadAheadWorker(const ReadAheadWorker&) = delete;
+		ReadAheadWorker(ReadAheadWorker&&) = delete;
+		auto operator=(const ReadAheadWorker&) -> ReadAheadWorker& = delete;
+		auto operator=(ReadAheadWorker&&) -> ReadAheadWorker& = delete;
+
+		virtual auto start(qint64 offset, quint64 generation) -> void = 0;
+		virtual auto resume() -> void = 0;
+
+	  signals:
+		auto bufferChanged() -> void;
+
+	  protected:
+		ReadAheadBuffer* m_buffer;
+		quint64 m_generation{};
+	};
+
+	class FileReadAheadWorker final: public ReadAheadWorker {
+	  public:
+		FileReadAheadWorker(ReadAheadBuffer* buffer, const QString& path):
+			ReadAheadWorker{buffer}, m_file{path, this} {
+			if(m_file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+				/* Pipes and character devices are read front to back */
+				if(!m_file.isSequential()) {
+					m_buffer->setSize(m_file.size());
+					m_buffer->setSeekable(true);
+				}
+			} else {
+				qDebug() << "Read-ahead failed to open" << path << ":"
+						 << m_file.errorString();
+			}
+		}
+
+		~FileReadAheadWorker() final = default;
+		FileReadAheadWorker(const FileReadAheadWorker&) = delete;
+		FileReadAheadWorker(FileReadAheadWorker&&) = delete;
+		auto operator=(const FileReadAheadWorker&) -> FileReadAheadWorker& =
+			delete;
+		auto operator=(FileReadAheadWorker&&) -> FileReadAheadWorker& =
+			delete;
+
+		auto start(qint64 offset, quint64 generation) -> void final {
+			m_generation = generation;
+			if(!m_file.isOpen() || !m_file.seek(offset)) {
+				m_buffer->finish(m_generation, true);
+				emit bufferChanged();
+				return;
+			}
+			resume();
+		}
+
+		/* Reads large sequential blocks until the window is full or the
+		 * generation changed because of a seek. */
+		auto resume() -> void final {
+			while(m_buffer->wanted(m_generation) > 0) {
+				auto data{m_file.read(READ_AHEAD_BLOCK)};
+				if(data.isEmpty()) {
+					m_buffer->finish(
+						m_generation, m_file.error() != QFileDevice::NoError);
+					emit bufferChanged();
+					return;
+				}
+				m_buffer->append(m_generation, data);
+				emit bufferChanged();
+			}
+		}
+
+	  private:
+		QFile m_file;
+	};
+
+	class HttpReadAheadWorker final: public ReadAheadWorker {
+	  public:
+		HttpReadAheadWorker(ReadAheadBuffer* buffer, QUrl url):
+			ReadAheadWorker{buffer}, m_url{std::move(url)} {
+			/* Servers without range support are seeked by skipping */
+			m_buffer->setSeekable(true);
+		}
+
+		~HttpReadAheadWorker() final = default;
+		HttpReadAheadWorker(const HttpReadAheadWorker&) = delete;
+		HttpReadAheadWorker(HttpReadAheadWorker&&) = delete;
+		auto operator=(const HttpReadAheadWorker&) -> HttpReadAheadWorker& =
+			delete;
+		auto operator=(HttpReadAheadWorker&&) -> HttpReadAheadWorker& =
+			delete;
+
+		auto start(qint64 offset, quint64 generation) -> void final {
+			if(m_reply) {
+				disconnect(m_reply, nullptr, this, nullptr);
+				m_reply->abort();
+				m_reply->deleteLater();
+			}
+			if(!m_network) {
+				m_network = new QNetworkAccessManager{this};
+			}
+			m_generation = generation;
+			m_offset = offset;
+			m_skip = 0;
+			m_finished = false;
+			QNetworkRequest request{m_url};
+			if(offset > 0) {
+				request.setRawHeader(
+					"Range"_ba, "bytes=" + QByteArray::number(offset) + "-");
+			}
+			m_reply = m_network->get(request);
+			/* Stops reading from the socket while the window is full */
+			m_reply->setReadBufferSize(READ_AHEAD_HTTP_BUFFER);
+			connect(m_reply,
+				&QNetworkReply::metaDataChanged,
+				this,
+				&HttpReadAheadWorker::onMetaDataChanged,
+				Qt::AutoConnection);
+			connect(m_reply,
+				&QNetworkReply::readyRead,
+				this,
+				&HttpReadAheadWorker::resume,
+				Qt::AutoConnection);
+			connect(
+				m_reply,
+				&QNetworkReply::finished,
+				this,
+				[=, this]() {
+					m_finished = true;
+					resume();
+				},
+				Qt::AutoConnection);
+		}
+
+		auto resume() -> void final {
+			if(!m_reply) {
+				return;
+			}
+			while(m_reply->bytesAvailable() > 0) {
+				auto room{m_buffer->wanted(m_generation)};
+				if(room <= 0) {
+					return;
+				}
+				auto data{m_reply->read(qMin<qint64>(
+					m_reply->bytesAvailable(), room + m_skip))};
+				if(m_skip > 0) {
+					/* The server ignored the range request */
+					auto skipped{qMin<qint64>(m_skip, data.size())};
+					data.remove(0, skipped);
+					m_skip -= skipped;
+				}
+				m_buffer->append(m_generation, data);
+				emit bufferChanged();
+			}
+			if(m_finished) {
+				auto error{m_reply->error()};
+				if(error != QNetworkReply::NoError) {
+					qDebug() << "Read-ahead of" << m_url
+							 << "failed:" << m_reply->errorString();
+				}
+				m_buffer->finish(m_generation, error != QNetworkReply::NoError);
+				emit bufferChanged();
+			}
+		}
+
+	  private:
+		auto onMetaDataChanged() -> void {
+			auto status{
+				m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute)
+					.toInt()};
+			if(status == 206) {
+				/* Content-Range: bytes <first>-<last>/<size> */
+				auto range{m_reply->rawHeader("Content-Range"_ba)};
+				auto size{range.mid(range.lastIndexOf('/') + 1).toLongLong()};
+				if(size > 0) {
+					m_buffer->setSize(size);
+				}
+			} else {
+				auto size{
+					m_reply->header(QNetworkRequest::ContentLengthHeader)
+						.toLongLong()};
+				if(size > 0) {
+					m_buffer->setSize(size);
+				}
+				m_skip = m_offset;
+			}
+		}
+
+		QUrl m_url;
+		QNetworkAccessManager* m_network{};
+		QNetworkReply* m_reply{};
+		qint64 m_offset{};
+		qint64 m_skip{};
+		bool m_finished{};
+	};
+
+	/* Reads local files and HTTP resources ahead of the player in a
+	 * dedicated I/O thread. The window is given in seconds of media and
+	 * converted to bytes with the average bitrate once the duration is
+	 * known. */
+	class ReadAheadDevice final: public QIODevice {
+		Q_OBJECT
+
+	  public:
+		/* Seconds of media to prefetch, 0 disables the read-ahead */
+		static inline qint32 windowTime{};
+
+		[[nodiscard]]
+		static auto supports(const QUrl& url) -> bool {
+			return windowTime > 0
+				&& (url.isLocalFile() || url.scheme() == "http"_L1
+					|| url.scheme() == "https"_L1);
+		}
+
+		ReadAheadDevice(const QUrl& url, QObject* parent): QIODevice{parent} {
+			if(url.isLocalFile()) {
+				m_worker = new FileReadAheadWorker{&m_buffer, url.toLocalFile()};
+			} else {
+				m_worker = new HttpReadAheadWorker{&m_buffer, url};
+			}
+			m_buffer.setWindow(qBound<qint64>(READ_AHEAD_MIN_WINDOW,
+				static_cast<qint64>(windowTime) * READ_AHEAD_BYTE_RATE,
+				READ_AHEAD_MAX_WINDOW));
+			connect(
+				m_worker,
+				&ReadAheadWorker::bufferChanged,
+				this,
+				[this]() { updateStatus(); },
+				Qt::DirectConnection);
+			m_worker->moveToThread(&m_thread);
+			m_thread.setObjectName("ReadAhead"_L1);
+			m_thread.start();
+			open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+			QMetaObject::invokeMethod(
+				m_worker,
+				[worker = m_worker]() { worker->start(0, 0); },
+				Qt::QueuedConnection);
+		}
+
+		~ReadAheadDevice() final {
+			abort();
+			m_worker->deleteLater();
+			m_thread.quit();
+			m_thread.wait();
+		}
+
+		ReadAheadDevice(const ReadAheadDevice&) = delete;
+		ReadAheadDevice(ReadAheadDevice&&) = delete;
+		auto operator=(const ReadAheadDevice&) -> ReadAheadDevice& = delete;
+		auto operator=(ReadAheadDevice&&) -> ReadAheadDevice& = delete;
+
+		/* Wakes up and fails a pending read, e.g. before the player lets go
+		 * of the device. */
+		auto abort() -> void {
+			m_buffer.abort();
+		}
+
+		/* Sizes the window by the average bitrate of the source */
+		auto setDuration(qint64 duration) -> void {
+			auto size{m_buffer.size()};
+			if(duration <= 0 || size <= 0) {
+				return;
+			}
+			m_buffer.setWindow(qBound<qint64>(READ_AHEAD_MIN_WINDOW,
+				size * windowTime * 1000 / duration,
+				READ_AHEAD_MAX_WINDOW));
+			resume();
+			updateStatus();
+		}
+
+		[[nodiscard]]
+		auto bufferStatus() const -> int {
+			return m_status;
+		}
+
+		[[nodiscard]]
+		auto isSequential() const -> bool final {
+			return !m_buffer.isSeekable();
+		}
+
+		[[nodiscard]]
+		auto size() const -> qint64 final {
+			auto size{m_buffer.size()};
+			return size >= 0 ? size : QIODevice::size();
+		}
+
+		/* The device is unbuffered, and for seekable devices QIODevice
+		 * would count the bytes up to size() */
+		[[nodiscard]]
+		auto bytesAvailable() const -> qint64 final {
+			return m_buffer.buffered();
+		}
+
+		[[nodiscard]]
+		auto atEnd() const -> bool final {
+			return m_buffer.atEnd();
+		}
+
+		auto seek(qint64 position) -> bool final {
+			if(isSequential()) {
+				return false;
+			}
+			if(!m_buffer.skip(position)) {
+				auto generation{m_buffer.restart(position)};
+				QMetaObject::invokeMethod(
+					m_worker,
+					[=, worker = m_worker]() {
+						worker->start(position, generation);
+					},
+					Qt::QueuedConnection);
+			}
+			resume();
+			updateStatus();
+			return QIODevice::seek(position);
+		}
+
+	  signals:
+		auto bufferStatusChanged(int _t1) -> void;
+
+	  protected:
+		auto readData(char* data, qint64 maxSize) -> qint64 final {
+			auto read{m_buffer.read(data, maxSize)};
+			resume();
+			updateStatus();
+			return read;
+		}
+
+		auto writeData(const char* /*data*/, qint64 /*len*/) -> qint64 final {
+			return -1;
+		}
+
+	  private:
+		auto resume() -> void {
+			if(m_buffer.needsResume()) {
+				QMetaObject::invokeMethod(
+					m_worker,
+					[worker = m_worker]() { worker->resume(); },
+					Qt::QueuedConnection);
+			}
+		}
+
+		auto updateStatus() -> void {
+			auto status{m_buffer.fill()};
+			if(m_status.exchange(status) != status) {
+				emit bufferStatusChanged(status);
+			}
+		}
+
+		ReadAheadBuffer m_buffer;
+		ReadAheadWorker* m_worker{};
+		QThread m_thread;
+		std::atomic<int> m_status{-1};
+	};
+} // namespace Phonon::Native
+
+#include "readaheaddevice.moc"
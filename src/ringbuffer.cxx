@@ -0,0 +1,86 @@
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+export module phonon_native:ringbuffer;
+
+export namespace Phonon::Native {
+	/* Bounded lock-free queue for exactly one producer and one consumer
+	 * thread. */
+	template<typename T>
+	class RingBuffer final {
+	  public:
+		explicit RingBuffer(std::size_t capacity):
+			m_slots(std::bit_ceil(std::max<std::size_t>(capacity, 2))),
+			m_mask{m_slots.size() - 1} {}
+
+		~RingBuffer() = default;
+		RingBuffer(const RingBuffer&) = delete;
+		RingBuffer(RingBuffer&&) = delete;
+		auto operator=(const RingBuffer&) -> RingBuffer& = delete;
+		auto operator=(RingBuffer&&) -> RingBuffer& = delete;
+
+		/* Producer side */
+		[[nodiscard]]
+		auto push(T value) -> bool {
+			auto tail{m_tail.load(std::memory_order_relaxed)};
+			if(tail - m_head.load(std::memory_order_acquire) > m_mask) {
+				return false;
+			}
+			m_slots[tail & m_mask] = std::move(value);
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		/* Consumer side */
+		[[nodiscard]]
+		auto pop() -> std::optional<T> {
+			auto head{m_head.load(std::memory_order_relaxed)};
+			if(head == m_tail.load(std::memory_order_acquire)) {
+				return std::nullopt;
+			}
+			std::optional<T> value{std::move(m_slots[head & m_mask])};
+			m_slots[head & m_mask] = T{};
+			m_head.store(head + 1, std::memory_order_release);
+			return value;
+		}
+
+		/* Consumer side */
+		[[nodiscard]]
+		auto front() -> T* {
+			auto head{m_head.load(std::memory_order_relaxed)};
+			if(head == m_tail.load(std::memory_order_acquire)) {
+				return nullptr;
+			}
+			return &m_slots[head & m_mask];
+		}
+
+		/* Consumer side */
+		auto clear() -> void {
+			while(pop()) {
+			}
+		}
+
+		[[nodiscard]]
+		auto size() const -> std::size_t {
+			return m_tail.load(std::memory_order_acquire)
+				- m_head.load(std::memory_order_acquire);
+		}
+
+		[[nodiscard]]
+		auto capacity() const -> std::size_t {
+			return m_slots.size();
+		}
+
+	  private:
+		std::vector<T> m_slots;
+		std::size_t m_mask;
+		alignas(64) std::atomic<std::size_t> m_head{};
+		alignas(64) std::atomic<std::size_t> m_tail{};
+	};
+} // namespace Phonon::Native
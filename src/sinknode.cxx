@@ -1,5 +1,6 @@
 module;
 
+#include <QList>
 #include <QMediaPlayer>
 
 export module phonon_native:sinknode;
@@ -7,6 +8,11 @@ export module phonon_native:sinknode;
 namespace Phonon::Native {
 	class SinkNode {
 	  public:
+		enum Gain {
+			LoudnessGain,
+			GainCount
+		};
+
 		SinkNode() = default;
 		SinkNode(const SinkNode&) = delete;
 		SinkNode(SinkNode&&) = delete;
@@ -16,18 +22,44 @@ namespace Phonon::Native {
 
 		virtual auto connectToMediaPlayer(QMediaPlayer* player) -> void {
 			m_player = player;
+			for(auto* sink: m_sinks) {
+				sink->connectToMediaPlayer(player);
+			}
 		}
 
-		virtual auto disconnectFromMediaPlayer(
-			QMediaPlayer* /*mediaObject*/) -> void {
+		virtual auto disconnectFromMediaPlayer(QMediaPlayer* player) -> void {
+			for(auto* sink: m_sinks) {
+				sink->disconnectFromMediaPlayer(player);
+			}
 			m_player = nullptr;
 		}
 
+		/* Gains applied on top of the user volume by the audio sinks */
+		virtual auto setGain(Gain stage, float gain) -> void {
+			for(auto* sink: m_sinks) {
+				sink->setGain(stage, gain);
+			}
+		}
+
 		auto mediaPlayer() -> QMediaPlayer* {
 			return m_player;
 		}
 
+		auto addSink(SinkNode* sink) -> void {
+			m_sinks << sink;
+			if(m_player) {
+				sink->connectToMediaPlayer(m_player);
+			}
+		}
+
+		auto removeSink(SinkNode* sink) -> void {
+			if(m_sinks.removeOne(sink) && m_player) {
+				sink->disconnectFromMediaPlayer(m_player);
+			}
+		}
+
 	  private:
 		QMediaPlayer* m_player{};
+		QList<SinkNode*> m_sinks;
 	};
 } // namespace Phonon::Native
@@ -0,0 +1,241 @@
+module;
+
+#include <QIODevice>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QtCore/qtmochelpers.h>
+#include <atomic>
+#include <cstring>
+#include <phonon/MediaSource>
+#include <phonon/streaminterface.h>
+
+#define STREAM_CHUNKS 4096
+#define STREAM_HIGH_WATERMARK (4 * 1024 * 1024)
+#define STREAM_LOW_WATERMARK (1024 * 1024)
+#define STREAM_WAIT 100
+
+export module phonon_native:streamreader;
+
+import :ringbuffer;
+
+export namespace Phonon::Native {
+	/* Presents an AbstractMediaStream as a QIODevice for
+	 * QMediaPlayer::setSourceDevice. The chunks written by the application
+	 * are queued by reference and only copied once, into the buffer of the
+	 * demuxer reading from another thread. */
+	class StreamReader final: public QIODevice, public StreamInterface {
+		Q_OBJECT
+
+	  public:
+		StreamReader(const MediaSource& source, QObject* parent):
+			QIODevice{parent}, m_chunks{STREAM_CHUNKS} {
+			connectToSource(source);
+			open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+			StreamInterface::reset();
+		}
+
+		~StreamReader() final {
+			abort();
+		}
+
+		StreamReader(const StreamReader&) = delete;
+		StreamReader(StreamReader&&) = delete;
+		auto operator=(const StreamReader&) -> StreamReader& = delete;
+		auto operator=(StreamReader&&) -> StreamReader& = delete;
+
+		/* Wakes up and fails a pending read, e.g. before the player lets go
+		 * of the device. */
+		auto abort() -> void {
+			m_aborted = true;
+			wake();
+		}
+
+		/* StreamInterface, called from the thread the reader lives in */
+
+		auto writeData(const QByteArray& data) -> void final {
+			if(data.isEmpty()) {
+				return;
+			}
+			discardStale();
+			m_buffered += data.size();
+			m_pending << Chunk{data, m_producerGeneration, false};
+			flush();
+			if(m_buffered > STREAM_HIGH_WATERMARK && m_dataRequested) {
+				m_dataRequested = false;
+				enoughData();
+			}
+		}
+
+		auto endOfData() -> void final {
+			discardStale();
+			m_pending << Chunk{{}, m_producerGeneration, true};
+			flush();
+		}
+
+		auto setStreamSize(qint64 newSize) -> void final {
+			m_streamSize = newSize;
+		}
+
+		auto setStreamSeekable(bool seekable) -> void final {
+			m_seekable = seekable;
+		}
+
+		/* QIODevice, called from the consumer thread */
+
+		[[nodiscard]]
+		auto isSequential() const -> bool final {
+			return !m_seekable;
+		}
+
+		[[nodiscard]]
+		auto size() const -> qint64 final {
+			return m_streamSize > 0 ? m_streamSize.load() : bytesAvailable();
+		}
+
+		/* The device is unbuffered, and for seekable devices QIODevice
+		 * would count the bytes up to size() */
+		[[nodiscard]]
+		auto bytesAvailable() const -> qint64 final {
+			return m_buffered;
+		}
+
+		[[nodiscard]]
+		auto atEnd() const -> bool final {
+			return m_endOfData && m_chunks.size() == 0
+				&& m_offset >= m_chunk.size();
+		}
+
+		auto seek(qint64 position) -> bool final {
+			if(!m_seekable || !QIODevice::seek(position)) {
+				return false;
+			}
+			/* Chunks queued for the old position are dropped by the
+			 * producer or when they are popped */
+			m_generation.fetch_add(1, std::memory_order_acq_rel);
+			m_chunks.clear();
+			m_chunk = {};
+			m_offset = 0;
+			m_buffered = 0;
+			m_endOfData = false;
+			m_dataRequested = false;
+			seekStream(position);
+			return true;
+		}
+
+	  protected:
+		auto readData(char* data, qint64 maxSize) -> qint64 final {
+			qint64 copied{0};
+			while(copied < maxSize && !m_aborted) {
+				if(m_offset >= m_chunk.size()) {
+					auto chunk{m_chunks.pop()};
+					if(chunk
+						&& chunk->generation
+							!= m_generation.load(std::memory_order_acquire)) {
+						continue;
+					}
+					if(chunk && chunk->end) {
+						m_endOfData = true;
+						continue;
+					}
+					if(!chunk) {
+						if(copied > 0) {
+							break;
+						}
+						if(m_endOfData) {
+							return -1;
+						}
+						requestData();
+						QMutexLocker locker{&m_mutex};
+						if(m_chunks.size() == 0 && !m_endOfData && !m_aborted) {
+							m_dataArrived.wait(&m_mutex, STREAM_WAIT);
+						}
+						continue;
+					}
+					m_chunk = chunk->data;
+					m_offset = 0;
+				}
+				auto length{
+					qMin<qint64>(maxSize - copied, m_chunk.size() - m_offset)};
+				std::memcpy(data + copied, m_chunk.constData() + m_offset,
+					static_cast<std::size_t>(length));
+				m_offset += length;
+				copied += length;
+				m_buffered -= length;
+			}
+			if(m_buffered < STREAM_LOW_WATERMARK) {
+				requestData();
+			}
+			return m_aborted ? -1 : copied;
+		}
+
+		auto writeData(const char* /*data*/, qint64 /*len*/) -> qint64 final {
+			return -1;
+		}
+
+	  private:
+		auto requestData() -> void {
+			if(!m_dataRequested.exchange(true)) {
+				needData();
+			}
+			/* Chunks that did not fit into the ring are moved over in the
+			 * thread of the producer. */
+			if(m_hasPending) {
+				QMetaObject::invokeMethod(
+					this, [this]() { flush(); }, Qt::QueuedConnection);
+			}
+		}
+
+		auto flush() -> void {
+			discardStale();
+			while(!m_pending.isEmpty() && m_chunks.push(m_pending.first())) {
+				m_pending.removeFirst();
+			}
+			m_hasPending = !m_pending.isEmpty();
+			wake();
+		}
+
+		/* Producer side, drops what was written before the last seek */
+		auto discardStale() -> void {
+			auto generation{m_generation.load(std::memory_order_acquire)};
+			if(generation == m_producerGeneration) {
+				return;
+			}
+			m_producerGeneration = generation;
+			m_pending.clear();
+			m_hasPending = false;
+		}
+
+		auto wake() -> void {
+			QMutexLocker locker{&m_mutex};
+			m_dataArrived.wakeAll();
+		}
+
+		/* The end of the data is queued as an empty chunk, so that it
+		 * follows the last data of its seek generation */
+		struct Chunk {
+			QByteArray data;
+			quint32 generation{};
+			bool end{};
+		};
+
+		RingBuffer<Chunk> m_chunks;
+		QList<Chunk> m_pending;
+		QByteArray m_chunk;
+		qsizetype m_offset{};
+		QMutex m_mutex;
+		QWaitCondition m_dataArrived;
+		std::atomic<qint64> m_buffered{};
+		std::atomic<qint64> m_streamSize{};
+		std::atomic<bool> m_seekable{};
+		std::atomic<bool> m_endOfData{};
+		std::atomic<bool> m_dataRequested{};
+		std::atomic<bool> m_aborted{};
+		std::atomic<bool> m_hasPending{};
+		std::atomic<quint32> m_generation{};
+		/* Generation the producer has seen */
+		quint32 m_producerGeneration{};
+	};
+} // namespace Phonon::Native
+
+#include "streamreader.moc"
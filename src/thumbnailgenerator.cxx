@@ -0,0 +1,501 @@
+module;
+
+#include <QBitArray>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QImage>
+#include <QMediaMetaData>
+#include <QMediaPlayer>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTimer>
+#include <QUrl>
+#include <QVideoFrame>
+#include <QVideoSink>
+#include <QtCore/qtmochelpers.h>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#define THUMBNAIL_MAGIC 0x504E5448
+#define THUMBNAIL_VERSION 1
+#define THUMBNAIL_WIDTH 160
+#define THUMBNAIL_INTERVAL 10'000
+#define THUMBNAIL_COLUMNS 16
+#define THUMBNAIL_THREADS 2
+#define THUMBNAIL_TIMEOUT 2000
+#define THUMBNAIL_CACHE_SIZE (64 * 1024 * 1024)
+#define MAX_THUMBNAILS 512
+#define USEC 1000
+
+export module phonon_native:thumbnailgenerator;
+
+import :frameconverter;
+import :keyframeindex;
+
+using Qt::Literals::StringLiterals::operator""_L1;
+
+export namespace Phonon::Native {
+	/* Thumbnails of a source at a fixed interval, stored as tiles of a
+	 * single image. */
+	struct ThumbnailAtlas {
+		QImage image;
+		QSize tile;
+		qint64 interval{};
+		int count{};
+		QBitArray ready;
+		qint64 size{};
+		qint64 modified{};
+		quint64 lastUsed{};
+
+		[[nodiscard]]
+		auto tileRect(int index) const -> QRect {
+			return {(index % THUMBNAIL_COLUMNS) * tile.width(),
+				(index / THUMBNAIL_COLUMNS) * tile.height(),
+				tile.width(),
+				tile.height()};
+		}
+	};
+
+	/* Decodes the frames of one source with a hidden player in a worker
+	 * thread. Seeks go to the keyframe closest to each interval mark, so
+	 * the decoder never has to run through a whole group of pictures. */
+	class ThumbnailJob final: public QObject {
+		Q_OBJECT
+
+	  public:
+		ThumbnailJob(QUrl url, qint64 interval):
+			m_url{std::move(url)}, m_interval{interval} {}
+
+		~ThumbnailJob() final = default;
+		ThumbnailJob(const ThumbnailJob&) = delete;
+		ThumbnailJob(ThumbnailJob&&) = delete;
+		auto operator=(const ThumbnailJob&) -> ThumbnailJob& = delete;
+		auto operator=(ThumbnailJob&&) -> ThumbnailJob& = delete;
+
+		auto start() -> void {
+			m_player = new QMediaPlayer{this};
+			m_sink = new QVideoSink{this};
+			m_timeout = new QTimer{this};
+			m_timeout->setSingleShot(true);
+			m_timeout->setInterval(THUMBNAIL_TIMEOUT);
+			m_player->setVideoOutput(m_sink);
+			connect(m_player,
+				&QMediaPlayer::mediaStatusChanged,
+				this,
+				&ThumbnailJob::onMediaStatusChanged,
+				Qt::AutoConnection);
+			connect(m_sink,
+				&QVideoSink::videoFrameChanged,
+				this,
+				&ThumbnailJob::onFrame,
+				Qt::AutoConnection);
+			connect(m_timeout,
+				&QTimer::timeout,
+				this,
+				&ThumbnailJob::next,
+				Qt::AutoConnection);
+			m_player->setSource(m_url);
+		}
+
+	  signals:
+		auto started(int _t1, qint64 _t2, QSize _t3) -> void;
+		auto tileReady(int _t1, QImage _t2) -> void;
+		auto finished() -> void;
+
+	  private:
+		auto onMediaStatusChanged(QMediaPlayer::MediaStatus status) -> void {
+			if(status == QMediaPlayer::InvalidMedia) {
+				finish();
+			} else if(status == QMediaPlayer::LoadedMedia && m_count == 0) {
+				onLoaded();
+			}
+		}
+
+		auto onLoaded() -> void {
+			auto duration{m_player->duration()};
+			if(!m_player->hasVideo() || duration <= 0) {
+				finish();
+				return;
+			}
+			m_interval = qMax(m_interval, duration / MAX_THUMBNAILS + 1);
+			m_count = static_cast<int>(duration / m_interval) + 1;
+
+			if(m_url.isLocalFile()) {
+				auto path{m_url.toLocalFile()};
+				auto keyframes{KeyframeIndex::instance()->find(path)};
+				if(!keyframes) {
+					keyframes = KeyframeReader::read(path);
+					if(keyframes) {
+						KeyframeIndex::instance()->insert(path, *keyframes);
+					}
+				}
+				m_keyframes = keyframes.value_or(KeyframeReader::Keyframes{});
+			}
+
+			auto resolution{
+				m_player->metaData()[QMediaMetaData::Resolution].toSize()};
+			m_tile = QSize{THUMBNAIL_WIDTH,
+				resolution.isEmpty() ? THUMBNAIL_WIDTH * 9 / 16
+									 : THUMBNAIL_WIDTH * resolution.height()
+						/ resolution.width()};
+			emit started(m_count, m_interval, m_tile);
+			/* A paused player renders one frame after each seek */
+			m_player->pause();
+			m_index = -1;
+			next();
+		}
+
+		auto next() -> void {
+			m_index++;
+			if(m_index >= m_count) {
+				finish();
+				return;
+			}
+			m_target =
+				KeyframeReader::nearest(m_keyframes, m_index * m_interval);
+			m_waiting = true;
+			m_timeout->start();
+			m_player->setPosition(m_target);
+		}
+
+		auto onFrame(const QVideoFrame& frame) -> void {
+			if(!m_waiting || !frame.isValid()) {
+				return;
+			}
+			/* Skips frames still queued from the previous seek */
+			if(frame.startTime() >= 0
+				&& std::abs(frame.startTime() / USEC - m_target)
+					> qMax<qint64>(m_interval / 2, THUMBNAIL_TIMEOUT)) {
+				return;
+			}
+			m_waiting = false;
+			m_timeout->stop();
+			emit tileReady(m_index,
+				FrameConverter::convert(frame, m_tile, Qt::IgnoreAspectRatio)
+					.convertToFormat(QImage::Format_RGB888));
+			QTimer::singleShot(0, this, &ThumbnailJob::next);
+		}
+
+		auto finish() -> void {
+			m_waiting = false;
+			if(m_timeout) {
+				m_timeout->stop();
+			}
+			if(m_player) {
+				m_player->stop();
+			}
+			emit finished();
+		}
+
+		QUrl m_url;
+		qint64 m_interval;
+		QMediaPlayer* m_player{};
+		QVideoSink* m_sink{};
+		QTimer* m_timeout{};
+		KeyframeReader::Keyframes m_keyframes;
+		QSize m_tile;
+		qint64 m_target{};
+		int m_count{};
+		int m_index{};
+		bool m_waiting{};
+	};
+
+	/* Generates seek bar previews in the background and keeps them in a
+	 * memory bounded cache of atlases that are also written to disk for
+	 * local files. Only used from the GUI thread. */
+	class ThumbnailGenerator final: public QObject {
+		Q_OBJECT
+
+	  public:
+		ThumbnailGenerator() {
+			/* Created here so the workers never race on it */
+			KeyframeIndex::instance();
+		}
+
+		~ThumbnailGenerator() final {
+			for(auto* thread: m_threads) {
+				thread->quit();
+				thread->wait();
+				delete thread;
+			}
+		}
+
+		ThumbnailGenerator(const ThumbnailGenerator&) = delete;
+		ThumbnailGenerator(ThumbnailGenerator&&) = delete;
+		auto operator=(const ThumbnailGenerator&) -> ThumbnailGenerator& =
+			delete;
+		auto operator=(ThumbnailGenerator&&) -> ThumbnailGenerator& = delete;
+
+		static inline ThumbnailGenerator* self{};
+
+		static auto instance() -> ThumbnailGenerator* {
+			if(!self) {
+				self = new ThumbnailGenerator{};
+			}
+			return self;
+		}
+
+		/* Returns the preview closest to the position or a null image if
+		 * it is not generated yet, in which case the generation starts. */
+		[[nodiscard]]
+		auto thumbnail(const QUrl& url, qint64 position) -> QImage {
+			auto atlas{m_atlases.find(url)};
+			if(atlas == m_atlases.end()) {
+				request(url);
+				return {};
+			}
+			atlas->lastUsed = ++m_clock;
+			if(atlas->count == 0) {
+				return {};
+			}
+			auto index{static_cast<int>(qBound<qint64>(0,
+				(position + atlas->interval / 2) / atlas->interval,
+				atlas->count - 1))};
+			if(!atlas->ready.testBit(index)) {
+				return {};
+			}
+			return atlas->image.copy(atlas->tileRect(index));
+		}
+
+		[[nodiscard]]
+		auto interval() const -> qint64 {
+			return m_interval;
+		}
+
+		/* Applies to atlases generated afterwards */
+		auto setInterval(qint64 interval) -> void {
+			m_interval = qMax<qint64>(1, interval);
+		}
+
+		[[nodiscard]]
+		auto capacity() const -> qint64 {
+			return m_capacity;
+		}
+
+		auto setCapacity(qint64 capacity) -> void {
+			m_capacity = qMax<qint64>(0, capacity);
+			evict();
+		}
+
+	  signals:
+		auto thumbnailsChanged(const QUrl& _t1) -> void;
+
+	  private:
+		auto request(const QUrl& url) -> void {
+			if(m_queue.contains(url)) {
+				return;
+			}
+			if(load(url)) {
+				emit thumbnailsChanged(url);
+				return;
+			}
+			ThumbnailAtlas atlas;
+			atlas.lastUsed = ++m_clock;
+			m_atlases.insert(url, atlas);
+			m_queue << url;
+			schedule();
+		}
+
+		auto schedule() -> void {
+			while(m_threads.size() < THUMBNAIL_THREADS
+				&& m_threads.size() < m_queue.size()) {
+				auto url{m_queue[m_threads.size()]};
+				auto* job{new ThumbnailJob{url, m_interval}};
+				auto* thread{new QThread{}};
+				thread->setObjectName("Thumbnails"_L1);
+				job->moveToThread(thread);
+				m_threads << thread;
+				connect(thread,
+					&QThread::started,
+					job,
+					&ThumbnailJob::start,
+					Qt::AutoConnection);
+				connect(thread,
+					&QThread::finished,
+					job,
+					&QObject::deleteLater,
+					Qt::AutoConnection);
+				connect(
+					job,
+					&ThumbnailJob::started,
+					this,
+					[=, this](int count, qint64 interval, QSize tile) {
+						onStarted(url, count, interval, tile);
+					},
+					Qt::AutoConnection);
+				connect(
+					job,
+					&ThumbnailJob::tileReady,
+					this,
+					[=, this](int index, const QImage& image) {
+						onTileReady(url, index, image);
+					},
+					Qt::AutoConnection);
+				connect(
+					job,
+					&ThumbnailJob::finished,
+					this,
+					[=, this]() { onFinished(url, thread); },
+					Qt::AutoConnection);
+				thread->start();
+			}
+		}
+
+		auto onStarted(const QUrl& url, int count, qint64 interval, QSize tile)
+			-> void {
+			auto atlas{m_atlases.find(url)};
+			if(atlas == m_atlases.end()) {
+				return;
+			}
+			auto rows{(count + THUMBNAIL_COLUMNS - 1) / THUMBNAIL_COLUMNS};
+			atlas->image = QImage{tile.width() * qMin(count, THUMBNAIL_COLUMNS),
+				tile.height() * rows,
+				QImage::Format_RGB888};
+			atlas->image.fill(Qt::black);
+			atlas->tile = tile;
+			atlas->interval = interval;
+			atlas->count = count;
+			atlas->ready = QBitArray{count};
+			if(url.isLocalFile()) {
+				QFileInfo file{url.toLocalFile()};
+				atlas->size = file.size();
+				atlas->modified = file.lastModified().toMSecsSinceEpoch();
+			}
+			evict();
+		}
+
+		auto onTileReady(const QUrl& url, int index, const QImage& image)
+			-> void {
+			auto atlas{m_atlases.find(url)};
+			if(atlas == m_atlases.end() || index >= atlas->count
+				|| image.size() != atlas->tile) {
+				return;
+			}
+			auto rect{atlas->tileRect(index)};
+			auto length{static_cast<std::size_t>(rect.width()) * 3};
+			for(auto y{0}; y < rect.height(); y++) {
+				std::memcpy(atlas->image.scanLine(rect.y() + y) + rect.x() * 3,
+					image.constScanLine(y),
+					length);
+			}
+			atlas->ready.setBit(index);
+			emit thumbnailsChanged(url);
+		}
+
+		auto onFinished(const QUrl& url, QThread* thread) -> void {
+			m_queue.removeOne(url);
+			m_threads.removeOne(thread);
+			thread->quit();
+			thread->wait();
+			delete thread;
+			auto atlas{m_atlases.find(url)};
+			if(atlas != m_atlases.end()) {
+				save(url, *atlas);
+			}
+			schedule();
+		}
+
+		/* Drops the least recently used atlases that are not being
+		 * generated until the cache fits. */
+		auto evict() -> void {
+			qint64 used{};
+			for(const auto& atlas: std::as_const(m_atlases)) {
+				used += atlas.image.sizeInBytes();
+			}
+			while(used > m_capacity) {
+				auto oldest{m_atlases.end()};
+				for(auto atlas{m_atlases.begin()}; atlas != m_atlases.end();
+					atlas++) {
+					if(!m_queue.contains(atlas.key())
+						&& (oldest == m_atlases.end()
+							|| atlas->lastUsed < oldest->lastUsed)) {
+						oldest = atlas;
+					}
+				}
+				if(oldest == m_atlases.end()) {
+					return;
+				}
+				used -= oldest->image.sizeInBytes();
+				m_atlases.erase(oldest);
+			}
+		}
+
+		static auto path(const QUrl& url) -> QString {
+			return QStandardPaths::writableLocation(
+					   QStandardPaths::GenericCacheLocation)
+				+ "/phonon-native/thumbnails/"_L1
+				+ QString::fromLatin1(QCryptographicHash::hash(
+					url.toLocalFile().toUtf8(), QCryptographicHash::Sha1)
+										  .toHex())
+				+ ".atlas"_L1;
+		}
+
+		auto save(const QUrl& url, const ThumbnailAtlas& atlas) -> void {
+			if(!url.isLocalFile() || atlas.count == 0) {
+				return;
+			}
+			QDir{}.mkpath(QFileInfo{path(url)}.absolutePath());
+			QSaveFile file{path(url)};
+			if(!file.open(QIODevice::WriteOnly)) {
+				qDebug() << "Cannot write thumbnails:" << file.errorString();
+				return;
+			}
+			QDataStream stream{&file};
+			stream.setVersion(QDataStream::Qt_6_0);
+			stream << quint32{THUMBNAIL_MAGIC} << quint32{THUMBNAIL_VERSION}
+				   << atlas.size << atlas.modified << atlas.interval
+				   << atlas.count << atlas.tile << atlas.ready << atlas.image;
+			file.commit();
+		}
+
+		auto load(const QUrl& url) -> bool {
+			if(!url.isLocalFile()) {
+				return false;
+			}
+			QFile file{path(url)};
+			if(!file.open(QIODevice::ReadOnly)) {
+				return false;
+			}
+			QFileInfo source{url.toLocalFile()};
+			QDataStream stream{&file};
+			stream.setVersion(QDataStream::Qt_6_0);
+			quint32 magic{};
+			quint32 version{};
+			ThumbnailAtlas atlas;
+			stream >> magic >> version >> atlas.size >> atlas.modified;
+			if(magic != THUMBNAIL_MAGIC || version != THUMBNAIL_VERSION
+				|| atlas.size != source.size()
+				|| atlas.modified
+					!= source.lastModified().toMSecsSinceEpoch()) {
+				return false;
+			}
+			stream >> atlas.interval >> atlas.count >> atlas.tile
+				>> atlas.ready >> atlas.image;
+			if(stream.status() != QDataStream::Ok
+				|| atlas.ready.size() != atlas.count
+				|| atlas.image.format() != QImage::Format_RGB888) {
+				return false;
+			}
+			atlas.lastUsed = ++m_clock;
+			m_atlases.insert(url, atlas);
+			evict();
+			return true;
+		}
+
+		QHash<QUrl, ThumbnailAtlas> m_atlases;
+		QList<QUrl> m_queue;
+		QList<QThread*> m_threads;
+		quint64 m_clock{};
+		qint64 m_interval{THUMBNAIL_INTERVAL};
+		qint64 m_capacity{THUMBNAIL_CACHE_SIZE};
+	};
+} // namespace Phonon::Native
+
+#include "thumbnailgenerator.moc"
@@ -0,0 +1,263 @@
+module;
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QTimer>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+
+#define DRIFT_LIMIT 250
+
+export module phonon_native:timeeventscheduler;
+
+import :playbackstatistics;
+
+export namespace Phonon::Native {
+	/* Keeps the upcoming time events of a media object in time order and
+	 * fires each of them once from a media clock that is interpolated
+	 * between the position updates of the player. */
+	class TimeEventScheduler final {
+	  public:
+		enum Event {
+			Tick,
+			PrefinishMark,
+			AboutToFinish,
+			Transition,
+			Chapter
+		};
+
+		using Callback = std::function<void(Event, qint64)>;
+
+		TimeEventScheduler(QObject* parent, Callback callback):
+			m_timer{new QTimer{parent}}, m_callback{std::move(callback)} {
+			m_timer->setSingleShot(true);
+			m_timer->setTimerType(Qt::PreciseTimer);
+			QObject::connect(
+				m_timer,
+				&QTimer::timeout,
+				m_timer,
+				[this]() { dispatch(); },
+				Qt::AutoConnection);
+		}
+
+		~TimeEventScheduler() = default;
+		TimeEventScheduler(const TimeEventScheduler&) = delete;
+		TimeEventScheduler(TimeEventScheduler&&) = delete;
+		auto operator=(const TimeEventScheduler&) -> TimeEventScheduler& =
+			delete;
+		auto operator=(TimeEventScheduler&&) -> TimeEventScheduler& = delete;
+
+		auto setTickInterval(qint32 interval) -> void {
+			m_tickInterval = interval;
+			rearm();
+		}
+
+		auto setPrefinishMark(qint32 mark) -> void {
+			m_prefinishMark = mark;
+			rearm();
+		}
+
+		auto setAboutToFinishTime(qint32 time) -> void {
+			m_aboutToFinishTime = time;
+			rearm();
+		}
+
+		auto setTransitionTime(qint32 time) -> void {
+			m_transitionTime = time;
+			rearm();
+		}
+
+		auto setDuration(qint64 duration) -> void {
+			m_duration = duration;
+			rearm();
+		}
+
+		auto setChapters(QList<qint64> starts) -> void {
+			std::sort(starts.begin(), starts.end());
+			m_chapters = std::move(starts);
+			rearm();
+		}
+
+		auto setRate(qreal rate) -> void {
+			anchor(position());
+			m_rate = rate;
+			arm();
+		}
+
+		auto start(qint64 position) -> void {
+			m_running = true;
+			seek(position);
+		}
+
+		auto stop(qint64 position) -> void {
+			m_running = false;
+			anchor(position);
+			arm();
+		}
+
+		auto seek(qint64 position) -> void {
+			anchor(position);
+			rearm();
+			tickStopped();
+		}
+
+		/* Corrects the interpolated clock with a position reported by the
+		 * player. Jumps that cannot be explained by drift re-arm all
+		 * events instead of firing the skipped ones. */
+		auto synchronize(qint64 position) -> void {
+			auto drift{position - this->position()};
+			anchor(position);
+			if(std::abs(drift) > DRIFT_LIMIT) {
+				rearm();
+			} else {
+				arm();
+			}
+			if(drift != 0) {
+				tickStopped();
+			}
+		}
+
+		[[nodiscard]]
+		auto position() const -> qint64 {
+			if(!m_running || !m_clock.isValid()) {
+				return m_anchor;
+			}
+			return m_anchor
+				+ std::llround(static_cast<double>(m_clock.nsecsElapsed())
+					* m_rate / 1'000'000.0);
+		}
+
+		[[nodiscard]]
+		auto chapterAt(qint64 time) const -> int {
+			auto next{
+				std::upper_bound(m_chapters.begin(), m_chapters.end(), time)};
+			return qMax(0, static_cast<int>(next - m_chapters.begin()) - 1);
+		}
+
+		auto schedule(Event event, qint64 time) -> void {
+			m_events.emplace(time, event);
+			arm();
+		}
+
+	  private:
+		auto anchor(qint64 position) -> void {
+			m_anchor = position;
+			m_clock.start();
+		}
+
+		/* Ticks the new position right away while the clock stands still,
+		 * e.g. after a seek while paused, so that sliders follow it */
+		auto tickStopped() -> void {
+			if(!m_running && m_tickInterval > 0) {
+				m_callback(Tick, m_anchor);
+			}
+		}
+
+		auto rearm() -> void {
+			m_generation++;
+			m_events.clear();
+			auto now{position()};
+			if(m_tickInterval > 0) {
+				m_events.emplace(
+					(now / m_tickInterval + 1) * m_tickInterval, Tick);
+			}
+			if(m_duration > 0) {
+				for(auto [event, offset]:
+					{std::pair{PrefinishMark, m_prefinishMark},
+						std::pair{AboutToFinish, m_aboutToFinishTime},
+						std::pair{Transition, m_transitionTime}}) {
+					if(offset > 0 && m_duration - offset > now) {
+						m_events.emplace(m_duration - offset, event);
+					}
+				}
+			}
+			if(!m_chapters.isEmpty()) {
+				m_events.emplace(now, Chapter);
+			}
+			arm();
+		}
+
+		auto arm() -> void {
+			if(m_events.empty()) {
+				m_timer->stop();
+				return;
+			}
+			auto due{m_events.begin()->first - position()};
+			if(due <= 0) {
+				m_timer->start(0);
+			} else if(m_running && m_rate > 0) {
+				m_timer->start(static_cast<int>(
+					std::ceil(static_cast<double>(due) / m_rate)));
+			} else {
+				m_timer->stop();
+			}
+		}
+
+		/* The time spent in the callbacks, i.e. in the slots of the
+		 * frontend, is left out of the Tick statistics. A callback that
+		 * rearms the scheduler, like a transition to the next track, ends
+		 * the round, the events left are relative to the old clock. */
+		auto dispatch() -> void {
+			QElapsedTimer clock;
+			clock.start();
+			qint64 callbacks{};
+			auto ticked{false};
+			auto now{position()};
+			auto generation{m_generation};
+			while(!m_events.empty() && m_events.begin()->first <= now
+				&& generation == m_generation) {
+				auto [due, event]{*m_events.begin()};
+				m_events.erase(m_events.begin());
+				switch(event) {
+					case Tick:
+						ticked = true;
+						if(m_tickInterval > 0) {
+							m_events.emplace(due
+									+ m_tickInterval
+										* ((now - due) / m_tickInterval + 1),
+								Tick);
+						}
+						break;
+					case Chapter:
+						{
+							auto next{std::upper_bound(
+								m_chapters.begin(), m_chapters.end(), now)};
+							if(next != m_chapters.end()) {
+								m_events.emplace(*next, Chapter);
+							}
+						}
+						break;
+					case PrefinishMark:
+					case AboutToFinish:
+					case Transition:
+						break;
+				}
+				auto called{clock.nsecsElapsed()};
+				m_callback(event, event == Chapter ? now : due);
+				callbacks += clock.nsecsElapsed() - called;
+			}
+			arm();
+			if(ticked) {
+				PlaybackStatistics::instance()->record(PlaybackStatistics::Tick,
+					(clock.nsecsElapsed() - callbacks) / 1000);
+			}
+		}
+
+		QTimer* m_timer;
+		Callback m_callback;
+		std::multimap<qint64, Event> m_events;
+		QList<qint64> m_chapters;
+		QElapsedTimer m_clock;
+		qint64 m_anchor{};
+		qint64 m_duration{};
+		qreal m_rate{1.0};
+		qint32 m_tickInterval{};
+		qint32 m_prefinishMark{};
+		qint32 m_aboutToFinishTime{};
+		qint32 m_transitionTime{};
+		quint64 m_generation{};
+		bool m_running{};
+	};
+} // namespace Phonon::Native
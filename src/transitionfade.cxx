@@ -0,0 +1,133 @@
+module;
+
+#include <QMediaPlayer>
+#include <QPointer>
+#include <atomic>
+#include <cmath>
+#include <numbers>
+
+#define LANES 4
+#define MSEC 1000
+#define TIME_BITS 30
+#define TIME_MASK ((1U << TIME_BITS) - 1)
+
+export module phonon_native:transitionfade;
+
+import :dsp;
+import :effectchain;
+
+export namespace Phonon::Native {
+	/* Half of an equal-power crossfade between two players of a media
+	 * object, run in the effect chain of one of them. The gain follows the
+	 * curve frame by frame from the first block processed after the fade
+	 * was started, for the incoming player that is its first audio. */
+	class TransitionFade final: public AudioProcessor {
+	  public:
+		enum Direction {
+			None,
+			In,
+			Out
+		};
+
+		TransitionFade() = default;
+
+		~TransitionFade() final {
+			detach();
+		}
+
+		TransitionFade(const TransitionFade&) = delete;
+		TransitionFade(TransitionFade&&) = delete;
+		auto operator=(const TransitionFade&) -> TransitionFade& = delete;
+		auto operator=(TransitionFade&&) -> TransitionFade& = delete;
+
+		/* Routes the audio of the player through the stage */
+		auto attach(QMediaPlayer* player) -> void {
+			detach();
+			m_chain = EffectChain::of(player);
+			m_chain->insert(this);
+		}
+
+		auto detach() -> void {
+			if(m_chain) {
+				m_chain->remove(this);
+				m_chain = nullptr;
+			}
+		}
+
+		/* Fades in or out over the time in milliseconds, None passes the
+		 * audio unchanged. Only called from the thread of the owner. */
+		auto start(Direction direction, int time) -> void {
+			m_finished.store(false, std::memory_order_relaxed);
+			auto serial{(m_request.load(std::memory_order_relaxed) >> 32) + 1};
+			m_request.store(serial << 32
+					| static_cast<quint64>(direction) << TIME_BITS
+					| (static_cast<quint64>(qMax(0, time)) & TIME_MASK),
+				std::memory_order_release);
+		}
+
+		/* A fade out reached silence */
+		[[nodiscard]]
+		auto finished() const -> bool {
+			return m_finished.load(std::memory_order_acquire);
+		}
+
+		/* Audio thread */
+		auto process(float* frames, qsizetype count, int groups, int rate)
+			-> void final {
+			receive(rate);
+			if(m_direction == None) {
+				return;
+			}
+			auto stride{groups * LANES};
+			for(qsizetype frame{0}; frame < count; frame++) {
+				auto gain{m_direction == In ? 1.0F : 0.0F};
+				if(m_position < m_length) {
+					auto angle{static_cast<double>(m_position)
+						/ static_cast<double>(m_length) * std::numbers::pi
+						/ 2.0};
+					gain = static_cast<float>(
+						m_direction == In ? std::sin(angle) : std::cos(angle));
+					m_position++;
+				}
+				auto factor{Float4::broadcast(gain)};
+				auto* samples{frames + frame * stride};
+				for(auto group{0}; group < groups; group++) {
+					(Float4::load(samples + group * LANES) * factor)
+						.store(samples + group * LANES);
+				}
+			}
+			if(m_position >= m_length) {
+				if(m_direction == Out) {
+					m_finished.store(true, std::memory_order_release);
+				}
+				/* Done fading in, nothing left to scale */
+				if(m_direction == In) {
+					m_direction = None;
+				}
+			}
+		}
+
+	  private:
+		auto receive(int rate) -> void {
+			auto request{m_request.load(std::memory_order_acquire)};
+			if(request >> 32 == m_received) {
+				return;
+			}
+			m_received = request >> 32;
+			m_direction = static_cast<Direction>((request >> TIME_BITS) & 3U);
+			m_length =
+				static_cast<qint64>(request & TIME_MASK) * rate / MSEC;
+			m_position = 0;
+		}
+
+		QPointer<EffectChain> m_chain;
+		/* Serial in the upper half, direction and time in the lower */
+		std::atomic<quint64> m_request{};
+		std::atomic<bool> m_finished{};
+		/* Owned by the audio thread */
+		quint64 m_received{};
+		Direction m_direction{None};
+		qint64 m_length{};
+		qint64 m_position{};
+	};
+} // namespace Phonon::Native
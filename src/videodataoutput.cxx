@@ -0,0 +1,332 @@
+module;
+
+#include <QByteArray>
+#include <QImage>
+#include <QMediaPlayer>
+#include <QMutex>
+#include <QPointer>
+#include <QThread>
+#include <QVideoFrame>
+#include <QVideoSink>
+#include <QtCore/qtmochelpers.h>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <phonon/experimental/abstractvideodataoutput.h>
+#include <phonon/experimental/videodataoutputinterface.h>
+#include <phonon/experimental/videoframe2.h>
+
+#define FRAME_QUEUE_SIZE 3
+
+export module phonon_native:videodataoutput;
+
+import :frameconverter;
+import :sinknode;
+
+using Qt::Literals::StringLiterals::operator""_L1;
+
+export namespace Phonon::Native {
+	/* Taps the frames of the video sink of the player and hands them to
+	 * the frontend on a delivery thread. Frames are queued by reference,
+	 * at most FRAME_QUEUE_SIZE of them, the oldest is dropped when the
+	 * consumer falls behind so the decoder never runs out of surfaces.
+	 * Planes in a format the frontend accepts are passed as mapped memory
+	 * without copying, other frames are converted to RGB888. */
+	class VideoDataOutput final:
+		public QObject,
+		public Experimental::VideoDataOutputInterface,
+		public SinkNode {
+		Q_OBJECT
+		Q_INTERFACES(Phonon::Experimental::VideoDataOutputInterface)
+		Q_PROPERTY(qint64 droppedFrames READ droppedFrames)
+
+	  public:
+		explicit VideoDataOutput(QObject* parent):
+			QObject{parent}, m_worker{new QObject{}},
+			m_ownSink{new QVideoSink{this}} {
+			m_worker->moveToThread(&m_thread);
+			m_thread.setObjectName("VideoDataOutput"_L1);
+			m_thread.start();
+		}
+
+		~VideoDataOutput() final {
+			if(m_source) {
+				disconnect(m_source, nullptr, this, nullptr);
+			}
+			m_worker->deleteLater();
+			m_thread.quit();
+			m_thread.wait();
+		}
+
+		VideoDataOutput(const VideoDataOutput&) = delete;
+		VideoDataOutput(VideoDataOutput&&) = delete;
+		auto operator=(const VideoDataOutput&) -> VideoDataOutput& = delete;
+		auto operator=(VideoDataOutput&&) -> VideoDataOutput& = delete;
+
+		Experimental::AbstractVideoDataOutput* frontendObject() const final {
+			return m_frontend.load(std::memory_order_acquire);
+		}
+
+		void setFrontendObject(
+			Experimental::AbstractVideoDataOutput* frontend) final {
+			m_frontend.store(frontend, std::memory_order_release);
+		}
+
+		auto connectToMediaPlayer(QMediaPlayer* player) -> void final {
+			connect(
+				player,
+				&QMediaPlayer::videoOutputChanged,
+				this,
+				[=, this]() { attach(player); },
+				Qt::AutoConnection);
+			connect(
+				player,
+				&QMediaPlayer::mediaStatusChanged,
+				this,
+				[=, this](QMediaPlayer::MediaStatus status) {
+					if(status == QMediaPlayer::EndOfMedia) {
+						deliver([this]() { finish(); });
+					}
+				},
+				Qt::AutoConnection);
+			attach(player);
+			SinkNode::connectToMediaPlayer(player);
+		}
+
+		auto disconnectFromMediaPlayer(QMediaPlayer* player) -> void final {
+			disconnect(player, nullptr, this, nullptr);
+			if(m_source) {
+				disconnect(m_source, nullptr, this, nullptr);
+				m_source = nullptr;
+			}
+			if(player->videoSink() == m_ownSink) {
+				player->setVideoOutput(nullptr);
+			}
+			SinkNode::disconnectFromMediaPlayer(player);
+		}
+
+		/* Frames dropped because the frontend was too slow */
+		[[nodiscard]]
+		auto droppedFrames() const -> qint64 {
+			return m_dropped.load(std::memory_order_relaxed);
+		}
+
+	  private:
+		using Frame = Experimental::VideoFrame2;
+
+		/* A player renders into one sink only. Frames are taken from the
+		 * sink of a video widget when there is one, the output falls back
+		 * to a sink of its own otherwise. */
+		auto attach(QMediaPlayer* player) -> void {
+			auto* sink{player->videoSink()};
+			if(!sink) {
+				player->setVideoOutput(m_ownSink);
+				sink = m_ownSink;
+			}
+			if(sink == m_source) {
+				return;
+			}
+			if(m_source) {
+				disconnect(m_source, nullptr, this, nullptr);
+			}
+			m_source = sink;
+			connect(
+				sink,
+				&QVideoSink::videoFrameChanged,
+				this,
+				[=, this](const QVideoFrame& frame) { enqueue(frame); },
+				Qt::DirectConnection);
+		}
+
+		template<typename Function>
+		auto deliver(Function function) -> void {
+			QMetaObject::invokeMethod(
+				m_worker, std::move(function), Qt::QueuedConnection);
+		}
+
+		/* Thread of the sink, only takes a reference to the frame */
+		auto enqueue(const QVideoFrame& frame) -> void {
+			auto* frontend{m_frontend.load(std::memory_order_acquire)};
+			if(!frame.isValid() || !frontend || !frontend->isRunning()) {
+				return;
+			}
+			QMutexLocker lock{&m_mutex};
+			if(m_pending.size() >= FRAME_QUEUE_SIZE) {
+				m_pending.removeFirst();
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+			}
+			m_pending << frame;
+			if(!m_drainPosted) {
+				m_drainPosted = true;
+				deliver([this]() { drain(); });
+			}
+		}
+
+		/* Delivery thread from here on */
+
+		auto drain() -> void {
+			forever {
+				QVideoFrame frame;
+				{
+					QMutexLocker lock{&m_mutex};
+					if(m_pending.isEmpty()) {
+						m_drainPosted = false;
+						return;
+					}
+					frame = m_pending.takeFirst();
+				}
+				process(frame);
+			}
+		}
+
+		auto finish() -> void {
+			drain();
+			if(auto* frontend{m_frontend.load(std::memory_order_acquire)}) {
+				frontend->endOfMedia();
+			}
+		}
+
+		auto process(QVideoFrame& frame) -> void {
+			auto* frontend{m_frontend.load(std::memory_order_acquire)};
+			if(!frontend || !frontend->isRunning()) {
+				return;
+			}
+			auto formats{frontend->allowedFormats()};
+			Frame output{};
+			output.width = frame.width();
+			output.height = frame.height();
+
+			auto format{frame.pixelFormat()};
+			auto planar{format == QVideoFrameFormat::Format_YUV420P
+				|| format == QVideoFrameFormat::Format_YV12
+				|| format == QVideoFrameFormat::Format_NV12
+				|| format == QVideoFrameFormat::Format_NV21};
+			if(planar && formats.contains(Frame::Format_YV12)
+				&& frame.map(QVideoFrame::ReadOnly)) {
+				output.format = Frame::Format_YV12;
+				mapPlanar(frame, output);
+			} else if(format == QVideoFrameFormat::Format_YUYV
+				&& formats.contains(Frame::Format_YUY2)
+				&& frame.map(QVideoFrame::ReadOnly)) {
+				output.format = Frame::Format_YUY2;
+				output.data0 = plane(frame.bits(0),
+					frame.bytesPerLine(0),
+					output.width * 2,
+					output.height,
+					m_planes[0]);
+			}
+
+			QImage image;
+			if(output.format == Frame::Format_Invalid) {
+				if(!formats.contains(Frame::Format_RGB888)) {
+					return;
+				}
+				image = FrameConverter::convert(frame, {}, Qt::KeepAspectRatio)
+							.convertToFormat(QImage::Format_RGB888);
+				if(image.isNull()) {
+					return;
+				}
+				output.format = Frame::Format_RGB888;
+				output.width = image.width();
+				output.height = image.height();
+				output.data0 = QByteArray::fromRawData(
+					reinterpret_cast<const char*>(image.constBits()),
+					image.sizeInBytes());
+			}
+			output.aspectRatio = static_cast<double>(output.width)
+				/ static_cast<double>(qMax(1, output.height));
+
+			frontend->frameReady(output);
+			if(frame.isMapped()) {
+				frame.unmap();
+			}
+		}
+
+		/* Y, Cb and Cr planes of a mapped 4:2:0 frame. Semi-planar chroma
+		 * is split into the plane buffers, the only copy on this path. */
+		auto mapPlanar(const QVideoFrame& frame,
+			Frame& output) -> void {
+			auto width{output.width};
+			auto height{output.height};
+			auto chromaWidth{(width + 1) / 2};
+			auto chromaHeight{(height + 1) / 2};
+			output.data0 = plane(frame.bits(0),
+				frame.bytesPerLine(0),
+				width,
+				height,
+				m_planes[0]);
+
+			auto format{frame.pixelFormat()};
+			if(format == QVideoFrameFormat::Format_YUV420P
+				|| format == QVideoFrameFormat::Format_YV12) {
+				auto swapped{format == QVideoFrameFormat::Format_YV12};
+				auto blue{swapped ? 2 : 1};
+				auto red{swapped ? 1 : 2};
+				output.data1 = plane(frame.bits(blue),
+					frame.bytesPerLine(blue),
+					chromaWidth,
+					chromaHeight,
+					m_planes[1]);
+				output.data2 = plane(frame.bits(red),
+					frame.bytesPerLine(red),
+					chromaWidth,
+					chromaHeight,
+					m_planes[2]);
+				return;
+			}
+
+			auto swapped{format == QVideoFrameFormat::Format_NV21};
+			auto size{qsizetype{chromaWidth} * chromaHeight};
+			m_planes[1].resize(size);
+			m_planes[2].resize(size);
+			auto* blue{m_planes[swapped ? 2 : 1].data()};
+			auto* red{m_planes[swapped ? 1 : 2].data()};
+			for(auto y{0}; y < chromaHeight; y++) {
+				const auto* line{
+					frame.bits(1) + qsizetype{y} * frame.bytesPerLine(1)};
+				for(auto x{0}; x < chromaWidth; x++) {
+					*blue++ = static_cast<char>(line[2 * x]);
+					*red++ = static_cast<char>(line[2 * x + 1]);
+				}
+			}
+			output.data1 = m_planes[1];
+			output.data2 = m_planes[2];
+		}
+
+		/* The mapped plane itself when its lines are packed, else a
+		 * packed copy in the reused buffer */
+		static auto plane(const uchar* bits,
+			int stride,
+			int width,
+			int height,
+			QByteArray& buffer) -> QByteArray {
+			if(stride == width) {
+				return QByteArray::fromRawData(
+					reinterpret_cast<const char*>(bits),
+					qsizetype{width} * height);
+			}
+			buffer.resize(qsizetype{width} * height);
+			auto* data{buffer.data()};
+			for(auto y{0}; y < height; y++) {
+				std::memcpy(data + qsizetype{y} * width,
+					bits + qsizetype{y} * stride,
+					static_cast<std::size_t>(width));
+			}
+			return buffer;
+		}
+
+		QThread m_thread;
+		QObject* m_worker;
+		QVideoSink* m_ownSink;
+		QPointer<QVideoSink> m_source;
+		std::atomic<Experimental::AbstractVideoDataOutput*> m_frontend{};
+		std::atomic<qint64> m_dropped{};
+		QMutex m_mutex;
+		QList<QVideoFrame> m_pending;
+		bool m_drainPosted{};
+		/* Owned by the delivery thread, reused from frame to frame */
+		std::array<QByteArray, 3> m_planes;
+	};
+} // namespace Phonon::Native
+
+#include "videodataoutput.moc"
@@ -1,21 +1,57 @@
 module;
 
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QMatrix4x4>
 #include <QMediaPlayer>
+#include <QQmlEngine>
 #include <QQuickItem>
 #include <QQuickView>
+#include <QSGRendererInterface>
 #include <QVBoxLayout>
 #include <QVideoFrame>
 #include <QVideoSink>
+#include <QtConcurrentRun>
 #include <QtCore/qtmochelpers.h>
+#include <cmath>
+#include <numbers>
 #include <phonon/VideoWidgetInterface>
 
-#define MAX_COLOR_VALUE 255
+#define LUMA_RED 0.2126F
+#define LUMA_GREEN 0.7152F
+#define LUMA_BLUE 0.0722F
 
 export module phonon_native:videowidget;
 
+import :frameconverter;
+import :loadstatistics;
 import :sinknode;
 
+using Qt::Literals::StringLiterals::operator""_L1;
+
 export namespace Phonon::Native {
+	/* QML engine shared by all video widgets. Video.qml is compiled ahead
+	 * of time into the org.kde.phonon.native module, so each widget only
+	 * instantiates the cached component. */
+	class QuickEngine final: public QQmlEngine {
+	  public:
+		QuickEngine() = default;
+		~QuickEngine() final = default;
+		QuickEngine(const QuickEngine&) = delete;
+		QuickEngine(QuickEngine&&) = delete;
+		auto operator=(const QuickEngine&) -> QuickEngine& = delete;
+		auto operator=(QuickEngine&&) -> QuickEngine& = delete;
+
+		static inline QuickEngine* self{};
+
+		static auto instance() -> QuickEngine* {
+			if(!self) {
+				self = new QuickEngine{};
+			}
+			return self;
+		}
+	};
+
 	class VideoWidget final:
 		public QWidget,
 		public VideoWidgetInterface44,
@@ -24,20 +60,45 @@ export namespace Phonon::Native {
 		Q_INTERFACES(Phonon::VideoWidgetInterface44)
 
 	  public:
+		/* Construction time of all video widgets */
+		static inline LatencyHistogram constructionTime;
+		/* Time the render thread spends on a frame of any video widget */
+		static inline LatencyHistogram frameTime;
+		/* Conversion time of snapshots, synchronous or not */
+		static inline LatencyHistogram snapshotTime;
+
 		explicit VideoWidget(QWidget* parent):
 			QWidget{parent, Qt::WindowFlags()} {
+			QElapsedTimer clock;
+			clock.start();
 			auto* layout{new QVBoxLayout(this)};
-			auto* view{new QQuickView{QUrl::fromLocalFile(":/video.qml"),
-				static_cast<QWindow*>(nullptr)}};
+			auto* view{new QQuickView{
+				QuickEngine::instance(), static_cast<QWindow*>(nullptr)}};
 			view->setResizeMode(QQuickView::SizeRootObjectToView);
+			view->loadFromModule("org.kde.phonon.native"_L1, "Video"_L1);
 			auto* container{
 				QWidget::createWindowContainer(view, this, Qt::WindowFlags())};
 			container->setMinimumSize(view->size());
 			container->setFocusPolicy(Qt::TabFocus);
 			layout->addWidget(container, 0, Qt::Alignment());
+			m_output = view->rootObject()->children().first();
 			m_sink = qvariant_cast<QVideoSink*>(
-				view->rootObject()->children().first()->property("videoSink"));
-			m_effect = view->rootObject()->children()[1];
+				m_output->property("videoSink"));
+			connect(
+				view,
+				&QQuickWindow::beforeRendering,
+				this,
+				[=, this]() { m_frameClock.start(); },
+				Qt::DirectConnection);
+			connect(
+				view,
+				&QQuickWindow::afterRendering,
+				this,
+				[=, this]() {
+					frameTime.record(m_frameClock.nsecsElapsed() / 1000);
+				},
+				Qt::DirectConnection);
+			constructionTime.record(clock.nsecsElapsed() / 1000);
 		}
 
 		~VideoWidget() final = default;
@@ -63,7 +124,7 @@ export namespace Phonon::Native {
 
 		auto setBrightness(qreal brightness) -> void final {
 			m_brightness = brightness;
-			m_effect->setProperty("brightness", m_brightness);
+			updateColorMatrix();
 		}
 
 		[[nodiscard]]
@@ -73,7 +134,7 @@ export namespace Phonon::Native {
 
 		auto setScaleMode(Phonon::VideoWidget::ScaleMode mode) -> void final {
 			m_scale = mode;
-			m_effect->setProperty("fillMode",
+			m_output->setProperty("fillMode",
 				mode == Phonon::VideoWidget::FitInView
 					? Qt::KeepAspectRatio
 					: Qt::KeepAspectRatioByExpanding);
@@ -86,7 +147,7 @@ export namespace Phonon::Native {
 
 		auto setContrast(qreal contrast) -> void final {
 			m_contrast = contrast;
-			m_effect->setProperty("contrast", m_contrast);
+			updateColorMatrix();
 		}
 
 		[[nodiscard]]
@@ -96,21 +157,7 @@ export namespace Phonon::Native {
 
 		auto setHue(qreal hue) -> void final {
 			m_hue = hue;
-			if(m_hue > 0) {
-				m_effect->setProperty("colorization", m_hue);
-				m_effect->setProperty("colorizationColor",
-					QColor::fromHsv(MAX_COLOR_VALUE,
-						MAX_COLOR_VALUE,
-						MAX_COLOR_VALUE,
-						MAX_COLOR_VALUE));
-			} else if(m_hue < 0) {
-				m_effect->setProperty("colorization", qFabs(m_hue));
-				m_effect->setProperty("colorizationColor",
-					QColor::fromHsv(
-						0, MAX_COLOR_VALUE, MAX_COLOR_VALUE, MAX_COLOR_VALUE));
-			} else {
-				m_effect->setProperty("colorization", m_hue);
-			}
+			updateColorMatrix();
 		}
 
 		[[nodiscard]]
@@ -120,7 +167,7 @@ export namespace Phonon::Native {
 
 		auto setSaturation(qreal saturation) -> void final {
 			m_saturation = saturation;
-			m_effect->setProperty("saturation", m_saturation);
+			updateColorMatrix();
 		}
 
 		auto widget() -> QWidget* final {
@@ -129,7 +176,23 @@ export namespace Phonon::Native {
 
 		[[nodiscard]]
 		auto snapshot() const -> QImage final {
-			return m_sink->videoFrame().toImage();
+			return takeSnapshot(m_sink->videoFrame(), {});
+		}
+
+		/* Converts the current frame in the global thread pool, fitted
+		 * into size or at full size if size is empty. Only a reference to
+		 * the frame is taken on the calling thread. */
+		[[nodiscard]]
+		auto snapshotAsync(QSize size) const -> QFuture<QImage> {
+			return QtConcurrent::run(
+				&VideoWidget::takeSnapshot, m_sink->videoFrame(), size);
+		}
+
+		/* As snapshotAsync, for callers that only see the QObject */
+		Q_INVOKABLE auto requestSnapshot(const QSize& size) -> void {
+			snapshotAsync(size).then(this, [=, this](const QImage& image) {
+				emit snapshotTaken(image);
+			});
 		}
 
 		auto connectToMediaPlayer(QMediaPlayer* player) -> void final {
@@ -142,9 +205,106 @@ export namespace Phonon::Native {
 			SinkNode::disconnectFromMediaPlayer(player);
 		}
 
+	  signals:
+		auto snapshotTaken(const QImage& _t1) -> void;
+
 	  private:
+		static auto takeSnapshot(const QVideoFrame& frame, QSize size)
+			-> QImage {
+			QElapsedTimer clock;
+			clock.start();
+			auto image{
+				FrameConverter::convert(frame, size, Qt::KeepAspectRatio)};
+			snapshotTime.record(clock.nsecsElapsed() / 1000);
+			return image;
+		}
+
+		/* Hue rotation about the grey axis, then saturation and contrast
+		 * around mid grey, then the brightness offset. All controls range
+		 * from -1 to 1, the shader is bypassed when they are all 0. */
+		auto updateColorMatrix() -> void {
+			auto angle{static_cast<float>(m_hue) * std::numbers::pi_v<float>};
+			auto c{std::cos(angle)};
+			auto s{std::sin(angle)};
+			QMatrix4x4 hue{LUMA_RED + c * (1 - LUMA_RED) - s * LUMA_RED,
+				LUMA_GREEN - c * LUMA_GREEN - s * LUMA_GREEN,
+				LUMA_BLUE - c * LUMA_BLUE + s * (1 - LUMA_BLUE),
+				0.0F,
+				LUMA_RED - c * LUMA_RED + s * 0.143F,
+				LUMA_GREEN + c * (1 - LUMA_GREEN) + s * 0.140F,
+				LUMA_BLUE - c * LUMA_BLUE - s * 0.283F,
+				0.0F,
+				LUMA_RED - c * LUMA_RED - s * (1 - LUMA_RED),
+				LUMA_GREEN - c * LUMA_GREEN + s * LUMA_GREEN,
+				LUMA_BLUE + c * (1 - LUMA_BLUE) + s * LUMA_BLUE,
+				0.0F,
+				0.0F,
+				0.0F,
+				0.0F,
+				1.0F};
+
+			auto k{static_cast<float>(m_saturation) + 1.0F};
+			auto r{(1.0F - k) * LUMA_RED};
+			auto g{(1.0F - k) * LUMA_GREEN};
+			auto b{(1.0F - k) * LUMA_BLUE};
+			QMatrix4x4 saturation{r + k,
+				g,
+				b,
+				0.0F,
+				r,
+				g + k,
+				b,
+				0.0F,
+				r,
+				g,
+				b + k,
+				0.0F,
+				0.0F,
+				0.0F,
+				0.0F,
+				1.0F};
+
+			auto contrast{static_cast<float>(m_contrast) + 1.0F};
+			auto offset{0.5F * (1.0F - contrast)
+				+ static_cast<float>(m_brightness)};
+			QMatrix4x4 levels{contrast,
+				0.0F,
+				0.0F,
+				offset,
+				0.0F,
+				contrast,
+				0.0F,
+				offset,
+				0.0F,
+				0.0F,
+				contrast,
+				offset,
+				0.0F,
+				0.0F,
+				0.0F,
+				1.0F};
+
+			auto adjusted{!qFuzzyIsNull(m_hue) || !qFuzzyIsNull(m_saturation)
+				|| !qFuzzyIsNull(m_contrast) || !qFuzzyIsNull(m_brightness)};
+			m_output->setProperty("colorMatrix", levels * saturation * hue);
+			m_output->setProperty("adjusted", adjusted);
+			/* Shader effects do not exist in the software renderer */
+			if(adjusted && !softwareWarned
+				&& QQuickWindow::graphicsApi()
+					== QSGRendererInterface::Software) {
+				softwareWarned = true;
+				qWarning() << "Brightness, contrast, hue and saturation have "
+							  "no effect with the software renderer of Qt "
+							  "Quick";
+			}
+		}
+
+		static inline bool softwareWarned{};
+
 		QVideoSink* m_sink;
-		QObject* m_effect;
+		QObject* m_output;
+		/* Render thread */
+		QElapsedTimer m_frameClock;
 		qreal m_hue{};
 		qreal m_saturation{};
 		qreal m_brightness{};
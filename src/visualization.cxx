@@ -0,0 +1,338 @@
+module;
+
+#include <QAudioBuffer>
+#include <QAudioBufferOutput>
+#include <QMediaPlayer>
+#include <QMutex>
+#include <QPointer>
+#include <QThread>
+#include <QTimer>
+#include <QVariantMap>
+#include <QtCore/qtmochelpers.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <numbers>
+#include <tuple>
+
+#define FRAME_RATE 30
+#define FFT_SIZE 2048
+#define BAND_COUNT 32
+#define TAP_CAPACITY 64
+#define LOWEST_FREQUENCY 20.0
+#define INT16_RANGE 32768.0F
+#define USEC 1'000'000
+
+export module phonon_native:visualization;
+
+import :audiotap;
+import :deinterleave;
+import :fft;
+import :ringbuffer;
+import :sinknode;
+
+using Qt::Literals::StringLiterals::operator""_L1;
+
+export namespace Phonon::Native {
+	struct Spectrum {
+		/* Magnitude of each FFT bin, 1.0 for a full scale sine */
+		QList<float> magnitudes;
+		/* Peak and RMS of the bins in logarithmically spaced bands */
+		QList<float> bandPeaks;
+		QList<float> bandRms;
+		/* Media time of the end of the analysed audio in microseconds */
+		qint64 time{};
+	};
+
+	/* Mixes the tapped audio down to mono and analyses the latest
+	 * samples through a Hann window. */
+	class SpectrumAnalyzer final {
+	  public:
+		SpectrumAnalyzer(qsizetype size, int bands):
+			m_fft{size}, m_history(m_fft.size()), m_window(m_fft.size()),
+			m_windowed(m_fft.size()), m_magnitudes(m_fft.size() / 2),
+			m_bands{qMax(1, bands)} {
+			auto length{static_cast<double>(m_fft.size())};
+			double sum{};
+			for(qsizetype i{0}; i < m_window.size(); i++) {
+				auto angle{
+					2.0 * std::numbers::pi * static_cast<double>(i) / length};
+				auto value{0.5 - 0.5 * std::cos(angle)};
+				m_window[i] = static_cast<float>(value);
+				sum += value;
+			}
+			m_scale = static_cast<float>(2.0 / sum);
+		}
+
+		~SpectrumAnalyzer() = default;
+		SpectrumAnalyzer(const SpectrumAnalyzer&) = delete;
+		SpectrumAnalyzer(SpectrumAnalyzer&&) = delete;
+		auto operator=(const SpectrumAnalyzer&) -> SpectrumAnalyzer& = delete;
+		auto operator=(SpectrumAnalyzer&&) -> SpectrumAnalyzer& = delete;
+
+		auto append(const QAudioBuffer& buffer) -> void {
+			auto channels{buffer.format().channelCount()};
+			auto frames{buffer.frameCount()};
+			if(channels <= 0 || frames <= 0) {
+				return;
+			}
+			if(buffer.format().sampleRate() != m_rate) {
+				m_rate = buffer.format().sampleRate();
+				updateBands();
+			}
+			m_time = buffer.startTime() + frames * USEC / qMax(1, m_rate);
+
+			m_channels.resize(channels);
+			QList<qint16*> outputs(channels);
+			for(auto i{0}; i < channels; i++) {
+				m_channels[i].resize(frames);
+				outputs[i] = m_channels[i].data();
+			}
+			deinterleave(buffer,
+				frames,
+				{outputs.constData(), static_cast<size_t>(outputs.size())});
+
+			/* Keep the latest samples at the end of the history */
+			auto size{m_history.size()};
+			auto count{qMin(frames, size)};
+			std::copy(m_history.begin() + count,
+				m_history.end(),
+				m_history.begin());
+			auto scale{1.0F / (INT16_RANGE * static_cast<float>(channels))};
+			for(qsizetype i{0}; i < count; i++) {
+				auto frame{frames - count + i};
+				float sum{};
+				for(auto channel{0}; channel < channels; channel++) {
+					sum += m_channels[channel][frame];
+				}
+				m_history[size - count + i] = sum * scale;
+			}
+		}
+
+		auto analyze(Spectrum& result) -> void {
+			for(qsizetype i{0}; i < m_history.size(); i++) {
+				m_windowed[i] = m_history[i] * m_window[i];
+			}
+			m_fft.magnitudes(m_windowed.constData(), m_magnitudes.data());
+			result.magnitudes.resize(m_magnitudes.size());
+			for(qsizetype i{0}; i < m_magnitudes.size(); i++) {
+				result.magnitudes[i] = m_magnitudes[i] * m_scale;
+			}
+			result.bandPeaks.resize(m_bands);
+			result.bandRms.resize(m_bands);
+			for(auto band{0}; band < m_bands; band++) {
+				auto first{m_edges[band]};
+				auto last{qMax(m_edges[band + 1], first + 1)};
+				float peak{};
+				float energy{};
+				for(auto bin{first}; bin < last; bin++) {
+					auto value{result.magnitudes[bin]};
+					peak = qMax(peak, value);
+					energy += value * value;
+				}
+				result.bandPeaks[band] = peak;
+				result.bandRms[band] =
+					std::sqrt(energy / static_cast<float>(last - first));
+			}
+			result.time = m_time;
+		}
+
+	  private:
+		/* First bin of each band, spaced logarithmically from 20 Hz to
+		 * the Nyquist frequency */
+		auto updateBands() -> void {
+			auto bins{m_magnitudes.size()};
+			auto nyquist{qMax(1, m_rate) / 2.0};
+			auto lowest{qMin(LOWEST_FREQUENCY, nyquist / 2)};
+			m_edges.resize(m_bands + 1);
+			for(auto band{0}; band <= m_bands; band++) {
+				auto frequency{lowest
+					* std::pow(nyquist / lowest,
+						static_cast<double>(band) / m_bands)};
+				m_edges[band] = qBound<qsizetype>(1,
+					static_cast<qsizetype>(
+						frequency / nyquist * static_cast<double>(bins)),
+					bins - 1);
+			}
+		}
+
+		RealFft m_fft;
+		QList<float> m_history;
+		QList<float> m_window;
+		QList<float> m_windowed;
+		QList<float> m_magnitudes;
+		QList<QList<qint16>> m_channels;
+		QList<qsizetype> m_edges;
+		float m_scale{};
+		int m_bands;
+		int m_rate{};
+		qint64 m_time{};
+	};
+
+	/* Spectrum analyser fed from the rendered audio of the media object it
+	 * is connected to. Analysis runs on a worker thread at a fixed frame
+	 * rate, finished frames are published through a double buffer. */
+	class Visualization final: public QObject, public SinkNode {
+		Q_OBJECT
+		Q_PROPERTY(int frameRate READ frameRate WRITE setFrameRate)
+		Q_PROPERTY(int fftSize READ fftSize WRITE setFftSize)
+		Q_PROPERTY(int bandCount READ bandCount WRITE setBandCount)
+
+	  public:
+		explicit Visualization(QObject* parent):
+			QObject{parent}, m_worker{new QObject{}},
+			m_timer{new QTimer{m_worker}}, m_buffers{TAP_CAPACITY},
+			m_analyzer{std::make_unique<SpectrumAnalyzer>(
+				m_fftSize, m_bandCount)} {
+			m_timer->setInterval(1000 / m_frameRate);
+			connect(
+				m_timer,
+				&QTimer::timeout,
+				m_worker,
+				[=, this]() { analyze(); },
+				Qt::AutoConnection);
+			m_worker->moveToThread(&m_thread);
+			m_thread.setObjectName("Visualization"_L1);
+			m_thread.start(QThread::LowPriority);
+		}
+
+		~Visualization() final {
+			if(m_tap) {
+				disconnect(m_tap, nullptr, this, nullptr);
+			}
+			m_worker->deleteLater();
+			m_thread.quit();
+			m_thread.wait();
+		}
+
+		Visualization(const Visualization&) = delete;
+		Visualization(Visualization&&) = delete;
+		auto operator=(const Visualization&) -> Visualization& = delete;
+		auto operator=(Visualization&&) -> Visualization& = delete;
+
+		auto connectToMediaPlayer(QMediaPlayer* player) -> void final {
+			m_tap = AudioTap::of(player);
+			connect(
+				m_tap,
+				&QAudioBufferOutput::audioBufferReceived,
+				this,
+				[=, this](const QAudioBuffer& buffer) {
+					/* Dropped while the worker is behind */
+					std::ignore = m_buffers.push(buffer);
+				},
+				Qt::DirectConnection);
+			/* Analyses only while connected */
+			QMetaObject::invokeMethod(
+				m_timer, qOverload<>(&QTimer::start), Qt::QueuedConnection);
+			SinkNode::connectToMediaPlayer(player);
+		}
+
+		auto disconnectFromMediaPlayer(QMediaPlayer* player) -> void final {
+			if(m_tap) {
+				disconnect(m_tap, nullptr, this, nullptr);
+				m_tap = nullptr;
+			}
+			QMetaObject::invokeMethod(
+				m_timer, &QTimer::stop, Qt::QueuedConnection);
+			SinkNode::disconnectFromMediaPlayer(player);
+		}
+
+		/* The latest frame as {time, magnitudes, bandPeaks, bandRms} */
+		[[nodiscard]]
+		Q_INVOKABLE auto frame() const -> QVariantMap {
+			QMutexLocker locker{&m_frontMutex};
+			const auto& spectrum{m_frames[m_front]};
+			return {{"time"_L1, spectrum.time},
+				{"magnitudes"_L1, QVariant::fromValue(spectrum.magnitudes)},
+				{"bandPeaks"_L1, QVariant::fromValue(spectrum.bandPeaks)},
+				{"bandRms"_L1, QVariant::fromValue(spectrum.bandRms)}};
+		}
+
+		[[nodiscard]]
+		auto frameRate() const -> int {
+			return m_frameRate;
+		}
+
+		auto setFrameRate(int rate) -> void {
+			m_frameRate = qBound(1, rate, 1000);
+			QMetaObject::invokeMethod(
+				m_timer,
+				[=, this, interval = 1000 / m_frameRate]() {
+					m_timer->setInterval(interval);
+				},
+				Qt::QueuedConnection);
+		}
+
+		[[nodiscard]]
+		auto fftSize() const -> int {
+			return m_fftSize;
+		}
+
+		/* Rounded up to a power of two */
+		auto setFftSize(int size) -> void {
+			m_fftSize = qBound(64, size, 1 << 16);
+			resetAnalyzer();
+		}
+
+		[[nodiscard]]
+		auto bandCount() const -> int {
+			return m_bandCount;
+		}
+
+		auto setBandCount(int count) -> void {
+			m_bandCount = qBound(1, count, 1024);
+			resetAnalyzer();
+		}
+
+	  signals:
+		/* Emitted from the worker thread */
+		auto frameChanged() -> void;
+
+	  private:
+		auto resetAnalyzer() -> void {
+			QMetaObject::invokeMethod(
+				m_worker,
+				[=, this, size = m_fftSize, bands = m_bandCount]() {
+					m_analyzer =
+						std::make_unique<SpectrumAnalyzer>(size, bands);
+				},
+				Qt::QueuedConnection);
+		}
+
+		/* Worker thread */
+		auto analyze() -> void {
+			auto received{false};
+			while(auto buffer{m_buffers.pop()}) {
+				m_analyzer->append(*buffer);
+				received = true;
+			}
+			if(!received) {
+				return;
+			}
+			auto back{1 - m_front};
+			m_analyzer->analyze(m_frames[back]);
+			{
+				QMutexLocker locker{&m_frontMutex};
+				m_front = back;
+			}
+			emit frameChanged();
+		}
+
+		QThread m_thread;
+		QObject* m_worker;
+		QTimer* m_timer;
+		QPointer<QAudioBufferOutput> m_tap;
+		RingBuffer<QAudioBuffer> m_buffers;
+		int m_frameRate{FRAME_RATE};
+		int m_fftSize{FFT_SIZE};
+		int m_bandCount{BAND_COUNT};
+		/* Owned by the worker thread */
+		std::unique_ptr<SpectrumAnalyzer> m_analyzer;
+		std::array<Spectrum, 2> m_frames;
+		int m_front{};
+		mutable QMutex m_frontMutex;
+	};
+} // namespace Phonon::Native
+
+#include "visualization.moc"
@@ -1,112 +1,181 @@
 module;
 
-#include <QAudioOutput>
 #include <QMediaPlayer>
-#include <QTimeLine>
+#include <QPointer>
 #include <QtCore/qtmochelpers.h>
+#include <atomic>
+#include <cmath>
 #include <phonon/VolumeFaderInterface>
 
+#define LANES 4
+#define MSEC 1000
+
 export module phonon_native:volumefadereffect;
 
+import :dsp;
+import :effectchain;
 import :sinknode;
 
 export namespace Phonon::Native {
+	/* Fades run as a gain ramp evaluated for every frame on the audio thread
+	 * of the effect chain, so their timing follows the rendered audio and
+	 * not the event loop. Fades are handed over through a sequence lock. */
 	class VolumeFaderEffect final:
 		public QObject,
 		public VolumeFaderInterface,
-		public SinkNode {
+		public SinkNode,
+		public AudioProcessor {
 		Q_OBJECT
 		Q_INTERFACES(Phonon::VolumeFaderInterface)
 
-	  private slots:
-
-		auto slotSetVolume(qreal volume) -> void {
-			m_output->setVolume(
-				m_fadeFromVolume
-				+ (static_cast<float>(volume)
-					* (static_cast<float>(m_fadeToVolume) - m_fadeFromVolume)));
-		}
-
 	  public:
-		explicit VolumeFaderEffect(QObject* parent):
-			QObject{parent}, m_fadeTimeline{new QTimeLine{1000, this}} {
-			connect(m_fadeTimeline,
-				&QTimeLine::valueChanged,
-				this,
-				&VolumeFaderEffect::slotSetVolume,
-				Qt::AutoConnection);
+		explicit VolumeFaderEffect(QObject* parent): QObject{parent} {}
+
+		~VolumeFaderEffect() final {
+			if(m_chain) {
+				m_chain->remove(this);
+			}
 		}
 
-		~VolumeFaderEffect() final = default;
 		VolumeFaderEffect(const VolumeFaderEffect&) = delete;
 		VolumeFaderEffect(VolumeFaderEffect&&) = delete;
 		auto operator=(const VolumeFaderEffect&) -> VolumeFaderEffect& = delete;
 		auto operator=(VolumeFaderEffect&&) -> VolumeFaderEffect& = delete;
 
+		/* The gain reached by the audio thread */
 		virtual float volume() const final {
-			return m_output->volume();
+			return m_volume.load(std::memory_order_relaxed);
 		}
 
 		virtual void setVolume(float volume) final {
-			m_fadeTimeline->stop();
-			m_output->setVolume(volume);
+			fadeTo(volume, 0);
 		}
 
 		virtual Phonon::VolumeFaderEffect::FadeCurve fadeCurve() const final {
-			return m_fadeCurve;
+			return m_fadeCurve.load(std::memory_order_relaxed);
 		}
 
 		virtual void setFadeCurve(
 			Phonon::VolumeFaderEffect::FadeCurve pFadeCurve) final {
-			m_fadeCurve = pFadeCurve;
-			QEasingCurve fadeCurve;
-			switch(pFadeCurve) {
-				case Phonon::VolumeFaderEffect::Fade3Decibel:
-					fadeCurve = QEasingCurve::InQuad;
-					break;
-				case Phonon::VolumeFaderEffect::Fade6Decibel:
-					fadeCurve = QEasingCurve::Linear;
-					break;
-				case Phonon::VolumeFaderEffect::Fade9Decibel:
-					fadeCurve = QEasingCurve::OutCubic;
-					break;
-				case Phonon::VolumeFaderEffect::Fade12Decibel:
-					fadeCurve = QEasingCurve::OutQuart;
-					break;
-			}
-			m_fadeTimeline->setEasingCurve(fadeCurve);
+			m_fadeCurve.store(pFadeCurve, std::memory_order_relaxed);
 		}
 
 		virtual void fadeTo(float targetVolume, int fadeTime) final {
-			m_fadeTimeline->stop();
-			m_fadeToVolume = static_cast<qreal>(targetVolume);
-			m_fadeFromVolume = m_output->volume();
-
 			if(fadeTime <= 0) {
-				setVolume(targetVolume);
-				return;
+				m_volume.store(targetVolume, std::memory_order_relaxed);
 			}
-
-			m_fadeTimeline->setDuration(fadeTime);
-			m_fadeTimeline->start();
+			/* Only the thread of the object writes */
+			auto sequence{m_sequence.load(std::memory_order_relaxed)};
+			m_sequence.store(sequence + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			m_target.store(targetVolume, std::memory_order_relaxed);
+			m_fadeTime.store(qMax(0, fadeTime), std::memory_order_relaxed);
+			m_sequence.store(sequence + 2, std::memory_order_release);
 		}
 
 		auto connectToMediaPlayer(QMediaPlayer* player) -> void final {
-			m_output = player->audioOutput();
+			m_chain = EffectChain::of(player);
+			m_chain->insert(this);
 			SinkNode::connectToMediaPlayer(player);
 		}
 
 		auto disconnectFromMediaPlayer(QMediaPlayer* player) -> void final {
-			m_output = nullptr;
+			if(m_chain) {
+				m_chain->remove(this);
+				m_chain = nullptr;
+			}
 			SinkNode::disconnectFromMediaPlayer(player);
 		}
 
+		/* Audio thread */
+		auto process(float* frames, qsizetype count, int groups, int rate)
+			-> void final {
+			receiveFade(rate);
+			if(m_position >= m_length) {
+				/* Fades without length end before the first frame */
+				m_gain = m_to;
+				if(m_gain == 1.0F) {
+					m_volume.store(m_gain, std::memory_order_relaxed);
+					return;
+				}
+			}
+			auto stride{groups * LANES};
+			auto curve{m_fadeCurve.load(std::memory_order_relaxed)};
+			for(qsizetype frame{0}; frame < count; frame++) {
+				if(m_position < m_length) {
+					auto progress{static_cast<float>(m_position)
+						/ static_cast<float>(m_length)};
+					/* The curve is mirrored for fades out so that both
+					 * directions pass the same level at the midpoint */
+					m_gain = m_to >= m_from
+						? m_from + shape(curve, progress) * (m_to - m_from)
+						: m_to
+							+ shape(curve, 1.0F - progress) * (m_from - m_to);
+					m_position++;
+				} else {
+					m_gain = m_to;
+				}
+				auto gain{Float4::broadcast(m_gain)};
+				auto* samples{frames + frame * stride};
+				for(auto group{0}; group < groups; group++) {
+					(Float4::load(samples + group * LANES) * gain)
+						.store(samples + group * LANES);
+				}
+			}
+			m_volume.store(m_gain, std::memory_order_relaxed);
+		}
+
 	  private:
-		QAudioOutput* m_output;
-		QTimeLine* m_fadeTimeline;
-		qreal m_fadeToVolume;
-		float m_fadeFromVolume;
-		Phonon::VolumeFaderEffect::FadeCurve m_fadeCurve;
+		/* Gain of a fade in at the progress, 3, 6, 9 or 12 dB below full
+		 * scale at the midpoint as documented for the curves */
+		static auto shape(Phonon::VolumeFaderEffect::FadeCurve curve,
+			float progress) -> float {
+			switch(curve) {
+				case Phonon::VolumeFaderEffect::Fade3Decibel:
+					return std::sqrt(progress);
+				case Phonon::VolumeFaderEffect::Fade6Decibel:
+					return progress;
+				case Phonon::VolumeFaderEffect::Fade9Decibel:
+					return progress * std::sqrt(progress);
+				case Phonon::VolumeFaderEffect::Fade12Decibel:
+					return progress * progress;
+			}
+			return progress;
+		}
+
+		/* Starts the latest fade from the gain reached so far */
+		auto receiveFade(int rate) -> void {
+			auto sequence{m_sequence.load(std::memory_order_acquire)};
+			if(sequence == m_received || sequence % 2 != 0) {
+				return;
+			}
+			auto target{m_target.load(std::memory_order_relaxed)};
+			auto fadeTime{m_fadeTime.load(std::memory_order_relaxed)};
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(m_sequence.load(std::memory_order_relaxed) != sequence) {
+				return;
+			}
+			m_received = sequence;
+			m_from = m_gain;
+			m_to = target;
+			m_length = static_cast<qint64>(fadeTime) * rate / MSEC;
+			m_position = 0;
+		}
+
+		QPointer<EffectChain> m_chain;
+		std::atomic<float> m_volume{1.0F};
+		std::atomic<Phonon::VolumeFaderEffect::FadeCurve> m_fadeCurve{
+			Phonon::VolumeFaderEffect::Fade3Decibel};
+		std::atomic<quint32> m_sequence{};
+		std::atomic<float> m_target{1.0F};
+		std::atomic<int> m_fadeTime{};
+		/* Owned by the audio thread */
+		quint32 m_received{};
+		float m_gain{1.0F};
+		float m_from{1.0F};
+		float m_to{1.0F};
+		qint64 m_length{};
+		qint64 m_position{};
 	};
 } // namespace Phonon::Native
 
@@ -0,0 +1,125 @@
+#include <QAudioBuffer>
+#include <QAudioBufferOutput>
+#include <QAudioFormat>
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QMap>
+#include <QMediaPlayer>
+#include <QVariantList>
+#include <QVector>
+#include <cmath>
+#include <numbers>
+#include <phonon/AudioDataOutput>
+
+#define SAMPLE_RATE 44'100
+#define CHANNELS 2
+#define BUFFER_FRAMES 4096
+#define DATA_SIZE 512
+#define BATCH 16
+#define HOURS 2
+#define SEGMENTS 12
+#define FREQUENCY 440.0
+#define AMPLITUDE 16'000.0
+#define USEC 1'000'000
+#define KIB 1024
+#define NSEC_PER_USEC 1000.0
+
+import phonon_native;
+import phonon_native_testing;
+
+using namespace Phonon::Native;
+using namespace Phonon::Native::Testing;
+using Qt::Literals::StringLiterals::operator""_L1;
+
+namespace {
+	using Block = QMap<Phonon::AudioDataOutput::Channel, QVector<qint16>>;
+
+	/* One buffer of a stereo sine, shared by all buffers of the stream */
+	auto sine() -> QByteArray {
+		QByteArray data(BUFFER_FRAMES * CHANNELS * 2, Qt::Uninitialized);
+		auto* samples{reinterpret_cast<qint16*>(data.data())};
+		for(auto frame{0}; frame < BUFFER_FRAMES; frame++) {
+			auto value{static_cast<qint16>(std::lround(AMPLITUDE
+				* std::sin(2.0 * std::numbers::pi * FREQUENCY
+					* static_cast<double>(frame) / SAMPLE_RATE)))};
+			samples[frame * CHANNELS] = value;
+			samples[frame * CHANNELS + 1] = value;
+		}
+		return data;
+	}
+} // namespace
+
+/* Streams HOURS of audio through an AudioDataOutput as fast as it takes
+ * it. The buffers are emitted by the tap of a player like its renderer
+ * does, the delivery runs in this thread between batches. The peak RSS
+ * of the process before and after is compared with the size of the whole
+ * stream decoded into memory. The cost per buffer is given for each of
+ * SEGMENTS parts of the stream, it stays flat from start to end. */
+auto main(int argc, char** argv) -> int {
+	Harness::prepare();
+	QGuiApplication application{argc, argv};
+	Harness harness{"audioDataOutput"_L1, false};
+
+	QAudioFormat format;
+	format.setSampleRate(SAMPLE_RATE);
+	format.setChannelCount(CHANNELS);
+	format.setSampleFormat(QAudioFormat::Int16);
+	format.setChannelConfig(QAudioFormat::ChannelConfigStereo);
+	auto data{sine()};
+
+	QMediaPlayer player;
+	AudioDataOutput output{nullptr};
+	output.setDataSize(DATA_SIZE);
+	output.connectToMediaPlayer(&player);
+	auto* tap{AudioTap::of(&player)};
+	qint64 blocks{};
+	QObject::connect(
+		&output,
+		&AudioDataOutput::dataReady,
+		&output,
+		[&](const Block& /*block*/) { blocks++; },
+		Qt::DirectConnection);
+
+	auto before{Harness::peakMemory()};
+	qint64 frames{qint64{HOURS} * 3600 * SAMPLE_RATE};
+	auto segment{frames / SEGMENTS};
+	qint64 buffers{};
+	qint64 segmentBuffers{};
+	QVariantList costs;
+	QElapsedTimer clock;
+	clock.start();
+	for(qint64 frame{0}; frame < frames; frame += BUFFER_FRAMES) {
+		emit tap->audioBufferReceived(
+			QAudioBuffer{data, format, frame * USEC / SAMPLE_RATE});
+		segmentBuffers++;
+		if(++buffers % BATCH == 0) {
+			QCoreApplication::processEvents();
+		}
+		/* µs per buffer of the segment that ends here */
+		if((frame + BUFFER_FRAMES) / segment != frame / segment
+			|| frame + BUFFER_FRAMES >= frames) {
+			QCoreApplication::processEvents();
+			costs << static_cast<double>(clock.nsecsElapsed()) / NSEC_PER_USEC
+					/ static_cast<double>(segmentBuffers);
+			segmentBuffers = 0;
+			clock.start();
+		}
+	}
+	auto after{Harness::peakMemory()};
+
+	auto& report{harness.report()};
+	report.set("hours"_L1, HOURS);
+	report.set("buffers"_L1, buffers);
+	report.set("blocks"_L1, blocks);
+	/* KiB */
+	report.set("peakRssBefore"_L1, before);
+	report.set("peakRssAfter"_L1, after);
+	report.set("peakRssGrowth"_L1, after - before);
+	report.set("wholeStreamDecoded"_L1, frames * CHANNELS * 2 / KIB);
+	report.set("bufferCost"_L1, costs);
+	report.set("lastToFirstCost"_L1,
+		costs.last().toDouble() / costs.first().toDouble());
+	return harness.finish();
+}
@@ -0,0 +1,192 @@
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QtEndian>
+#include <tuple>
+
+#define SOURCE_LENGTH 6000
+#define FREQUENCY 440.0
+#define FRAME_RATE 25
+#define PATTERN_WIDTH 64
+#define PATTERN_HEIGHT 48
+#define SAMPLE_RATE 44'100
+#define MSEC 1000
+#define CHPL_UNIT 10'000'000
+
+import phonon_native;
+import phonon_native_testing;
+
+using namespace Phonon::Native;
+using namespace Phonon::Native::Testing;
+using Qt::Literals::StringLiterals::operator""_L1;
+using Qt::Literals::StringLiterals::operator""_ba;
+
+namespace {
+	using Chapters = ChapterReader::Chapters;
+
+	/* Three chapters at the thirds of the source, in seconds */
+	auto thirds() -> Chapters {
+		return {{0.0F, 2.0F}, {2.0F, 4.0F}, {4.0F, 6.0F}};
+	}
+
+	template<typename T>
+	auto appendBig(QByteArray& data, T value) -> void {
+		data.resize(data.size() + sizeof(T));
+		qToBigEndian(value, data.data() + data.size() - sizeof(T));
+	}
+
+	template<typename T>
+	auto appendLittle(QByteArray& data, T value) -> void {
+		data.resize(data.size() + sizeof(T));
+		qToLittleEndian(value, data.data() + data.size() - sizeof(T));
+	}
+
+	auto box(const char* type, const QByteArray& payload) -> QByteArray {
+		QByteArray result;
+		appendBig<quint32>(result, payload.size() + 8);
+		return result + type + payload;
+	}
+
+	/* An MP4 without tracks whose chapters are in a Nero chpl box */
+	auto mp4File() -> QByteArray {
+		QByteArray mvhd(4 + 4 + 4, '\0');
+		appendBig<quint32>(mvhd, MSEC);
+		appendBig<quint32>(mvhd, SOURCE_LENGTH);
+		mvhd.resize(100, '\0');
+
+		QByteArray chpl(4, '\0');
+		auto starts{thirds()};
+		chpl += static_cast<char>(starts.size());
+		for(const auto& chapter: starts) {
+			appendBig<quint64>(
+				chpl, static_cast<quint64>(chapter.first) * CHPL_UNIT);
+			chpl += '\x01';
+			chpl += 'C';
+		}
+		return box("ftyp", "isom\0\0\0\0isom"_ba)
+			+ box("moov", box("mvhd", mvhd) + box("udta", box("chpl", chpl)));
+	}
+
+	auto page(quint64 granule, char type, const QByteArray& packet)
+		-> QByteArray {
+		QByteArray result{"OggS\0"_ba};
+		result += type;
+		appendLittle<quint64>(result, granule);
+		appendLittle<quint32>(result, 1);
+		appendLittle<quint32>(result, 0);
+		appendLittle<quint32>(result, 0);
+		if(packet.isEmpty()) {
+			result += '\0';
+			return result;
+		}
+		result += '\x01';
+		result += static_cast<char>(packet.size());
+		return result + packet;
+	}
+
+	/* The headers of an Ogg Vorbis stream and a last page for the
+	 * duration, the CRCs are not checked by the reader */
+	auto oggFile() -> QByteArray {
+		QByteArray identification{"\x01vorbis"_ba};
+		appendLittle<quint32>(identification, 0);
+		identification += '\x02';
+		appendLittle<quint32>(identification, SAMPLE_RATE);
+		identification += QByteArray(12, '\0');
+		identification += "\xB8\x01"_ba;
+
+		QByteArray comments{"\x03vorbis"_ba};
+		appendLittle<quint32>(comments, 4);
+		comments += "test"_ba;
+		QList<QByteArray> marks{"CHAPTER001=00:00:00.000"_ba,
+			"CHAPTER001NAME=One"_ba,
+			"CHAPTER002=00:00:02.000"_ba,
+			"CHAPTER003=00:00:04.000"_ba};
+		appendLittle<quint32>(comments, marks.size());
+		for(const auto& mark: marks) {
+			appendLittle<quint32>(comments, mark.size());
+			comments += mark;
+		}
+		comments += '\x01';
+
+		return page(0, '\x02', identification) + page(0, '\0', comments)
+			+ page(quint64{SOURCE_LENGTH} * SAMPLE_RATE / MSEC, '\x04', {});
+	}
+} // namespace
+
+/* Chapter marks read straight from the containers, the ones the media
+ * generator writes and minimal MP4 and Ogg files built here */
+class ChapterReaderTest final: public QObject {
+	Q_OBJECT
+
+  private slots:
+	auto initTestCase() -> void {
+		QVERIFY(m_directory.isValid());
+	}
+
+	/* Neither carries chapters the reader knows of */
+	auto wav() -> void {
+		auto url{m_media.tone("tone.wav"_L1, SOURCE_LENGTH, FREQUENCY)};
+		QVERIFY(!ChapterReader::read(url.toLocalFile()));
+	}
+
+	auto avi() -> void {
+		auto url{m_media.testPattern("pattern.avi"_L1,
+			SOURCE_LENGTH,
+			{PATTERN_WIDTH, PATTERN_HEIGHT},
+			FRAME_RATE)};
+		QVERIFY(!ChapterReader::read(url.toLocalFile()));
+	}
+
+	auto flac() -> void {
+		auto url{m_media.chapters("chapters.flac"_L1,
+			SOURCE_LENGTH,
+			{0, SOURCE_LENGTH / 3, SOURCE_LENGTH * 2 / 3})};
+		compare(url.toLocalFile());
+	}
+
+	auto mp4() -> void {
+		compare(write("chapters.mp4"_L1, mp4File()));
+	}
+
+	auto ogg() -> void {
+		compare(write("chapters.ogg"_L1, oggFile()));
+	}
+
+	/* Cut off in the middle of the chapters */
+	auto truncated() -> void {
+		for(const auto& data: {mp4File(), oggFile()}) {
+			for(auto size{data.size() - 1}; size > 0; size -= 7) {
+				std::ignore = ChapterReader::read(
+					write("truncated"_L1, data.first(size)));
+			}
+		}
+	}
+
+  private:
+	static auto compare(const QString& path) -> void {
+		auto chapters{ChapterReader::read(path)};
+		QVERIFY(chapters);
+		QCOMPARE(*chapters, thirds());
+	}
+
+	auto write(const QString& name, const QByteArray& data) -> QString {
+		auto path{m_directory.filePath(name)};
+		QFile file{path};
+		if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+			return {};
+		}
+		file.write(data);
+		return path;
+	}
+
+	QTemporaryDir m_directory;
+	MediaGenerator m_media{m_directory.path()};
+};
+
+QTEST_GUILESS_MAIN(ChapterReaderTest)
+
+#include "chapterreadertest.moc"
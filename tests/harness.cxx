@@ -0,0 +1,267 @@
+module;
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QPluginLoader>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QVariantMap>
+#include <QtCore/qtmochelpers.h>
+#include <ctime>
+#include <functional>
+#include <phonon/backendinterface.h>
+#include <phonon/phononnamespace.h>
+#include <utility>
+
+#define DEFAULT_ITERATIONS 5
+#define WAIT_TIMEOUT 10'000
+#define NSEC_PER_USEC 1000
+
+export module phonon_native_testing:harness;
+
+import :mediagenerator;
+import :report;
+
+using Qt::Literals::StringLiterals::operator""_L1;
+using Qt::Literals::StringLiterals::operator""_ba;
+
+export namespace Phonon::Native::Testing {
+	/* Timestamps the emissions of a signal of a backend object, connected
+	 * by its signature like the frontend does. The filter is given the
+	 * arguments and decides which emissions count, e.g. only the changes
+	 * into a certain state. */
+	class SignalProbe final: public QObject {
+		Q_OBJECT
+
+	  public:
+		using Filter = std::function<bool(const QList<QVariant>&)>;
+
+		SignalProbe(QObject* sender, const char* signal, Filter filter = {}):
+			m_spy{sender, signal}, m_filter{std::move(filter)} {
+			/* After the spy, which stores the arguments first */
+			connect(sender, signal, this, SLOT(record()), Qt::DirectConnection);
+			m_clock.start();
+		}
+
+		~SignalProbe() final = default;
+		SignalProbe(const SignalProbe&) = delete;
+		SignalProbe(SignalProbe&&) = delete;
+		auto operator=(const SignalProbe&) -> SignalProbe& = delete;
+		auto operator=(SignalProbe&&) -> SignalProbe& = delete;
+
+		/* Forgets the emissions so far and restarts the clock */
+		auto arm() -> void {
+			m_spy.clear();
+			m_times.clear();
+			m_clock.start();
+		}
+
+		/* Runs the event loop until the signal was emitted after arm() */
+		[[nodiscard]]
+		auto wait(int timeout = WAIT_TIMEOUT) const -> bool {
+			return QTest::qWaitFor(
+				[this]() { return !m_times.isEmpty(); }, timeout);
+		}
+
+		/* µs from arm() to the first emission, -1 if there was none */
+		[[nodiscard]]
+		auto first() const -> qint64 {
+			return m_times.isEmpty() ? -1 : m_times.first();
+		}
+
+		[[nodiscard]]
+		auto count() const -> qsizetype {
+			return m_times.size();
+		}
+
+	  public slots:
+		auto record() -> void {
+			if(!m_filter || m_filter(m_spy.last())) {
+				m_times << m_clock.nsecsElapsed() / NSEC_PER_USEC;
+			}
+		}
+
+	  private:
+		QSignalSpy m_spy;
+		Filter m_filter;
+		QElapsedTimer m_clock;
+		QList<qint64> m_times;
+	};
+
+	/* Filter for stateChanged(): paused, or playing right away, once the
+	 * media is loaded */
+	auto loadedState(const QList<QVariant>& arguments) -> bool {
+		auto state{arguments.first().value<State>()};
+		return state == PausedState || state == PlayingState;
+	}
+
+	/* Loads the plugin like Phonon does, generates the media into a
+	 * temporary directory and writes the report of a benchmark. Runs
+	 * headless: the offscreen platform is used unless another one is set
+	 * and no audio output is ever created, the players render into a null
+	 * device. Benchmarks of single units run without the plugin. Takes
+	 * --output <file>, --iterations <count> and --plugin <file>, the
+	 * latter to compare with a build of another revision. */
+	class Harness final {
+	  public:
+		/* Must run before the application object is created */
+		static auto prepare() -> void {
+			if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+				qputenv("QT_QPA_PLATFORM", "offscreen"_ba);
+			}
+			/* Keeps the caches of the backend out of the home directory */
+			QStandardPaths::setTestModeEnabled(true);
+		}
+
+		explicit Harness(const QString& name, bool loadBackend = true):
+			m_report{name}, m_media{m_directory.path()} {
+			QCommandLineParser parser;
+			QCommandLineOption output{
+				"output"_L1, "Report file, - for stdout"_L1, "file"_L1};
+			QCommandLineOption iterations{"iterations"_L1,
+				"Repetitions of each measurement"_L1,
+				"count"_L1,
+				QString::number(DEFAULT_ITERATIONS)};
+			QCommandLineOption plugin{"plugin"_L1,
+				"Backend to load instead of the one of this build"_L1,
+				"file"_L1,
+				QString::fromUtf8(PHONON_NATIVE_PLUGIN)};
+			parser.addOptions({output, iterations, plugin});
+			parser.addHelpOption();
+			parser.process(*QCoreApplication::instance());
+			m_output = parser.value(output);
+			m_iterations = qMax(1, parser.value(iterations).toInt());
+			if(!loadBackend) {
+				return;
+			}
+
+			m_loader.setFileName(parser.value(plugin));
+			m_backendObject = m_loader.instance();
+			m_backend = qobject_cast<BackendInterface*>(m_backendObject);
+			if(!m_backend) {
+				qFatal("Cannot load %s: %s",
+					qPrintable(m_loader.fileName()),
+					qPrintable(m_loader.errorString()));
+			}
+		}
+
+		/* Objects first, the backend deletes its singletons */
+		~Harness() {
+			qDeleteAll(m_objects.children());
+			if(m_backend) {
+				m_loader.unload();
+			}
+		}
+
+		Harness(const Harness&) = delete;
+		Harness(Harness&&) = delete;
+		auto operator=(const Harness&) -> Harness& = delete;
+		auto operator=(Harness&&) -> Harness& = delete;
+
+		[[nodiscard]]
+		auto backend() const -> QObject* {
+			return m_backendObject;
+		}
+
+		/* Owned by the harness unless a parent is given */
+		[[nodiscard]]
+		auto create(BackendInterface::Class type,
+			QObject* parent = nullptr,
+			const QList<QVariant>& args = {}) -> QObject* {
+			return m_backend->createObject(
+				type, parent ? parent : &m_objects, args);
+		}
+
+		[[nodiscard]]
+		auto statistics() const -> QVariantMap {
+			if(!m_backendObject) {
+				return {};
+			}
+			return m_backendObject->property("statistics").toMap();
+		}
+
+		[[nodiscard]]
+		auto media() -> MediaGenerator& {
+			return m_media;
+		}
+
+		[[nodiscard]]
+		auto report() -> Report& {
+			return m_report;
+		}
+
+		[[nodiscard]]
+		auto iterations() const -> int {
+			return m_iterations;
+		}
+
+		/* CPU time of the calling thread in µs */
+		[[nodiscard]]
+		static auto threadCpuTime() -> qint64 {
+			timespec time{};
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+			return static_cast<qint64>(time.tv_sec) * 1'000'000
+				+ time.tv_nsec / NSEC_PER_USEC;
+		}
+
+		/* Peak resident set size of the process in KiB */
+		[[nodiscard]]
+		static auto peakMemory() -> qint64 {
+			return memoryStatus("VmHWM:"_ba);
+		}
+
+		/* Current resident set size of the process in KiB */
+		[[nodiscard]]
+		static auto residentMemory() -> qint64 {
+			return memoryStatus("VmRSS:"_ba);
+		}
+
+		/* Adds the statistics of the backend and writes the report,
+		 * returns the exit code */
+		[[nodiscard]]
+		auto finish() -> int {
+			if(m_backend) {
+				m_report.set("plugin"_L1, m_loader.fileName());
+			}
+			m_report.setBackend(statistics());
+			return m_report.write(m_output) ? 0 : 1;
+		}
+
+	  private:
+		static auto memoryStatus(const QByteArray& key) -> qint64 {
+			QFile status{"/proc/self/status"_L1};
+			if(!status.open(QIODevice::ReadOnly | QIODevice::Text)) {
+				return -1;
+			}
+			for(const auto& line: status.readAll().split('\n')) {
+				if(line.startsWith(key)) {
+					/* "VmHWM:	  123456 kB" */
+					return line.mid(key.size())
+						.trimmed()
+						.split(' ')
+						.first()
+						.toLongLong();
+				}
+			}
+			return -1;
+		}
+
+		QTemporaryDir m_directory;
+		Report m_report;
+		MediaGenerator m_media;
+		QPluginLoader m_loader;
+		QObject* m_backendObject{};
+		BackendInterface* m_backend{};
+		QObject m_objects;
+		QString m_output;
+		int m_iterations{DEFAULT_ITERATIONS};
+	};
+} // namespace Phonon::Native::Testing
+
+#include "harness.moc"
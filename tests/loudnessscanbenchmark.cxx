@@ -0,0 +1,105 @@
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QList>
+#include <QMetaObject>
+#include <QTest>
+#include <QThread>
+#include <QUrl>
+#include <QVariantList>
+#include <QVariantMap>
+#include <algorithm>
+
+#define FILES 16
+#define SOURCE_LENGTH 30'000
+#define FREQUENCY 440.0
+#define TIMEOUT 300'000
+#define MSEC_PER_MINUTE 60'000.0
+#define MSEC_PER_HOUR 3'600'000.0
+
+import phonon_native_testing;
+
+using namespace Phonon::Native::Testing;
+using Qt::Literals::StringLiterals::operator""_L1;
+
+namespace {
+	/* ms to scan FILES new files with the given number of threads, -1 on
+	 * timeout. Measured files stay in the cache, so every run generates
+	 * its own and removes them after. */
+	auto scan(Harness& harness, int threads, int run) -> qint64 {
+		QList<QUrl> urls;
+		for(auto file{0}; file < FILES; file++) {
+			urls << harness.media().tone("scan-"_L1 + QString::number(run)
+					+ '-' + QString::number(file) + ".wav"_L1,
+				SOURCE_LENGTH,
+				FREQUENCY * (file + 1) / 2);
+		}
+		auto* backend{harness.backend()};
+		backend->setProperty("loudnessScanThreads", threads);
+		SignalProbe scanned{backend, SIGNAL(loudnessScanned(QUrl))};
+
+		QElapsedTimer clock;
+		clock.start();
+		QMetaObject::invokeMethod(backend,
+			"scanLoudness",
+			Qt::DirectConnection,
+			Q_ARG(QList<QUrl>, urls));
+		auto done{QTest::qWaitFor(
+			[&]() { return scanned.count() >= FILES; }, TIMEOUT)};
+		auto elapsed{clock.elapsed()};
+		for(const auto& url: urls) {
+			QFile::remove(url.toLocalFile());
+		}
+		return done ? elapsed : -1;
+	}
+} // namespace
+
+/* Throughput of the batch loudness scan through the backend with 1 up to
+ * all cores, in files and hours of audio per minute, and the speedup over
+ * a single thread */
+auto main(int argc, char** argv) -> int {
+	Harness::prepare();
+	QGuiApplication application{argc, argv};
+
+	Harness harness{"loudnessScan"_L1};
+	/* Powers of two and all cores */
+	auto cores{QThread::idealThreadCount()};
+	QList<int> counts;
+	for(auto threads{1}; threads < cores; threads *= 2) {
+		counts << threads;
+	}
+	counts << cores;
+
+	auto run{0};
+	double single{};
+	QVariantList runs;
+	for(auto threads: counts) {
+		QList<qint64> times;
+		for(auto iteration{0}; iteration < harness.iterations(); iteration++) {
+			auto elapsed{scan(harness, threads, run++)};
+			if(elapsed < 0) {
+				qWarning() << "Timed out scanning with" << threads << "threads";
+				return 1;
+			}
+			times << elapsed;
+		}
+		std::sort(times.begin(), times.end());
+		auto minutes{static_cast<double>(times[times.size() / 2])
+			/ MSEC_PER_MINUTE};
+		auto filesPerMinute{FILES / minutes};
+		if(threads == 1) {
+			single = filesPerMinute;
+		}
+		runs << QVariantMap{{"threads"_L1, threads},
+			{"filesPerMinute"_L1, filesPerMinute},
+			{"audioHoursPerMinute"_L1,
+				FILES * SOURCE_LENGTH / MSEC_PER_HOUR / minutes},
+			{"speedup"_L1, filesPerMinute / single}};
+	}
+
+	harness.report().set("cores"_L1, cores);
+	harness.report().set("files"_L1, FILES);
+	harness.report().set("fileLength"_L1, SOURCE_LENGTH);
+	harness.report().set("scan"_L1, runs);
+	return harness.finish();
+}
@@ -0,0 +1,365 @@
+module;
+
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QList>
+#include <QSize>
+#include <QString>
+#include <QUrl>
+#include <QtEndian>
+#include <array>
+#include <cmath>
+#include <numbers>
+#include <utility>
+
+#define SAMPLE_RATE 44'100
+#define CHANNELS 2
+#define AMPLITUDE 16'000.0
+#define MSEC 1000
+#define FLAC_BLOCK 4096
+#define WRITE_BLOCK 4096
+#define FREQUENCY 440.0
+#define AVI_KEYFRAME 0x10U
+#define AVI_HAS_INDEX 0x10U
+
+export module phonon_native_testing:mediagenerator;
+
+using Qt::Literals::StringLiterals::operator""_ba;
+
+export namespace Phonon::Native::Testing {
+	/* Writes small media files for the benchmarks into a directory: 16 bit
+	 * stereo sine tones as WAV, colour bars as uncompressed AVI and tones
+	 * with chapter marks as FLAC. All of them decode without any codec
+	 * beyond what every FFmpeg build has, the files are deterministic. */
+	class MediaGenerator final {
+	  public:
+		explicit MediaGenerator(QString directory):
+			m_directory{std::move(directory)} {}
+
+		~MediaGenerator() = default;
+		MediaGenerator(const MediaGenerator&) = delete;
+		MediaGenerator(MediaGenerator&&) = delete;
+		auto operator=(const MediaGenerator&) -> MediaGenerator& = delete;
+		auto operator=(MediaGenerator&&) -> MediaGenerator& = delete;
+
+		/* Sine of the frequency, duration in ms */
+		[[nodiscard]]
+		auto tone(const QString& name, qint64 duration, double frequency)
+			-> QUrl {
+			auto frames{duration * SAMPLE_RATE / MSEC};
+			auto size{static_cast<quint32>(frames * CHANNELS * 2)};
+			QByteArray header;
+			header += "RIFF"_ba;
+			appendLittle<quint32>(header, size + 36);
+			header += "WAVEfmt "_ba;
+			appendLittle<quint32>(header, 16);
+			appendLittle<quint16>(header, 1);
+			appendLittle<quint16>(header, CHANNELS);
+			appendLittle<quint32>(header, SAMPLE_RATE);
+			appendLittle<quint32>(header, SAMPLE_RATE * CHANNELS * 2);
+			appendLittle<quint16>(header, CHANNELS * 2);
+			appendLittle<quint16>(header, 16);
+			header += "data"_ba;
+			appendLittle<quint32>(header, size);
+
+			return write(name, header, [&](QFile& file) {
+				QByteArray block;
+				for(qint64 offset{0}; offset < frames; offset += WRITE_BLOCK) {
+					block.clear();
+					auto count{qMin<qint64>(WRITE_BLOCK, frames - offset)};
+					for(qint64 i{0}; i < count; i++) {
+						auto sample{this->sample(offset + i, frequency)};
+						appendLittle<qint16>(block, sample);
+						appendLittle<qint16>(block, sample);
+					}
+					file.write(block);
+				}
+			});
+		}
+
+		/* Colour bars with a white column moving one step per frame,
+		 * stored as bottom-up BGR frames in an AVI without audio */
+		[[nodiscard]]
+		auto testPattern(const QString& name,
+			qint64 duration,
+			QSize size,
+			int frameRate) -> QUrl {
+			auto width{size.width() & ~3};
+			auto height{size.height()};
+			auto frames{static_cast<quint32>(duration * frameRate / MSEC)};
+			auto frameSize{static_cast<quint32>(width * height * 3)};
+			auto chunk{frameSize + 8};
+
+			QByteArray mainHeader;
+			appendLittle<quint32>(mainHeader, MSEC * MSEC / frameRate);
+			appendLittle<quint32>(mainHeader, frameSize * frameRate);
+			appendLittle<quint32>(mainHeader, 0);
+			appendLittle<quint32>(mainHeader, AVI_HAS_INDEX);
+			appendLittle<quint32>(mainHeader, frames);
+			appendLittle<quint32>(mainHeader, 0);
+			appendLittle<quint32>(mainHeader, 1);
+			appendLittle<quint32>(mainHeader, frameSize);
+			appendLittle<quint32>(mainHeader, width);
+			appendLittle<quint32>(mainHeader, height);
+			mainHeader += QByteArray(16, '\0');
+
+			QByteArray streamHeader;
+			streamHeader += "vidsDIB "_ba;
+			appendLittle<quint32>(streamHeader, 0);
+			appendLittle<quint32>(streamHeader, 0);
+			appendLittle<quint32>(streamHeader, 0);
+			appendLittle<quint32>(streamHeader, 1);
+			appendLittle<quint32>(streamHeader, frameRate);
+			appendLittle<quint32>(streamHeader, 0);
+			appendLittle<quint32>(streamHeader, frames);
+			appendLittle<quint32>(streamHeader, frameSize);
+			appendLittle<quint32>(streamHeader, ~0U);
+			appendLittle<quint32>(streamHeader, 0);
+			appendLittle<quint16>(streamHeader, 0);
+			appendLittle<quint16>(streamHeader, 0);
+			appendLittle<quint16>(streamHeader, width);
+			appendLittle<quint16>(streamHeader, height);
+
+			QByteArray format;
+			appendLittle<quint32>(format, 40);
+			appendLittle<qint32>(format, width);
+			appendLittle<qint32>(format, height);
+			appendLittle<quint16>(format, 1);
+			appendLittle<quint16>(format, 24);
+			appendLittle<quint32>(format, 0);
+			appendLittle<quint32>(format, frameSize);
+			format += QByteArray(16, '\0');
+
+			auto streamList{"strl"_ba + this->chunk("strh"_ba, streamHeader)
+				+ this->chunk("strf"_ba, format)};
+			auto headerList{"hdrl"_ba + this->chunk("avih"_ba, mainHeader)
+				+ this->chunk("LIST"_ba, streamList)};
+			auto movieSize{4 + frames * chunk};
+
+			QByteArray header;
+			header += "RIFF"_ba;
+			appendLittle<quint32>(header,
+				static_cast<quint32>(4 + 8 + headerList.size() + 8 + movieSize
+					+ 8 + 16 * frames));
+			header += "AVI "_ba;
+			header += this->chunk("LIST"_ba, headerList);
+			header += "LIST"_ba;
+			appendLittle<quint32>(header, movieSize);
+			header += "movi"_ba;
+
+			return write(name, header, [&](QFile& file) {
+				static constexpr std::array<std::array<char, 3>, 7> bars{
+					{{'\xC0', '\xC0', '\xC0'},
+						{'\x00', '\xC0', '\xC0'},
+						{'\xC0', '\xC0', '\x00'},
+						{'\x00', '\xC0', '\x00'},
+						{'\xC0', '\x00', '\xC0'},
+						{'\x00', '\x00', '\xC0'},
+						{'\xC0', '\x00', '\x00'}}};
+				QByteArray line(width * 3, '\0');
+				QByteArray frame;
+				for(quint32 index{0}; index < frames; index++) {
+					auto marker{static_cast<int>(index) % width};
+					for(auto x{0}; x < width; x++) {
+						const auto& bar{bars[x * 7 / width]};
+						for(auto c{0}; c < 3; c++) {
+							line[x * 3 + c] = x == marker ? '\xFF' : bar[c];
+						}
+					}
+					frame = "00db"_ba;
+					appendLittle<quint32>(frame, frameSize);
+					for(auto y{0}; y < height; y++) {
+						frame += line;
+					}
+					file.write(frame);
+				}
+				QByteArray index;
+				index += "idx1"_ba;
+				appendLittle<quint32>(index, 16 * frames);
+				for(quint32 i{0}; i < frames; i++) {
+					index += "00db"_ba;
+					appendLittle<quint32>(index, AVI_KEYFRAME);
+					appendLittle<quint32>(index, 4 + i * chunk);
+					appendLittle<quint32>(index, frameSize);
+				}
+				file.write(index);
+			});
+		}
+
+		/* Tone in FLAC with verbatim subframes and a CHAPTERxx Vorbis
+		 * comment for each start in ms */
+		[[nodiscard]]
+		auto chapters(const QString& name,
+			qint64 duration,
+			const QList<qint64>& starts) -> QUrl {
+			auto frames{duration * SAMPLE_RATE / MSEC};
+
+			QByteArray streamInfo;
+			appendBig<quint16>(streamInfo, FLAC_BLOCK);
+			appendBig<quint16>(streamInfo, FLAC_BLOCK);
+			streamInfo += QByteArray(6, '\0');
+			/* 20 bits rate, 3 bits channels - 1, 5 bits bits per sample - 1
+			 * and 36 bits of samples */
+			auto packed{static_cast<quint64>(SAMPLE_RATE) << 44
+				| static_cast<quint64>(CHANNELS - 1) << 41
+				| static_cast<quint64>(15) << 36
+				| static_cast<quint64>(frames)};
+			appendBig<quint64>(streamInfo, packed);
+			streamInfo += QByteArray(16, '\0');
+
+			QByteArray comments;
+			auto vendor{"phonon-native"_ba};
+			appendLittle<quint32>(
+				comments, static_cast<quint32>(vendor.size()));
+			comments += vendor;
+			appendLittle<quint32>(
+				comments, static_cast<quint32>(starts.size() * 2));
+			auto digits{[](qint64 value, int width) {
+				return QByteArray::number(value).rightJustified(width, '0');
+			}};
+			for(auto i{0}; i < starts.size(); i++) {
+				auto key{"CHAPTER"_ba + digits(i + 1, 2)};
+				auto start{starts[i]};
+				for(const auto& comment:
+					{key + '=' + digits(start / 3'600'000, 2) + ':'
+							+ digits(start / 60'000 % 60, 2) + ':'
+							+ digits(start / MSEC % 60, 2) + '.'
+							+ digits(start % MSEC, 3),
+						key + "NAME=Chapter "_ba + QByteArray::number(i + 1)}) {
+					appendLittle<quint32>(
+						comments, static_cast<quint32>(comment.size()));
+					comments += comment;
+				}
+			}
+
+			QByteArray header{"fLaC"_ba};
+			header += metadataBlock(0, streamInfo, false);
+			header += metadataBlock(4, comments, true);
+
+			return write(name, header, [&](QFile& file) {
+				QByteArray frame;
+				quint32 number{0};
+				for(qint64 offset{0}; offset < frames;
+					offset += FLAC_BLOCK, number++) {
+					auto count{static_cast<int>(
+						qMin<qint64>(FLAC_BLOCK, frames - offset))};
+					flacFrame(frame, number, offset, count);
+					file.write(frame);
+				}
+			});
+		}
+
+	  private:
+		template<typename T>
+		static auto appendLittle(QByteArray& data, T value) -> void {
+			std::array<char, sizeof(T)> bytes{};
+			qToLittleEndian(value, bytes.data());
+			data.append(bytes.data(), sizeof(T));
+		}
+
+		template<typename T>
+		static auto appendBig(QByteArray& data, T value) -> void {
+			std::array<char, sizeof(T)> bytes{};
+			qToBigEndian(value, bytes.data());
+			data.append(bytes.data(), sizeof(T));
+		}
+
+		static auto chunk(const QByteArray& id, const QByteArray& data)
+			-> QByteArray {
+			auto result{id};
+			appendLittle<quint32>(result, static_cast<quint32>(data.size()));
+			return result + data;
+		}
+
+		static auto metadataBlock(int type, const QByteArray& data, bool last)
+			-> QByteArray {
+			QByteArray result;
+			appendBig<quint32>(result,
+				(last ? 0x8000'0000U : 0U) | static_cast<quint32>(type) << 24
+					| static_cast<quint32>(data.size()));
+			return result + data;
+		}
+
+		static auto sample(qint64 index, double frequency) -> qint16 {
+			return static_cast<qint16>(std::lround(AMPLITUDE
+				* std::sin(2.0 * std::numbers::pi * frequency
+					* static_cast<double>(index) / SAMPLE_RATE)));
+		}
+
+		/* Fixed block size frame, 44.1 kHz, independent stereo, 16 bit.
+		 * Only the last frame is shorter, its size follows the header. */
+		static auto flacFrame(
+			QByteArray& frame, quint32 number, qint64 offset, int count)
+			-> void {
+			frame = "\xFF\xF8"_ba;
+			auto blockCode{count == FLAC_BLOCK ? 0xC0 : 0x70};
+			frame += static_cast<char>(blockCode | 0x09);
+			frame += static_cast<char>(0x18);
+			/* Frame number coded like UTF-8 */
+			if(number < 0x80) {
+				frame += static_cast<char>(number);
+			} else if(number < 0x800) {
+				frame += static_cast<char>(0xC0 | number >> 6);
+				frame += static_cast<char>(0x80 | (number & 0x3F));
+			} else {
+				frame += static_cast<char>(0xE0 | number >> 12);
+				frame += static_cast<char>(0x80 | (number >> 6 & 0x3F));
+				frame += static_cast<char>(0x80 | (number & 0x3F));
+			}
+			if(count != FLAC_BLOCK) {
+				appendBig<quint16>(frame, static_cast<quint16>(count - 1));
+			}
+			frame += static_cast<char>(crc8(frame));
+			for(auto channel{0}; channel < CHANNELS; channel++) {
+				/* Verbatim subframe without wasted bits */
+				frame += static_cast<char>(0x02);
+				for(auto i{0}; i < count; i++) {
+					appendBig<qint16>(frame, sample(offset + i, FREQUENCY));
+				}
+			}
+			appendBig<quint16>(frame, crc16(frame));
+		}
+
+		static auto crc8(const QByteArray& data) -> quint8 {
+			quint8 crc{};
+			for(auto byte: data) {
+				crc ^= static_cast<quint8>(byte);
+				for(auto bit{0}; bit < 8; bit++) {
+					crc = static_cast<quint8>(
+						crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+				}
+			}
+			return crc;
+		}
+
+		static auto crc16(const QByteArray& data) -> quint16 {
+			quint16 crc{};
+			for(auto byte: data) {
+				crc ^= static_cast<quint16>(static_cast<quint8>(byte) << 8);
+				for(auto bit{0}; bit < 8; bit++) {
+					crc = static_cast<quint16>(
+						crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1);
+				}
+			}
+			return crc;
+		}
+
+		template<typename Body>
+		auto write(const QString& name, const QByteArray& header, Body body)
+			-> QUrl {
+			auto path{QDir{m_directory}.filePath(name)};
+			QFile file{path};
+			if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+				qWarning() << "Cannot write" << path << ":"
+						   << file.errorString();
+				return {};
+			}
+			file.write(header);
+			body(file);
+			return QUrl::fromLocalFile(path);
+		}
+
+		QString m_directory;
+	};
+} // namespace Phonon::Native::Testing
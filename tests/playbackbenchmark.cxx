@@ -0,0 +1,235 @@
+#include <QApplication>
+#include <QList>
+#include <QTest>
+#include <QUrl>
+#include <QVariantMap>
+#include <QWidget>
+#include <phonon/addoninterface.h>
+#include <phonon/backendinterface.h>
+#include <phonon/mediaobjectinterface.h>
+#include <phonon/mediasource.h>
+#include <phonon/phononnamespace.h>
+#include <tuple>
+#include <utility>
+
+#define SOURCE_LENGTH 6000
+#define TRANSITION_LENGTH 1500
+#define TICK_INTERVAL 10
+#define TICK_WINDOW 1000
+#define SEEKS 4
+#define SEEK_SETTLE 500
+#define FRAME_RATE 25
+#define PATTERN_WIDTH 320
+#define PATTERN_HEIGHT 240
+#define FREQUENCY 440.0
+#define NEXT_FREQUENCY 660.0
+#define SAMPLE_RATE 44'100
+#define TIMEOUT 10'000
+#define CHAPTER_TIMEOUT 1000
+
+import phonon_native_testing;
+
+using namespace Phonon;
+using namespace Phonon::Native::Testing;
+using Qt::Literals::StringLiterals::operator""_L1;
+
+namespace {
+	/* Event count of a metric in the statistics of the backend */
+	auto recorded(const Harness& harness, const QString& metric) -> qint64 {
+		return harness.statistics()
+			.value("playback"_L1)
+			.toMap()
+			.value(metric)
+			.toMap()
+			.value("count"_L1)
+			.toLongLong();
+	}
+
+	auto createMediaObject(Harness& harness)
+		-> std::pair<QObject*, MediaObjectInterface*> {
+		auto* object{harness.create(BackendInterface::MediaObjectClass)};
+		auto* media{qobject_cast<MediaObjectInterface*>(object)};
+		media->setTickInterval(TICK_INTERVAL);
+		return {object, media};
+	}
+
+	/* Time from setSource() to the media being loaded and to the first
+	 * tick and the CPU time of the GUI thread per tick during playback */
+	auto measurePlayback(Harness& harness, const QUrl& url) -> QVariantMap {
+		QList<qint64> loaded;
+		QList<qint64> firstTick;
+		QList<qint64> tickCpu;
+		auto chapters{0};
+		for(auto iteration{0}; iteration < harness.iterations(); iteration++) {
+			auto [object, media]{createMediaObject(harness)};
+			SignalProbe load{object,
+				SIGNAL(stateChanged(Phonon::State, Phonon::State)),
+				loadedState};
+			SignalProbe tick{object, SIGNAL(tick(qint64))};
+
+			load.arm();
+			tick.arm();
+			media->setSource(MediaSource{url});
+			if(!load.wait(TIMEOUT)) {
+				qWarning() << "Timed out loading" << url;
+				delete object;
+				break;
+			}
+			loaded << load.first();
+			if(tick.wait(TIMEOUT)) {
+				firstTick << tick.first();
+			}
+
+			tick.arm();
+			auto cpu{Harness::threadCpuTime()};
+			QTest::qWait(TICK_WINDOW);
+			if(tick.count() > 0) {
+				tickCpu << (Harness::threadCpuTime() - cpu) / tick.count();
+			}
+
+			if(auto* addon{qobject_cast<AddonInterface*>(object)}) {
+				auto available{[&]() {
+					return addon
+						->interfaceCall(AddonInterface::ChapterInterface,
+							AddonInterface::availableChapters)
+						.toInt();
+				}};
+				std::ignore = QTest::qWaitFor(
+					[&]() { return available() > 0; }, CHAPTER_TIMEOUT);
+				chapters = available();
+			}
+
+			media->stop();
+			delete object;
+		}
+
+		return {{"loaded"_L1, Report::summary(loaded)},
+			{"firstTick"_L1, Report::summary(firstTick)},
+			{"tickCpu"_L1, Report::summary(tickCpu)},
+			{"chapters"_L1, chapters}};
+	}
+
+	/* Time from seek() to the first frame at the new position in a video
+	 * widget, for seeks spread over the source. While scrubbing that is
+	 * the frame of the keyframe, the refinement is left to settle before
+	 * the next seek. */
+	auto measureSeeks(Harness& harness, const QUrl& url, bool scrubbing)
+		-> QVariantMap {
+		auto* backend{qobject_cast<BackendInterface*>(harness.backend())};
+		harness.backend()->setProperty("scrubbing", scrubbing);
+		QList<qint64> seeks;
+		for(auto iteration{0}; iteration < harness.iterations(); iteration++) {
+			auto [object, media]{createMediaObject(harness)};
+			auto* widget{qobject_cast<QWidget*>(
+				harness.create(BackendInterface::VideoWidgetClass))};
+			widget->show();
+			backend->connectNodes(object, widget);
+			SignalProbe load{object,
+				SIGNAL(stateChanged(Phonon::State, Phonon::State)),
+				loadedState};
+			media->setSource(MediaSource{url});
+			if(!load.wait(TIMEOUT)) {
+				qWarning() << "Timed out loading" << url;
+				delete widget;
+				delete object;
+				break;
+			}
+			for(auto seek{0}; media->isSeekable() && seek < SEEKS; seek++) {
+				auto count{recorded(harness, "seek"_L1)};
+				media->seek(media->totalTime() * (seek + 1) / (SEEKS + 2));
+				if(QTest::qWaitFor(
+					   [&]() { return recorded(harness, "seek"_L1) > count; },
+					   TIMEOUT)) {
+					seeks << object->property("seekLatency").toLongLong()
+							* 1000;
+				}
+				QTest::qWait(SEEK_SETTLE);
+			}
+			media->stop();
+			backend->disconnectNodes(object, widget);
+			delete widget;
+			delete object;
+		}
+		harness.backend()->setProperty("scrubbing", false);
+		return Report::summary(seeks);
+	}
+
+	/* Gapless transitions from one tone to the next queued with
+	 * setNextSource(), in samples at the output rate and in ms */
+	auto measureTransitions(Harness& harness,
+		const QUrl& first,
+		const QUrl& second) -> QVariantMap {
+		QList<qint64> gaps;
+		QVariantList samples;
+		for(auto iteration{0}; iteration < harness.iterations(); iteration++) {
+			auto [object, media]{createMediaObject(harness)};
+			SignalProbe load{object,
+				SIGNAL(stateChanged(Phonon::State, Phonon::State)),
+				loadedState};
+			SignalProbe switched{
+				object, SIGNAL(currentSourceChanged(Phonon::MediaSource))};
+			load.arm();
+			media->setSource(MediaSource{first});
+			if(!load.wait(TIMEOUT)) {
+				qWarning() << "Timed out loading" << first;
+				delete object;
+				break;
+			}
+			/* Queued while playing, prerolled ahead of the end */
+			media->setNextSource(MediaSource{second});
+			switched.arm();
+			auto count{recorded(harness, "transitionGap"_L1)};
+			if(switched.wait(TRANSITION_LENGTH + TIMEOUT)
+				&& QTest::qWaitFor(
+					[&]() {
+						return recorded(harness, "transitionGap"_L1) > count;
+					},
+					TIMEOUT)) {
+				auto gap{object->property("transitionGap").toLongLong()};
+				samples << gap;
+				gaps << gap * 1'000'000 / SAMPLE_RATE;
+			} else {
+				qWarning() << "No transition measured from" << first;
+			}
+			media->stop();
+			delete object;
+		}
+		auto result{Report::summary(gaps)};
+		result.insert("samples"_L1, samples);
+		return result;
+	}
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+	Harness::prepare();
+	QApplication application{argc, argv};
+	qRegisterMetaType<State>();
+	qRegisterMetaType<MediaSource>();
+
+	Harness harness{"playback"_L1};
+	auto& media{harness.media()};
+	QList<std::pair<QString, QUrl>> sources{
+		{"tone"_L1, media.tone("tone.wav"_L1, SOURCE_LENGTH, FREQUENCY)},
+		{"pattern"_L1,
+			media.testPattern("pattern.avi"_L1,
+				SOURCE_LENGTH,
+				{PATTERN_WIDTH, PATTERN_HEIGHT},
+				FRAME_RATE)},
+		{"chapters"_L1,
+			media.chapters("chapters.flac"_L1,
+				SOURCE_LENGTH,
+				{0, SOURCE_LENGTH / 3, SOURCE_LENGTH * 2 / 3})}};
+	for(const auto& [name, url]: sources) {
+		harness.report().set(name, measurePlayback(harness, url));
+	}
+	harness.report().set("seekToFrame"_L1,
+		QVariantMap{{"scrubbingOff"_L1,
+						measureSeeks(harness, sources[1].second, false)},
+			{"scrubbingOn"_L1,
+				measureSeeks(harness, sources[1].second, true)}});
+	harness.report().set("transitionGap"_L1,
+		measureTransitions(harness,
+			media.tone("first.wav"_L1, TRANSITION_LENGTH, FREQUENCY),
+			media.tone("second.wav"_L1, TRANSITION_LENGTH, NEXT_FREQUENCY)));
+	return harness.finish();
+}
@@ -0,0 +1,341 @@
+#include <QByteArray>
+#include <QFile>
+#include <QHostAddress>
+#include <QList>
+#include <QMutex>
+#include <QNetworkProxy>
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThread>
+#include <QTimer>
+#include <QUrl>
+#include <QtEndian>
+#include <algorithm>
+#include <memory>
+#include <sys/stat.h>
+#include <utility>
+
+#define FILE_SIZE (4 * 1024 * 1024)
+#define STREAM_SIZE (2 * 1024 * 1024)
+#define CHUNK (64 * 1024)
+#define READ_SIZE (16 * 1024)
+#define THROTTLE_INTERVAL 5
+#define WINDOW_TIME 2
+#define FULL 100
+#define DURATION 8000
+
+import phonon_native;
+
+using namespace Phonon::Native;
+using Qt::Literals::StringLiterals::operator""_L1;
+using Qt::Literals::StringLiterals::operator""_ba;
+
+namespace {
+	/* Every four bytes hold their own offset, misplaced data shows */
+	auto pattern(qint64 size) -> QByteArray {
+		QByteArray data(size, Qt::Uninitialized);
+		for(qint64 offset{0}; offset + 4 <= size; offset += 4) {
+			qToLittleEndian(static_cast<quint32>(offset), data.data() + offset);
+		}
+		return data;
+	}
+
+	/* Reads up to size bytes, or to the end if size is negative, and
+	 * notes the fill level after every read */
+	auto readAll(ReadAheadDevice& device, qint64 size, QList<int>* levels)
+		-> QByteArray {
+		QByteArray result;
+		while(size < 0 || result.size() < size) {
+			auto wanted{size < 0
+					? READ_SIZE
+					: qMin<qint64>(READ_SIZE, size - result.size())};
+			auto data{device.read(wanted)};
+			if(data.isEmpty()) {
+				break;
+			}
+			result += data;
+			if(levels) {
+				*levels << device.bufferStatus();
+			}
+		}
+		return result;
+	}
+
+	/* Serves one resource over HTTP/1.1 on localhost from a thread of its
+	 * own, CHUNK bytes every THROTTLE_INTERVAL ms. Range requests are
+	 * answered with 206 unless ranges are disabled, then the whole
+	 * resource is sent like some servers do. */
+	class HttpStandIn final {
+	  public:
+		HttpStandIn(QByteArray data, bool ranges):
+			m_data{std::move(data)}, m_ranges{ranges}, m_worker{new QObject{}} {
+			m_worker->moveToThread(&m_thread);
+			m_thread.start();
+			QMetaObject::invokeMethod(
+				m_worker, [this]() { listen(); }, Qt::BlockingQueuedConnection);
+		}
+
+		~HttpStandIn() {
+			m_worker->deleteLater();
+			m_thread.quit();
+			m_thread.wait();
+		}
+
+		HttpStandIn(const HttpStandIn&) = delete;
+		HttpStandIn(HttpStandIn&&) = delete;
+		auto operator=(const HttpStandIn&) -> HttpStandIn& = delete;
+		auto operator=(HttpStandIn&&) -> HttpStandIn& = delete;
+
+		[[nodiscard]]
+		auto url() const -> QUrl {
+			return QUrl{
+				"http://127.0.0.1:"_L1 + QString::number(m_port) + "/media"_L1};
+		}
+
+		/* First offset of every request */
+		[[nodiscard]]
+		auto offsets() const -> QList<qint64> {
+			QMutexLocker lock{&m_mutex};
+			return m_offsets;
+		}
+
+	  private:
+		struct Connection {
+			QByteArray request;
+			qint64 position{-1};
+		};
+
+		auto listen() -> void {
+			auto* server{new QTcpServer{m_worker}};
+			server->listen(QHostAddress::LocalHost);
+			m_port = server->serverPort();
+			QObject::connect(
+				server,
+				&QTcpServer::newConnection,
+				server,
+				[=, this]() {
+					while(auto* socket{server->nextPendingConnection()}) {
+						serve(socket);
+					}
+				},
+				Qt::AutoConnection);
+		}
+
+		auto serve(QTcpSocket* socket) -> void {
+			auto connection{std::make_shared<Connection>()};
+			auto* timer{new QTimer{socket}};
+			timer->setInterval(THROTTLE_INTERVAL);
+			QObject::connect(socket,
+				&QTcpSocket::disconnected,
+				socket,
+				&QObject::deleteLater,
+				Qt::AutoConnection);
+			QObject::connect(
+				socket,
+				&QTcpSocket::readyRead,
+				socket,
+				[=, this]() {
+					connection->request += socket->readAll();
+					if(connection->position >= 0
+						|| !connection->request.contains("\r\n\r\n")) {
+						return;
+					}
+					connection->position = respond(socket, connection->request);
+					timer->start();
+				},
+				Qt::AutoConnection);
+			QObject::connect(
+				timer,
+				&QTimer::timeout,
+				socket,
+				[=, this]() {
+					if(connection->position >= m_data.size()) {
+						timer->stop();
+						socket->disconnectFromHost();
+						return;
+					}
+					if(socket->bytesToWrite() > CHUNK) {
+						return;
+					}
+					socket->write(m_data.mid(connection->position, CHUNK));
+					connection->position += CHUNK;
+				},
+				Qt::AutoConnection);
+		}
+
+		/* Writes the header, returns the offset to send from */
+		auto respond(QTcpSocket* socket, const QByteArray& request) -> qint64 {
+			qint64 offset{};
+			auto range{request.toLower().indexOf("range: bytes="_ba)};
+			if(range >= 0) {
+				auto start{range + qsizetype{13}};
+				offset = request.mid(start, request.indexOf('-', start) - start)
+							 .toLongLong();
+			}
+			{
+				QMutexLocker lock{&m_mutex};
+				m_offsets << offset;
+			}
+			auto size{m_data.size()};
+			QByteArray header;
+			if(m_ranges && offset > 0) {
+				header = "HTTP/1.1 206 Partial Content\r\n"_ba
+					+ "Content-Range: bytes " + QByteArray::number(offset) + '-'
+					+ QByteArray::number(size - 1) + '/'
+					+ QByteArray::number(size) + "\r\n";
+			} else {
+				header = "HTTP/1.1 200 OK\r\n"_ba;
+				offset = 0;
+			}
+			header += "Content-Length: "_ba + QByteArray::number(size - offset)
+				+ "\r\nContent-Type: application/octet-stream\r\n"
+				+ (m_ranges ? "Accept-Ranges: bytes\r\n"_ba : QByteArray{})
+				+ "Connection: close\r\n\r\n";
+			socket->write(header);
+			return offset;
+		}
+
+		QByteArray m_data;
+		bool m_ranges;
+		QThread m_thread;
+		QObject* m_worker;
+		quint16 m_port{};
+		mutable QMutex m_mutex;
+		QList<qint64> m_offsets;
+	};
+} // namespace
+
+/* The read-ahead layer against local files, a throttled pipe standing in
+ * for a slow mount and a throttled HTTP server on localhost */
+class ReadAheadDeviceTest final: public QObject {
+	Q_OBJECT
+
+  private slots:
+	auto initTestCase() -> void {
+		QNetworkProxy::setApplicationProxy(QNetworkProxy::NoProxy);
+		QVERIFY(m_directory.isValid());
+		m_file = m_directory.filePath("media"_L1);
+		QFile file{m_file};
+		QVERIFY(file.open(QIODevice::WriteOnly));
+		QCOMPARE(file.write(pattern(FILE_SIZE)), FILE_SIZE);
+	}
+
+	auto init() -> void {
+		ReadAheadDevice::windowTime = WINDOW_TIME;
+	}
+
+	auto localFile() -> void {
+		ReadAheadDevice device{QUrl::fromLocalFile(m_file), nullptr};
+		QVERIFY(!device.isSequential());
+		QCOMPARE(device.size(), FILE_SIZE);
+		QCOMPARE(readAll(device, -1, nullptr), pattern(FILE_SIZE));
+		QVERIFY(device.atEnd());
+		QCOMPARE(device.bufferStatus(), FULL);
+	}
+
+	/* The window is sized by the bitrate, 2 s of a 4 MiB file of 8 s are
+	 * 1 MiB. The fill level drops as the player reads and recovers. */
+	auto window() -> void {
+		ReadAheadDevice device{QUrl::fromLocalFile(m_file), nullptr};
+		device.setDuration(DURATION);
+		QTRY_COMPARE(device.bufferStatus(), FULL);
+		QVERIFY(device.bytesAvailable() < FILE_SIZE);
+
+		auto window{FILE_SIZE / 4};
+		QCOMPARE(readAll(device, window * 3 / 4, nullptr),
+			pattern(FILE_SIZE).first(window * 3 / 4));
+		QVERIFY(device.bufferStatus() < FULL);
+		QTRY_COMPARE(device.bufferStatus(), FULL);
+	}
+
+	auto seek() -> void {
+		auto data{pattern(FILE_SIZE)};
+		ReadAheadDevice device{QUrl::fromLocalFile(m_file), nullptr};
+		device.setDuration(DURATION);
+		for(auto position: {qint64{CHUNK},
+				qint64{FILE_SIZE * 3 / 4},
+				qint64{CHUNK * 3},
+				qint64{FILE_SIZE - READ_SIZE}}) {
+			QVERIFY(device.seek(position));
+			QCOMPARE(readAll(device, READ_SIZE, nullptr),
+				data.sliced(position, READ_SIZE));
+		}
+	}
+
+	/* A pipe fed in chunks stands in for a slow mount */
+	auto throttledFile() -> void {
+		auto path{m_directory.filePath("pipe"_L1)};
+		QVERIFY(mkfifo(QFile::encodeName(path).constData(), 0600) == 0);
+		auto data{pattern(STREAM_SIZE)};
+		std::unique_ptr<QThread> writer{QThread::create([&]() {
+			QFile pipe{path};
+			if(!pipe.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+				return;
+			}
+			for(qint64 offset{0}; offset < data.size(); offset += CHUNK) {
+				pipe.write(data.mid(offset, CHUNK));
+				QThread::msleep(THROTTLE_INTERVAL);
+			}
+		})};
+		writer->start();
+
+		QList<int> levels;
+		{
+			ReadAheadDevice device{QUrl::fromLocalFile(path), nullptr};
+			QVERIFY(device.isSequential());
+			QCOMPARE(readAll(device, -1, &levels), data);
+			QCOMPARE(device.bufferStatus(), FULL);
+		}
+		writer->wait();
+		QVERIFY(std::any_of(levels.begin(), levels.end(), [](int level) {
+			return level < FULL;
+		}));
+	}
+
+	auto http() -> void {
+		auto data{pattern(STREAM_SIZE)};
+		HttpStandIn server{data, true};
+		QList<int> levels;
+		ReadAheadDevice device{server.url(), nullptr};
+		QCOMPARE(readAll(device, -1, &levels), data);
+		QCOMPARE(device.size(), STREAM_SIZE);
+		QCOMPARE(device.bufferStatus(), FULL);
+		QVERIFY(std::any_of(levels.begin(), levels.end(), [](int level) {
+			return level < FULL;
+		}));
+	}
+
+	/* Seeks past the window restart the download with a range request */
+	auto httpSeek() -> void {
+		auto data{pattern(STREAM_SIZE)};
+		HttpStandIn server{data, true};
+		ReadAheadDevice device{server.url(), nullptr};
+		QCOMPARE(readAll(device, READ_SIZE, nullptr), data.first(READ_SIZE));
+		auto position{qint64{STREAM_SIZE - CHUNK}};
+		QVERIFY(device.seek(position));
+		QCOMPARE(readAll(device, -1, nullptr), data.sliced(position));
+		QVERIFY(server.offsets().contains(position));
+	}
+
+	/* Servers without range support are skipped forward */
+	auto httpWithoutRanges() -> void {
+		auto data{pattern(STREAM_SIZE)};
+		HttpStandIn server{data, false};
+		ReadAheadDevice device{server.url(), nullptr};
+		QCOMPARE(readAll(device, READ_SIZE, nullptr), data.first(READ_SIZE));
+		auto position{qint64{STREAM_SIZE - CHUNK}};
+		QVERIFY(device.seek(position));
+		QCOMPARE(readAll(device, -1, nullptr), data.sliced(position));
+	}
+
+  private:
+	QTemporaryDir m_directory;
+	QString m_file;
+};
+
+QTEST_GUILESS_MAIN(ReadAheadDeviceTest)
+
+#include "readaheaddevicetest.moc"
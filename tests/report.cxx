@@ -0,0 +1,114 @@
+module;
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QList>
+#include <QString>
+#include <QVariantMap>
+#include <QtDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+#define USEC_PER_MSEC 1000.0
+#define PERCENTILE_50 0.50
+#define PERCENTILE_95 0.95
+#define PERCENTILE_99 0.99
+
+export module phonon_native_testing:report;
+
+using Qt::Literals::StringLiterals::operator""_L1;
+
+export namespace Phonon::Native::Testing {
+	/* Results of one benchmark run, written as a single JSON object:
+	 * {"benchmark", "results", "backend"}. Latencies are given in ms with
+	 * {count, min, p50, p95, p99, max, mean} like the statistics of the
+	 * backend. */
+	class Report final {
+	  public:
+		explicit Report(QString name): m_name{std::move(name)} {}
+
+		~Report() = default;
+		Report(const Report&) = delete;
+		Report(Report&&) = delete;
+		auto operator=(const Report&) -> Report& = delete;
+		auto operator=(Report&&) -> Report& = delete;
+
+		/* Samples in µs */
+		[[nodiscard]]
+		static auto summary(QList<qint64> samples) -> QVariantMap {
+			if(samples.isEmpty()) {
+				return {{"count"_L1, 0}};
+			}
+			std::sort(samples.begin(), samples.end());
+			auto at{[&](double fraction) {
+				auto rank{static_cast<qsizetype>(
+					std::ceil(fraction * static_cast<double>(samples.size())))};
+				return milliseconds(samples[qBound<qsizetype>(
+					0, rank - 1, samples.size() - 1)]);
+			}};
+			qint64 sum{};
+			for(auto sample: samples) {
+				sum += sample;
+			}
+			return {{"count"_L1, samples.size()},
+				{"min"_L1, milliseconds(samples.first())},
+				{"p50"_L1, at(PERCENTILE_50)},
+				{"p95"_L1, at(PERCENTILE_95)},
+				{"p99"_L1, at(PERCENTILE_99)},
+				{"max"_L1, milliseconds(samples.last())},
+				{"mean"_L1,
+					static_cast<double>(sum)
+						/ static_cast<double>(samples.size()) / USEC_PER_MSEC}};
+		}
+
+		auto set(const QString& key, const QVariant& value) -> void {
+			m_results.insert(key, value);
+		}
+
+		auto setLatency(const QString& key, const QList<qint64>& samples)
+			-> void {
+			m_results.insert(key, summary(samples));
+		}
+
+		auto setBackend(const QVariantMap& statistics) -> void {
+			m_backend = statistics;
+		}
+
+		/* To the file, or to stdout if the path is empty or "-" */
+		[[nodiscard]]
+		auto write(const QString& path) const -> bool {
+			QVariantMap report{{"benchmark"_L1, m_name},
+				{"results"_L1, m_results},
+				{"backend"_L1, m_backend}};
+			auto json{QJsonDocument::fromVariant(report).toJson(
+				QJsonDocument::Indented)};
+			if(path.isEmpty() || path == "-"_L1) {
+				std::fwrite(json.constData(),
+					1,
+					static_cast<std::size_t>(json.size()),
+					stdout);
+				std::fflush(stdout);
+				return true;
+			}
+			QFile file{path};
+			if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+				|| file.write(json) != json.size()) {
+				qWarning() << "Cannot write report to" << path << ":"
+						   << file.errorString();
+				return false;
+			}
+			return true;
+		}
+
+	  private:
+		static auto milliseconds(qint64 usec) -> double {
+			return static_cast<double>(usec) / USEC_PER_MSEC;
+		}
+
+		QString m_name;
+		QVariantMap m_results;
+		QVariantMap m_backend;
+	};
+} // namespace Phonon::Native::Testing
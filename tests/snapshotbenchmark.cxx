@@ -0,0 +1,139 @@
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QGuiApplication>
+#include <QImage>
+#include <QList>
+#include <QSize>
+#include <QVariantMap>
+#include <QVideoFrame>
+#include <QVideoFrameFormat>
+#include <QtConcurrentRun>
+#include <utility>
+
+#define FRAME_WIDTH 3840
+#define FRAME_HEIGHT 2160
+#define THUMBNAIL_WIDTH 320
+#define THUMBNAIL_HEIGHT 180
+#define NSEC_PER_USEC 1000
+
+import phonon_native;
+import phonon_native_testing;
+
+using namespace Phonon::Native;
+using namespace Phonon::Native::Testing;
+using Qt::Literals::StringLiterals::operator""_L1;
+
+namespace {
+	/* A 4K frame with a luma ramp across and chroma ramps down and across,
+	 * so that no plane is uniform */
+	auto frame(QVideoFrameFormat::PixelFormat pixelFormat) -> QVideoFrame {
+		QVideoFrame result{
+			QVideoFrameFormat{{FRAME_WIDTH, FRAME_HEIGHT}, pixelFormat}};
+		if(!result.map(QVideoFrame::WriteOnly)) {
+			return {};
+		}
+		for(auto plane{0}; plane < result.planeCount(); plane++) {
+			auto* bits{result.bits(plane)};
+			auto stride{result.bytesPerLine(plane)};
+			auto rows{plane == 0 ? FRAME_HEIGHT : FRAME_HEIGHT / 2};
+			for(auto y{0}; y < rows; y++) {
+				for(auto x{0}; x < stride; x++) {
+					auto value{plane == 0 ? x * 255 / stride : x + y * plane};
+					bits[y * stride + x] = static_cast<uchar>(value % 256);
+				}
+			}
+		}
+		result.unmap();
+		return result;
+	}
+
+	template<typename Function>
+	auto time(Function function, QList<qint64>* times) -> QImage {
+		QElapsedTimer clock;
+		clock.start();
+		auto image{function()};
+		*times << clock.nsecsElapsed() / NSEC_PER_USEC;
+		return image;
+	}
+
+	/* The synchronous conversions at full and thumbnail size, against
+	 * QVideoFrame::toImage(), and the asynchronous thumbnail as taken by
+	 * the video widget: the time the caller is held up and the time to
+	 * the result. toImage() keeps its image in the frame, so it is given
+	 * a new one each time. */
+	auto measure(Harness& harness, QVideoFrameFormat::PixelFormat format)
+		-> QVariantMap {
+		QSize thumbnail{THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT};
+		QList<qint64> toImage;
+		QList<qint64> toImageScaled;
+		QList<qint64> full;
+		QList<qint64> scaled;
+		QList<qint64> caller;
+		QList<qint64> result;
+		for(auto iteration{0}; iteration < harness.iterations(); iteration++) {
+			auto source{frame(format)};
+			time(
+				[&]() {
+					return FrameConverter::convert(
+						source, {}, Qt::KeepAspectRatio);
+				},
+				&full);
+			time(
+				[&]() {
+					return FrameConverter::convert(
+						source, thumbnail, Qt::KeepAspectRatio);
+				},
+				&scaled);
+
+			QElapsedTimer clock;
+			clock.start();
+			auto future{QtConcurrent::run(&FrameConverter::convert,
+				source,
+				thumbnail,
+				Qt::KeepAspectRatio)};
+			caller << clock.nsecsElapsed() / NSEC_PER_USEC;
+			future.waitForFinished();
+			result << clock.nsecsElapsed() / NSEC_PER_USEC;
+
+			time([&]() { return source.toImage(); }, &toImage);
+			source = frame(format);
+			time(
+				[&]() {
+					return source.toImage().scaled(thumbnail,
+						Qt::KeepAspectRatio,
+						Qt::SmoothTransformation);
+				},
+				&toImageScaled);
+		}
+		return {{"toImage"_L1, Report::summary(toImage)},
+			{"toImageScaled"_L1, Report::summary(toImageScaled)},
+			{"convert"_L1, Report::summary(full)},
+			{"convertScaled"_L1, Report::summary(scaled)},
+			{"asyncCaller"_L1, Report::summary(caller)},
+			{"asyncResult"_L1, Report::summary(result)}};
+	}
+} // namespace
+
+/* Snapshots of 4K 4:2:0 frames at full size and as thumbnails, with the
+ * converter of the video widget and with QVideoFrame::toImage() as the
+ * synchronous snapshot did before */
+auto main(int argc, char** argv) -> int {
+	Harness::prepare();
+	QGuiApplication application{argc, argv};
+	Harness harness{"snapshot"_L1, false};
+
+	for(const auto& [name, format]:
+		{std::pair{"nv12"_L1, QVideoFrameFormat::Format_NV12},
+			std::pair{"yuv420p"_L1, QVideoFrameFormat::Format_YUV420P}}) {
+		if(!frame(format).isValid()) {
+			qWarning() << "Cannot create a frame of" << format;
+			return 1;
+		}
+		harness.report().set(name, measure(harness, format));
+	}
+	harness.report().set("frameWidth"_L1, FRAME_WIDTH);
+	harness.report().set("frameHeight"_L1, FRAME_HEIGHT);
+	harness.report().set("thumbnailWidth"_L1, THUMBNAIL_WIDTH);
+	harness.report().set("thumbnailHeight"_L1, THUMBNAIL_HEIGHT);
+	return harness.finish();
+}
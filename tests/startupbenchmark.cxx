@@ -0,0 +1,94 @@
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QList>
+#include <QTest>
+#include <QUrl>
+#include <QVariantMap>
+#include <phonon/backendinterface.h>
+#include <phonon/mediaobjectinterface.h>
+#include <phonon/mediasource.h>
+#include <phonon/phononnamespace.h>
+
+#define SOURCE_LENGTH 2000
+#define FREQUENCY 440.0
+#define POOL_CAPACITY 2
+#define SETTLE_TIME 100
+#define TIMEOUT 10'000
+#define NSEC_PER_USEC 1000
+
+import phonon_native_testing;
+
+using namespace Phonon;
+using namespace Phonon::Native::Testing;
+using Qt::Literals::StringLiterals::operator""_L1;
+
+namespace {
+	struct Startup {
+		QList<qint64> construction;
+		QList<qint64> loaded;
+	};
+
+	/* Creates a media object, sets the source and waits for the media to
+	 * be loaded. Both times are taken from before createObject(). */
+	auto start(Harness& harness, const QUrl& url, Startup* startup) -> bool {
+		QElapsedTimer clock;
+		clock.start();
+		auto* object{harness.create(BackendInterface::MediaObjectClass)};
+		auto constructed{clock.nsecsElapsed() / NSEC_PER_USEC};
+		auto* media{qobject_cast<MediaObjectInterface*>(object)};
+		SignalProbe load{object,
+			SIGNAL(stateChanged(Phonon::State, Phonon::State)),
+			loadedState};
+		media->setSource(MediaSource{url});
+		auto loaded{load.wait(TIMEOUT)};
+		if(loaded && startup) {
+			startup->construction << constructed;
+			startup->loaded << clock.nsecsElapsed() / NSEC_PER_USEC;
+		}
+		media->stop();
+		delete object;
+		return loaded;
+	}
+
+	auto summary(const Startup& startup) -> QVariantMap {
+		return {{"construction"_L1, Report::summary(startup.construction)},
+			{"loaded"_L1, Report::summary(startup.loaded)}};
+	}
+} // namespace
+
+/* Time to the first LoadedMedia of a new media object with players taken
+ * from the warm pool and with the pool disabled. The runs alternate, and
+ * both let the event loop settle before, so that the pool is refilled. */
+auto main(int argc, char** argv) -> int {
+	Harness::prepare();
+	QGuiApplication application{argc, argv};
+	qRegisterMetaType<State>();
+
+	Harness harness{"startup"_L1};
+	auto url{harness.media().tone("tone.wav"_L1, SOURCE_LENGTH, FREQUENCY)};
+	auto* backend{harness.backend()};
+	backend->setProperty("playerPoolCapacity", POOL_CAPACITY);
+
+	/* Loads the multimedia plugin and the decoders once for both */
+	if(!start(harness, url, nullptr)) {
+		qWarning() << "Timed out loading" << url;
+		return 1;
+	}
+
+	Startup pooled;
+	Startup unpooled;
+	for(auto iteration{0}; iteration < harness.iterations(); iteration++) {
+		backend->setProperty("playerPoolCapacity", 0);
+		QTest::qWait(SETTLE_TIME);
+		start(harness, url, &unpooled);
+
+		backend->setProperty("playerPoolCapacity", POOL_CAPACITY);
+		QTest::qWait(SETTLE_TIME);
+		start(harness, url, &pooled);
+	}
+
+	harness.report().set("pooled"_L1, summary(pooled));
+	harness.report().set("unpooled"_L1, summary(unpooled));
+	harness.report().set("poolCapacity"_L1, POOL_CAPACITY);
+	return harness.finish();
+}
@@ -0,0 +1,192 @@
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QList>
+#include <QMetaObject>
+#include <QThread>
+#include <QVariantList>
+#include <QVariantMap>
+#include <algorithm>
+#include <atomic>
+#include <phonon/AbstractMediaStream>
+#include <phonon/MediaSource>
+
+#define SOURCE_LENGTH 300'000
+#define FREQUENCY 440.0
+#define READ_SIZE (64 * 1024)
+#define NSEC_PER_USEC 1000
+#define BYTES_PER_MB 1'000'000.0
+#define USEC 1'000'000.0
+
+import phonon_native;
+import phonon_native_testing;
+
+using namespace Phonon;
+using namespace Phonon::Native;
+using namespace Phonon::Native::Testing;
+using Qt::Literals::StringLiterals::operator""_L1;
+
+namespace {
+	/* Writes a file held in memory in chunks of a fixed size from the
+	 * thread it lives in, while the reader asks for data. The chunks
+	 * refer to the file, nothing is copied on the way in. */
+	class Producer final: public AbstractMediaStream {
+	  public:
+		Producer(const QByteArray& data, qsizetype chunk):
+			m_data{data}, m_chunk{chunk} {
+			setStreamSize(m_data.size());
+		}
+
+		~Producer() final = default;
+		Producer(const Producer&) = delete;
+		Producer(Producer&&) = delete;
+		auto operator=(const Producer&) -> Producer& = delete;
+		auto operator=(Producer&&) -> Producer& = delete;
+
+		/* Times the reader asked for data and told the producer to stop */
+		[[nodiscard]]
+		auto requests() const -> qint64 {
+			return m_requests;
+		}
+
+		[[nodiscard]]
+		auto throttles() const -> qint64 {
+			return m_throttles;
+		}
+
+	  protected:
+		auto reset() -> void final {
+			m_offset = 0;
+		}
+
+		/* Called from the thread of the reader */
+		auto needData() -> void final {
+			m_requests++;
+			m_wanted = true;
+			QMetaObject::invokeMethod(
+				this, [this]() { produce(); }, Qt::QueuedConnection);
+		}
+
+		auto enoughData() -> void final {
+			m_throttles++;
+			m_wanted = false;
+		}
+
+	  private:
+		auto produce() -> void {
+			while(m_wanted && m_offset < m_data.size()) {
+				auto length{qMin(m_chunk, m_data.size() - m_offset)};
+				writeData(QByteArray::fromRawData(
+					m_data.constData() + m_offset, length));
+				m_offset += length;
+			}
+			if(m_offset >= m_data.size() && !m_ended) {
+				m_ended = true;
+				endOfData();
+			}
+		}
+
+		const QByteArray& m_data;
+		qsizetype m_chunk;
+		qsizetype m_offset{};
+		std::atomic<bool> m_wanted{};
+		std::atomic<qint64> m_requests{};
+		std::atomic<qint64> m_throttles{};
+		bool m_ended{};
+	};
+
+	struct Run {
+		qint64 bytes{};
+		qint64 elapsed{};
+		qint64 stalls{};
+		qint64 stallTime{};
+		qint64 requests{};
+		qint64 throttles{};
+	};
+
+	/* Reads the whole stream like the demuxer does, a read that finds
+	 * the buffer empty counts as a stall */
+	auto stream(const QByteArray& data, qsizetype chunk) -> Run {
+		Run run;
+		QThread thread;
+		Producer producer{data, chunk};
+		StreamReader reader{MediaSource{&producer}, nullptr};
+		producer.moveToThread(&thread);
+		reader.moveToThread(&thread);
+		thread.start();
+
+		QByteArray buffer(READ_SIZE, Qt::Uninitialized);
+		QElapsedTimer clock;
+		clock.start();
+		while(true) {
+			auto stalled{reader.bytesAvailable() == 0};
+			auto started{clock.nsecsElapsed()};
+			auto length{reader.read(buffer.data(), READ_SIZE)};
+			if(length <= 0) {
+				break;
+			}
+			if(stalled) {
+				run.stalls++;
+				run.stallTime +=
+					(clock.nsecsElapsed() - started) / NSEC_PER_USEC;
+			}
+			run.bytes += length;
+		}
+		run.elapsed = clock.nsecsElapsed() / NSEC_PER_USEC;
+		run.requests = producer.requests();
+		run.throttles = producer.throttles();
+
+		thread.quit();
+		thread.wait();
+		return run;
+	}
+} // namespace
+
+/* Throughput of the stream bridge with a producer in the same process,
+ * a generated file pushed in chunks of several sizes from a thread of its
+ * own and read on this one. Stalls are reads that had to wait for the
+ * producer, need and enough data count the backpressure. */
+auto main(int argc, char** argv) -> int {
+	Harness::prepare();
+	QGuiApplication application{argc, argv};
+	Harness harness{"stream"_L1, false};
+
+	QFile file{
+		harness.media().tone("stream.wav"_L1, SOURCE_LENGTH, FREQUENCY)
+			.toLocalFile()};
+	if(!file.open(QIODevice::ReadOnly)) {
+		qWarning() << "Cannot read" << file.fileName();
+		return 1;
+	}
+	auto data{file.readAll()};
+
+	QVariantList runs;
+	for(qsizetype chunk: {4 * 1024, 64 * 1024, 1024 * 1024}) {
+		QList<qint64> times;
+		QVariantList stalls;
+		Run run;
+		for(auto iteration{0}; iteration < harness.iterations(); iteration++) {
+			run = stream(data, chunk);
+			if(run.bytes != data.size()) {
+				qWarning() << "Read" << run.bytes << "of" << data.size();
+				return 1;
+			}
+			times << run.elapsed;
+			stalls << QVariantMap{{"count"_L1, run.stalls},
+				{"time"_L1, run.stallTime / 1000.0}};
+		}
+		std::sort(times.begin(), times.end());
+		runs << QVariantMap{{"chunkSize"_L1, chunk},
+			{"time"_L1, Report::summary(times)},
+			{"megabytesPerSecond"_L1,
+				static_cast<double>(data.size()) / BYTES_PER_MB
+					/ (static_cast<double>(times[times.size() / 2]) / USEC)},
+			{"stalls"_L1, stalls},
+			{"needData"_L1, run.requests},
+			{"enoughData"_L1, run.throttles}};
+	}
+	harness.report().set("bytes"_L1, data.size());
+	harness.report().set("runs"_L1, runs);
+	return harness.finish();
+}
@@ -0,0 +1,5 @@
+export module phonon_native_testing;
+
+export import :harness;
+export import :mediagenerator;
+export import :report;
@@ -0,0 +1,213 @@
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QQuickWindow>
+#include <QSGRendererInterface>
+#include <QTest>
+#include <QUrl>
+#include <QVariantMap>
+#include <QWidget>
+#include <phonon/VideoWidgetInterface>
+#include <phonon/backendinterface.h>
+#include <phonon/mediaobjectinterface.h>
+#include <phonon/mediasource.h>
+#include <phonon/phononnamespace.h>
+#include <tuple>
+#include <utility>
+
+#define SOURCE_LENGTH 10'000
+#define FRAME_RATE 25
+#define PATTERN_WIDTH 640
+#define PATTERN_HEIGHT 480
+#define FRAME_WINDOW 2000
+#define TIMEOUT 10'000
+#define NSEC_PER_USEC 1000
+
+import phonon_native_testing;
+
+using namespace Phonon;
+using namespace Phonon::Native::Testing;
+using Qt::Literals::StringLiterals::operator""_L1;
+using Qt::Literals::StringLiterals::operator""_ba;
+
+namespace {
+	/* Times the frames of all Qt Quick windows, from beforeRendering to
+	 * afterRendering on whichever thread renders them */
+	class FrameProbe final {
+	  public:
+		FrameProbe() {
+			for(auto* window: QGuiApplication::allWindows()) {
+				auto* quick{qobject_cast<QQuickWindow*>(window)};
+				if(!quick) {
+					continue;
+				}
+				m_api = quick->rendererInterface()->graphicsApi();
+				QObject::connect(
+					quick,
+					&QQuickWindow::beforeRendering,
+					quick,
+					[this]() { m_clock.start(); },
+					Qt::DirectConnection);
+				QObject::connect(
+					quick,
+					&QQuickWindow::afterRendering,
+					quick,
+					[this]() {
+						QMutexLocker lock{&m_mutex};
+						m_times << m_clock.nsecsElapsed() / NSEC_PER_USEC;
+					},
+					Qt::DirectConnection);
+			}
+		}
+
+		~FrameProbe() = default;
+		FrameProbe(const FrameProbe&) = delete;
+		FrameProbe(FrameProbe&&) = delete;
+		auto operator=(const FrameProbe&) -> FrameProbe& = delete;
+		auto operator=(FrameProbe&&) -> FrameProbe& = delete;
+
+		/* Graphics API the video is rendered with */
+		[[nodiscard]]
+		auto api() const -> QString {
+			switch(m_api) {
+				case QSGRendererInterface::Software:
+					return "software"_L1;
+				case QSGRendererInterface::OpenGL:
+					return "opengl"_L1;
+				case QSGRendererInterface::Vulkan:
+					return "vulkan"_L1;
+				case QSGRendererInterface::Direct3D11:
+				case QSGRendererInterface::Direct3D12:
+					return "direct3d"_L1;
+				case QSGRendererInterface::Metal:
+					return "metal"_L1;
+				default:
+					return "unknown"_L1;
+			}
+		}
+
+		[[nodiscard]]
+		auto software() const -> bool {
+			return m_api == QSGRendererInterface::Software;
+		}
+
+		/* µs of the frames rendered since the last call */
+		auto take() -> QList<qint64> {
+			QMutexLocker lock{&m_mutex};
+			return std::exchange(m_times, {});
+		}
+
+	  private:
+		QSGRendererInterface::GraphicsApi m_api{
+			QSGRendererInterface::Unknown};
+		QElapsedTimer m_clock;
+		QMutex m_mutex;
+		QList<qint64> m_times;
+	};
+
+	struct Frames {
+		QList<qint64> frame;
+		/* CPU time of the GUI thread per frame, µs */
+		QList<qint64> guiCpu;
+	};
+
+	/* Plays for FRAME_WINDOW ms and collects the frames rendered */
+	auto measure(FrameProbe& probe, Frames* frames) -> void {
+		std::ignore = probe.take();
+		auto cpu{Harness::threadCpuTime()};
+		QTest::qWait(FRAME_WINDOW);
+		auto times{probe.take()};
+		if(times.isEmpty()) {
+			return;
+		}
+		frames->frame << times;
+		frames->guiCpu << (Harness::threadCpuTime() - cpu) / times.size();
+	}
+
+	auto summary(const Frames& frames) -> QVariantMap {
+		return {{"frame"_L1, Report::summary(frames.frame)},
+			{"guiCpu"_L1, Report::summary(frames.guiCpu)},
+			{"frames"_L1, frames.frame.size()}};
+	}
+} // namespace
+
+/* Frame time of a video widget playing a test pattern, with neutral colour
+ * controls, where the colour matrix is bypassed, and with all four
+ * controls set. Runs on OpenGL through the software rasteriser of Mesa
+ * unless the environment asks for another backend, so that the results do
+ * not depend on the GPU. The software renderer of Qt Quick has no shader
+ * effects, the matrix is then reported as unavailable. Run with --plugin
+ * and a build of the MultiEffect version for the baseline. */
+auto main(int argc, char** argv) -> int {
+	if(!qEnvironmentVariableIsSet("QT_QUICK_BACKEND")
+		&& !qEnvironmentVariableIsSet("QSG_RHI_BACKEND")) {
+		qputenv("QSG_RHI_BACKEND", "opengl"_ba);
+		if(!qEnvironmentVariableIsSet("LIBGL_ALWAYS_SOFTWARE")) {
+			qputenv("LIBGL_ALWAYS_SOFTWARE", "1"_ba);
+		}
+	}
+	Harness::prepare();
+	QApplication application{argc, argv};
+	qRegisterMetaType<State>();
+
+	Harness harness{"videoFrame"_L1};
+	auto* backend{qobject_cast<BackendInterface*>(harness.backend())};
+	auto url{harness.media().testPattern("pattern.avi"_L1,
+		SOURCE_LENGTH,
+		{PATTERN_WIDTH, PATTERN_HEIGHT},
+		FRAME_RATE)};
+
+	Frames neutral;
+	Frames adjusted;
+	QString api;
+	auto matrix{true};
+	for(auto iteration{0}; iteration < harness.iterations(); iteration++) {
+		auto* object{harness.create(BackendInterface::MediaObjectClass)};
+		auto* media{qobject_cast<MediaObjectInterface*>(object)};
+		auto* widget{qobject_cast<QWidget*>(
+			harness.create(BackendInterface::VideoWidgetClass))};
+		auto* controls{qobject_cast<VideoWidgetInterface44*>(widget)};
+		widget->resize(PATTERN_WIDTH, PATTERN_HEIGHT);
+		widget->show();
+		std::ignore = QTest::qWaitForWindowExposed(widget);
+		backend->connectNodes(object, widget);
+		FrameProbe probe;
+
+		SignalProbe load{object,
+			SIGNAL(stateChanged(Phonon::State, Phonon::State)),
+			loadedState};
+		media->setSource(MediaSource{url});
+		if(!load.wait(TIMEOUT)) {
+			qWarning() << "Timed out loading" << url;
+			return 1;
+		}
+		media->play();
+		measure(probe, &neutral);
+		api = probe.api();
+		matrix = !probe.software();
+
+		if(matrix) {
+			controls->setBrightness(0.1);
+			controls->setContrast(0.2);
+			controls->setHue(0.3);
+			controls->setSaturation(-0.2);
+			measure(probe, &adjusted);
+		}
+
+		media->stop();
+		backend->disconnectNodes(object, widget);
+		delete widget;
+		delete object;
+	}
+
+	harness.report().set("renderer"_L1, api);
+	harness.report().set("neutral"_L1, summary(neutral));
+	if(matrix) {
+		harness.report().set("adjusted"_L1, summary(adjusted));
+	} else {
+		harness.report().set("adjusted"_L1,
+			"unavailable with the software renderer"_L1);
+	}
+	return harness.finish();
+}
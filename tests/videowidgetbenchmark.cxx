@@ -0,0 +1,83 @@
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QGridLayout>
+#include <QList>
+#include <QTest>
+#include <QVariantList>
+#include <QVariantMap>
+#include <QWidget>
+#include <phonon/backendinterface.h>
+#include <tuple>
+
+#define WIDGET_WIDTH 320
+#define WIDGET_HEIGHT 240
+#define COLUMNS 4
+#define SETTLE_TIME 100
+#define NSEC_PER_USEC 1000
+
+import phonon_native_testing;
+
+using namespace Phonon;
+using namespace Phonon::Native::Testing;
+using Qt::Literals::StringLiterals::operator""_L1;
+
+namespace {
+	struct Widgets {
+		/* µs per widget */
+		QList<qint64> construction;
+		/* Growth of the resident set per widget once shown, KiB */
+		QVariantList memory;
+	};
+
+	/* Creates count video widgets in a grid of one window and shows it, so
+	 * that the scene graph and the render loop exist as well */
+	auto create(Harness& harness, int count, Widgets* widgets) -> void {
+		auto before{Harness::residentMemory()};
+		QWidget window;
+		auto* layout{new QGridLayout{&window}};
+		for(auto widget{0}; widget < count; widget++) {
+			QElapsedTimer clock;
+			clock.start();
+			auto* object{
+				harness.create(BackendInterface::VideoWidgetClass, &window)};
+			widgets->construction << clock.nsecsElapsed() / NSEC_PER_USEC;
+			auto* child{qobject_cast<QWidget*>(object)};
+			child->setMinimumSize(WIDGET_WIDTH, WIDGET_HEIGHT);
+			layout->addWidget(child, widget / COLUMNS, widget % COLUMNS);
+		}
+		window.show();
+		std::ignore = QTest::qWaitForWindowExposed(&window);
+		QTest::qWait(SETTLE_TIME);
+		widgets->memory << (Harness::residentMemory() - before) / count;
+	}
+} // namespace
+
+/* Construction time and memory of video widgets created through the
+ * backend, 1, 4 and 16 at a time. The first widget of the process also
+ * creates the shared QML engine and is reported on its own. Run with
+ * --plugin to compare with a build of another revision. */
+auto main(int argc, char** argv) -> int {
+	Harness::prepare();
+	QApplication application{argc, argv};
+
+	Harness harness{"videoWidget"_L1};
+	Widgets first;
+	create(harness, 1, &first);
+	harness.report().set("first"_L1,
+		QVariantMap{{"construction"_L1, Report::summary(first.construction)},
+			{"memory"_L1, first.memory.first()}});
+
+	QVariantList runs;
+	for(auto count: {1, 4, 16}) {
+		Widgets widgets;
+		for(auto iteration{0}; iteration < harness.iterations(); iteration++) {
+			create(harness, count, &widgets);
+			QTest::qWait(SETTLE_TIME);
+		}
+		runs << QVariantMap{{"widgets"_L1, count},
+			{"construction"_L1, Report::summary(widgets.construction)},
+			{"memoryPerWidget"_L1, widgets.memory}};
+	}
+	harness.report().set("runs"_L1, runs);
+	return harness.finish();
+}
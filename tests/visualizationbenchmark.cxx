@@ -0,0 +1,115 @@
+#include <QAudioBuffer>
+#include <QAudioFormat>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QList>
+#include <QThread>
+#include <QVariantList>
+#include <QVariantMap>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <numbers>
+
+#define SAMPLE_RATE 44'100
+#define CHANNELS 2
+#define FRAME_RATE 30
+#define BAND_COUNT 32
+#define FREQUENCY 440.0
+#define AMPLITUDE 16'000.0
+#define USEC 1'000'000
+#define RUN_TIME 1000
+
+import phonon_native;
+import phonon_native_testing;
+
+using namespace Phonon::Native;
+using namespace Phonon::Native::Testing;
+using Qt::Literals::StringLiterals::operator""_L1;
+
+namespace {
+	/* The audio of one frame at FRAME_RATE */
+	auto buffer() -> QAudioBuffer {
+		QAudioFormat format;
+		format.setSampleRate(SAMPLE_RATE);
+		format.setChannelCount(CHANNELS);
+		format.setSampleFormat(QAudioFormat::Int16);
+		format.setChannelConfig(QAudioFormat::ChannelConfigStereo);
+		auto frames{SAMPLE_RATE / FRAME_RATE};
+		QByteArray data(frames * CHANNELS * 2, Qt::Uninitialized);
+		auto* samples{reinterpret_cast<qint16*>(data.data())};
+		for(auto frame{0}; frame < frames; frame++) {
+			auto value{static_cast<qint16>(std::lround(AMPLITUDE
+				* std::sin(2.0 * std::numbers::pi * FREQUENCY
+					* static_cast<double>(frame) / SAMPLE_RATE)))};
+			samples[frame * CHANNELS] = value;
+			samples[frame * CHANNELS + 1] = value;
+		}
+		return QAudioBuffer{data, format};
+	}
+
+	/* Spectra per second of one analyser per thread, all running for
+	 * RUN_TIME ms at once */
+	auto measure(qsizetype size, int threads) -> double {
+		auto input{buffer()};
+		std::atomic<bool> running{true};
+		std::atomic<qint64> spectra{};
+		QList<std::shared_ptr<QThread>> workers;
+		for(auto i{0}; i < threads; i++) {
+			workers << std::shared_ptr<QThread>{QThread::create([&]() {
+				SpectrumAnalyzer analyzer{size, BAND_COUNT};
+				Spectrum spectrum;
+				qint64 count{};
+				while(running.load(std::memory_order_relaxed)) {
+					analyzer.append(input);
+					analyzer.analyze(spectrum);
+					count++;
+				}
+				spectra.fetch_add(count, std::memory_order_relaxed);
+			})};
+		}
+		QElapsedTimer clock;
+		clock.start();
+		for(const auto& worker: workers) {
+			worker->start();
+		}
+		QThread::msleep(RUN_TIME);
+		running.store(false, std::memory_order_relaxed);
+		for(const auto& worker: workers) {
+			worker->wait();
+		}
+		return static_cast<double>(spectra.load()) * USEC
+			/ static_cast<double>(clock.nsecsElapsed() / 1000);
+	}
+} // namespace
+
+/* Throughput of the spectrum analyser of the visualization node, one
+ * frame of audio appended and analysed per spectrum, with one analyser
+ * per core for 1 up to all cores */
+auto main(int argc, char** argv) -> int {
+	Harness::prepare();
+	QGuiApplication application{argc, argv};
+	Harness harness{"visualization"_L1, false};
+
+	/* Powers of two and all cores */
+	auto cores{QThread::idealThreadCount()};
+	QList<int> counts;
+	for(auto threads{1}; threads < cores; threads *= 2) {
+		counts << threads;
+	}
+	counts << cores;
+
+	for(qsizetype size: {1024, 2048, 4096}) {
+		QVariantList runs;
+		for(auto threads: counts) {
+			auto perSecond{measure(size, threads)};
+			runs << QVariantMap{{"threads"_L1, threads},
+				{"spectraPerSecond"_L1, perSecond},
+				{"spectraPerSecondPerCore"_L1, perSecond / threads}};
+		}
+		harness.report().set("fftSize"_L1 + QString::number(size), runs);
+	}
+	harness.report().set("cores"_L1, cores);
+	return harness.finish();
+}